@@ -0,0 +1,248 @@
+#ifndef __algorithms__key_traits__h__
+#define __algorithms__key_traits__h__
+
+#include <aRibeiroCore/common.h>
+#include <aRibeiroCore/Algorithms.h>
+#include <aRibeiroPlatform/AlgorithmsRadixSIMD.h>
+#include <string.h>
+
+namespace aRibeiro {
+    namespace Sorting {
+
+        //
+        // Key with a 64 bits index (payload), for arrays bigger than 4G elements.
+        //
+        template <typename K>
+        struct IndexKey64 {
+            K toSort;
+            uint64_t index;
+        };
+
+        typedef IndexKey64<int32_t> IndexInt32_64;
+        typedef IndexKey64<uint32_t> IndexUInt32_64;
+        typedef IndexKey64<int64_t> IndexInt64;
+        typedef IndexKey64<uint64_t> IndexUInt64;
+        typedef IndexKey64<float> IndexFloat;
+        typedef IndexKey64<double> IndexDouble;
+
+        //
+        // The sort engine works with the radix key of the elements:
+        //   an unsigned integer with the same order of the element key.
+        //
+        //  - unsigned: the value
+        //  - signed: the value with the sign bit flipped
+        //  - float/double: positive values get the sign bit flipped,
+        //                  negative values get all bits flipped
+        //
+        // The less comparator uses the radix key, so the std::sort and the merge
+        // produce the same order of the radix sort (including -0.0 < 0.0 and NaNs).
+        //
+        template <typename K>
+        struct SortRadixKey;
+
+        template <>
+        struct SortRadixKey<uint32_t> {
+            typedef uint32_t radix_type;
+            static ARIBEIRO_INLINE radix_type get(const uint32_t& v) { return v; }
+        };
+
+        template <>
+        struct SortRadixKey<int32_t> {
+            typedef uint32_t radix_type;
+            static ARIBEIRO_INLINE radix_type get(const int32_t& v) { return (uint32_t)v ^ UINT32_C(0x80000000); }
+        };
+
+        template <>
+        struct SortRadixKey<uint64_t> {
+            typedef uint64_t radix_type;
+            static ARIBEIRO_INLINE radix_type get(const uint64_t& v) { return v; }
+        };
+
+        template <>
+        struct SortRadixKey<int64_t> {
+            typedef uint64_t radix_type;
+            static ARIBEIRO_INLINE radix_type get(const int64_t& v) { return (uint64_t)v ^ UINT64_C(0x8000000000000000); }
+        };
+
+        template <>
+        struct SortRadixKey<float> {
+            typedef uint32_t radix_type;
+            static ARIBEIRO_INLINE radix_type get(const float& v) {
+                uint32_t bits;
+                memcpy(&bits, &v, sizeof(uint32_t));
+                uint32_t mask = (uint32_t)(-(int32_t)(bits >> 31)) | UINT32_C(0x80000000);
+                return bits ^ mask;
+            }
+        };
+
+        template <>
+        struct SortRadixKey<double> {
+            typedef uint64_t radix_type;
+            static ARIBEIRO_INLINE radix_type get(const double& v) {
+                uint64_t bits;
+                memcpy(&bits, &v, sizeof(uint64_t));
+                uint64_t mask = (uint64_t)(-(int64_t)(bits >> 63)) | UINT64_C(0x8000000000000000);
+                return bits ^ mask;
+            }
+        };
+
+        //
+        // Element traits: how to get the radix key of an element.
+        //
+        template <typename T>
+        struct SortKeyTraits {
+            typedef SortRadixKey<T> key;
+            typedef typename key::radix_type radix_type;
+            static ARIBEIRO_INLINE radix_type radixKey(const T& v) { return key::get(v); }
+            static ARIBEIRO_INLINE bool less(const T& a, const T& b) { return radixKey(a) < radixKey(b); }
+        };
+
+        template <>
+        struct SortKeyTraits<IndexInt32> {
+            typedef SortRadixKey<int32_t> key;
+            typedef key::radix_type radix_type;
+            static ARIBEIRO_INLINE radix_type radixKey(const IndexInt32& v) { return key::get(v.toSort); }
+            static ARIBEIRO_INLINE bool less(const IndexInt32& a, const IndexInt32& b) { return radixKey(a) < radixKey(b); }
+        };
+
+        template <>
+        struct SortKeyTraits<IndexUInt32> {
+            typedef SortRadixKey<uint32_t> key;
+            typedef key::radix_type radix_type;
+            static ARIBEIRO_INLINE radix_type radixKey(const IndexUInt32& v) { return key::get(v.toSort); }
+            static ARIBEIRO_INLINE bool less(const IndexUInt32& a, const IndexUInt32& b) { return radixKey(a) < radixKey(b); }
+        };
+
+        template <typename K>
+        struct SortKeyTraits< IndexKey64<K> > {
+            typedef SortRadixKey<K> key;
+            typedef typename key::radix_type radix_type;
+            static ARIBEIRO_INLINE radix_type radixKey(const IndexKey64<K>& v) { return key::get(v.toSort); }
+            static ARIBEIRO_INLINE bool less(const IndexKey64<K>& a, const IndexKey64<K>& b) { return radixKey(a) < radixKey(b); }
+        };
+
+        //
+        // Key + index element used to sort a key column (argsort, sortByKey):
+        //   small: 32 bits index (up to 4G elements), large: 64 bits index.
+        //
+        template <typename K>
+        struct SortKeyIndex;
+
+        template <>
+        struct SortKeyIndex<int32_t> {
+            typedef IndexInt32 small;
+            typedef IndexInt32_64 large;
+        };
+
+        template <>
+        struct SortKeyIndex<uint32_t> {
+            typedef IndexUInt32 small;
+            typedef IndexUInt32_64 large;
+        };
+
+        template <>
+        struct SortKeyIndex<int64_t> {
+            typedef IndexInt64 small;
+            typedef IndexInt64 large;
+        };
+
+        template <>
+        struct SortKeyIndex<uint64_t> {
+            typedef IndexUInt64 small;
+            typedef IndexUInt64 large;
+        };
+
+        template <>
+        struct SortKeyIndex<float> {
+            typedef IndexFloat small;
+            typedef IndexFloat large;
+        };
+
+        template <>
+        struct SortKeyIndex<double> {
+            typedef IndexDouble small;
+            typedef IndexDouble large;
+        };
+
+        template <typename T>
+        struct SortKeyLess {
+            ARIBEIRO_INLINE bool operator()(const T& a, const T& b) const { return SortKeyTraits<T>::less(a, b); }
+        };
+
+        //
+        // Bucket of the element in the hybrid sorts: the 7 most significant bits
+        // of the radix key (128 buckets).
+        //
+        template <typename T>
+        ARIBEIRO_INLINE size_t radix_key_bucket(const T& element) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
+            return (size_t)(SortKeyTraits<T>::radixKey(element) >> (sizeof(radix_type) * 8 - 7));
+        }
+
+        //
+        // LSD radix sort (8 bits digits) of any element with SortKeyTraits.
+        //
+        // The histograms of all digits are computed in one read pass,
+        // and the passes where all elements have the same digit are skipped.
+        //
+        // tmp must have room for size elements.
+        //
+        // The 32 bits keys use the SIMD kernels (AlgorithmsRadixSIMD.h).
+        //
+        template <typename T>
+        void radix_counting_sort_key(T* A, size_t size, T* tmp) {
+            if (radix_counting_sort_simd(A, size, tmp))
+                return;
+
+            typedef SortKeyTraits<T> Traits;
+            typedef typename Traits::radix_type radix_type;
+            const int passes = (int)sizeof(radix_type);
+
+            if (size < 2)
+                return;
+
+            size_t counting[sizeof(radix_type)][256];
+            memset(counting, 0, sizeof(counting));
+
+            for (size_t i = 0; i < size; i++) {
+                radix_type k = Traits::radixKey(A[i]);
+                for (int p = 0; p < passes; p++)
+                    counting[p][(k >> (p << 3)) & 0xff]++;
+            }
+
+            T* in = A;
+            T* out = tmp;
+
+            for (int p = 0; p < passes; p++) {
+                int shift = p << 3;
+                size_t* count = counting[p];
+
+                // all elements have the same digit
+                if (count[(Traits::radixKey(in[0]) >> shift) & 0xff] == size)
+                    continue;
+
+                size_t acc = 0;
+                for (int j = 0; j < 256; j++) {
+                    size_t tmp_count = count[j];
+                    count[j] = acc;
+                    acc += tmp_count;
+                }
+
+                for (size_t i = 0; i < size; i++) {
+                    const T& element = in[i];
+                    out[count[(Traits::radixKey(element) >> shift) & 0xff]++] = element;
+                }
+
+                T* swap = in;
+                in = out;
+                out = swap;
+            }
+
+            if (in != A)
+                memcpy(A, in, size * sizeof(T));
+        }
+
+    }
+}
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef __algorithms__merge__h__
+#define __algorithms__merge__h__
+
+#include <aRibeiroCore/common.h>
+#include <aRibeiroPlatform/AlgorithmsKeyTraits.h>
+
+#include <vector>
+
+namespace aRibeiro {
+    namespace Sorting {
+
+        //
+        // Multiway merge of sorted runs of one array.
+        //
+        // The run j is [run_begin[j], run_end[j]) of the array.
+        // The elements with the same key keep the order of the runs (stable).
+        //
+
+        //
+        // Co-rank of the multiway merge (multi-sequence selection):
+        //
+        // computes pos[j] of each run so that the merged output [0, rank) is
+        // the union of the ranges [run_begin[j], pos[j]).
+        //
+        // The split key is found with a binary search over the radix key values,
+        // so the cost is O(bits * runs * log(run size)).
+        //
+        // Each worker computes the co-ranks of its output range and merges it
+        // independently: all merges run in parallel with the same size.
+        //
+        template <typename T>
+        void multiway_merge_corank(const T* A, const size_t* run_begin, const size_t* run_end, int runs, size_t rank, size_t* pos) {
+            typedef SortKeyTraits<T> Traits;
+            typedef typename Traits::radix_type radix_type;
+
+            size_t total = 0;
+            for (int j = 0; j < runs; j++)
+                total += run_end[j] - run_begin[j];
+
+            if (rank == 0 || rank >= total) {
+                for (int j = 0; j < runs; j++)
+                    pos[j] = (rank == 0) ? run_begin[j] : run_end[j];
+                return;
+            }
+
+            // smallest key with at least rank elements less or equal to it
+            radix_type lo = 0;
+            radix_type hi = ~(radix_type)0;
+            while (lo < hi) {
+                radix_type mid = lo + (hi - lo) / 2;
+                size_t count = 0;
+                for (int j = 0; j < runs; j++) {
+                    // upper bound of mid
+                    size_t a = run_begin[j];
+                    size_t b = run_end[j];
+                    while (a < b) {
+                        size_t m = a + (b - a) / 2;
+                        if (Traits::radixKey(A[m]) <= mid)
+                            a = m + 1;
+                        else
+                            b = m;
+                    }
+                    count += a - run_begin[j];
+                }
+                if (count >= rank)
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+
+            // all elements less than the key
+            size_t taken = 0;
+            for (int j = 0; j < runs; j++) {
+                size_t a = run_begin[j];
+                size_t b = run_end[j];
+                while (a < b) {
+                    size_t m = a + (b - a) / 2;
+                    if (Traits::radixKey(A[m]) < lo)
+                        a = m + 1;
+                    else
+                        b = m;
+                }
+                pos[j] = a;
+                taken += a - run_begin[j];
+            }
+
+            // the elements equal to the key, in the order of the runs
+            size_t need = rank - taken;
+            for (int j = 0; j < runs && need > 0; j++) {
+                size_t a = pos[j];
+                while (a < run_end[j] && need > 0 && Traits::radixKey(A[a]) == lo) {
+                    a++;
+                    need--;
+                }
+                pos[j] = a;
+            }
+        }
+
+        //
+        // Loser tree merge of the ranges [begin[j], end[j]) of in, written to out.
+        //
+        // The data is read once: log2(runs) comparisons for each element.
+        // The tree compares the cached radix keys of the current element of each run.
+        //
+        template <typename T>
+        void multiway_merge(const T* in, const size_t* begin, const size_t* end, int runs, T* out) {
+            typedef SortKeyTraits<T> Traits;
+            typedef typename Traits::radix_type radix_type;
+
+            if (runs == 1) {
+                memcpy(out, in + begin[0], (end[0] - begin[0]) * sizeof(T));
+                return;
+            }
+
+            if (runs == 2) {
+                size_t a = begin[0], a_max = end[0];
+                size_t b = begin[1], b_max = end[1];
+                while (a < a_max && b < b_max) {
+                    if (Traits::less(in[b], in[a]))
+                        *out++ = in[b++];
+                    else
+                        *out++ = in[a++];
+                }
+                while (a < a_max)
+                    *out++ = in[a++];
+                while (b < b_max)
+                    *out++ = in[b++];
+                return;
+            }
+
+            int leaves = 1;
+            while (leaves < runs)
+                leaves <<= 1;
+
+            // entry of the tree: the current key of a run
+            struct Entry {
+                radix_type key;
+                // 1: the run is empty (loses all matches)
+                uint32_t done;
+                int32_t run;
+            };
+
+            std::vector<size_t> cur(leaves, 0);
+            std::vector<size_t> lim(leaves, 0);
+            std::vector<Entry> leaf(leaves);
+            size_t total = 0;
+            for (int j = 0; j < leaves; j++) {
+                leaf[j].key = 0;
+                leaf[j].done = 1;
+                leaf[j].run = j;
+                if (j >= runs)
+                    continue;
+                cur[j] = begin[j];
+                lim[j] = end[j];
+                total += end[j] - begin[j];
+                if (cur[j] < lim[j]) {
+                    leaf[j].key = Traits::radixKey(in[cur[j]]);
+                    leaf[j].done = 0;
+                }
+            }
+
+            // a beats b: not empty, smaller key, or same key and first run (stable)
+            // (branchless: the result of the matches is not predictable)
+#define ARIBEIRO_MERGE_BEATS(a, b) \
+    ( ((a).done < (b).done) | ( ((a).done == (b).done) & \
+        ( ((a).key < (b).key) | ( ((a).key == (b).key) & ((a).run < (b).run) ) ) ) )
+
+            // tree[node]: loser of the match at node (the entries are copied,
+            // so the replay reads only the path of the tree)
+            std::vector<Entry> tree(leaves);
+            std::vector<Entry> winner(leaves * 2);
+            for (int j = 0; j < leaves; j++)
+                winner[leaves + j] = leaf[j];
+            for (int node = leaves - 1; node >= 1; node--) {
+                const Entry& a = winner[node * 2];
+                const Entry& b = winner[node * 2 + 1];
+                if (ARIBEIRO_MERGE_BEATS(a, b)) {
+                    winner[node] = a;
+                    tree[node] = b;
+                }
+                else {
+                    winner[node] = b;
+                    tree[node] = a;
+                }
+            }
+
+            Entry w = winner[1];
+            Entry* tree_ptr = &tree[0];
+
+            for (size_t i = 0; i < total; i++) {
+                int run = w.run;
+                size_t position = cur[run]++;
+                out[i] = in[position];
+                position++;
+                if (position < lim[run])
+                    w.key = Traits::radixKey(in[position]);
+                else
+                    w.done = 1;
+                // replay the matches from the leaf of the winner
+                for (int node = (run + leaves) >> 1; node >= 1; node >>= 1) {
+                    Entry other = tree_ptr[node];
+                    if (ARIBEIRO_MERGE_BEATS(other, w)) {
+                        tree_ptr[node] = w;
+                        w = other;
+                    }
+                }
+            }
+
+#undef ARIBEIRO_MERGE_BEATS
+        }
+
+    }
+}
+
+#endif
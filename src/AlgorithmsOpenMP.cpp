@@ -6,1179 +6,615 @@
 namespace aRibeiro {
     namespace Sorting {
 
-
-        void hybrid_bucket_std_signed_OpenMP(int32_t* A, uint32_t size) {
-            const int64_t bucket_count = 128;
-            std::vector< int32_t >* bucket_list = new std::vector< int32_t >[bucket_count];
-
-            int64_t min = INT32_MIN;
-            int64_t max = INT32_MAX;
-            int64_t delta = max - min + 1;
-
-            for (int i = 0; i < size; i++) {
-                int32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                bucket_list[index].push_back(element32);
-            }
-
-            int a_offset[bucket_count];
-            int offset = 0;
-            for (int i = 0; i < bucket_count; i++) {
-                a_offset[i] = offset;
-                offset += (int)bucket_list[i].size();
-            }
-
-            #pragma omp parallel for
-            for (int i = 0; i < bucket_count; i++) {
-                std::vector< int32_t >& _bucket = bucket_list[i];
-                if (_bucket.size() == 0)
-                    continue;
-                std::sort(_bucket.begin(), _bucket.end());
-                memcpy(A + a_offset[i], &_bucket[0], sizeof(int32_t) * _bucket.size());
-            }
-
-            delete[]bucket_list;
+        //
+        // The OpenMP loops use int64_t indexes:
+        //   the OpenMP 2.0 (MSVC) only accepts signed loop variables,
+        //   and the int overflows with arrays bigger than 2G elements.
+        //
+
+        template <typename T>
+        static void sort_block(T* A, size_t size, T* tmp, bool radix) {
+            if (radix)
+                radix_counting_sort_key(A, size, tmp);
+            else
+                std::sort(A, A + size, SortKeyLess<T>());
         }
 
-        void hybrid_bucket_radix_counting_signed_OpenMP(int32_t* A, uint32_t size, int32_t* tmp_array) {
+        template <typename T>
+        static void hybrid_bucket(T* A, size_t size, T* tmp_array, bool radix) {
             const int64_t bucket_count = 128;
-            std::vector< int32_t >* bucket_list = new std::vector< int32_t >[bucket_count];
+            std::vector< T >* bucket_list = new std::vector< T >[bucket_count];
 
-            int64_t min = INT32_MIN;
-            int64_t max = INT32_MAX;
-            int64_t delta = max - min + 1;
-
-            for (uint32_t i = 0; i < size; i++) {
-                int32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                bucket_list[index].push_back(element32);
+            for (size_t i = 0; i < size; i++) {
+                const T& element = A[i];
+                bucket_list[radix_key_bucket(element)].push_back(element);
             }
 
-            int a_offset[bucket_count];
-            int offset = 0;
-            for (int i = 0; i < bucket_count; i++) {
+            size_t a_offset[bucket_count];
+            size_t offset = 0;
+            for (int64_t i = 0; i < bucket_count; i++) {
                 a_offset[i] = offset;
-                offset += (int)bucket_list[i].size();
+                offset += bucket_list[i].size();
             }
 
-            if (tmp_array == NULL) {
-#pragma omp parallel for
-                for (int i = 0; i < bucket_count; i++) {
-                    std::vector< int32_t >& _bucket = bucket_list[i];
-                    if (_bucket.size() == 0)
-                        continue;
-                    radix_counting_sort_signed(&_bucket[0], (uint32_t)_bucket.size(), NULL);
-                    memcpy(A + a_offset[i], &_bucket[0], sizeof(int32_t) * _bucket.size());
-                }
-            }
-            else {
-#pragma omp parallel for
-                for (int i = 0; i < bucket_count; i++) {
-                    std::vector< int32_t >& _bucket = bucket_list[i];
-                    if (_bucket.size() == 0)
-                        continue;
-                    radix_counting_sort_signed(&_bucket[0], (uint32_t)_bucket.size(), &tmp_array[a_offset[i]]);
-                    memcpy(A + a_offset[i], &_bucket[0], sizeof(int32_t) * _bucket.size());
-                }
-            }
-            delete[]bucket_list;
-        }
-
-        void hybrid_bucket_radix_counting_signed_index_OpenMP(IndexInt32* A, uint32_t size, IndexInt32* tmp_array) {
-            const int64_t bucket_count = 128;
-            std::vector< IndexInt32 >* bucket_list = new std::vector< IndexInt32 >[bucket_count];
-
-            int64_t min = INT32_MIN;
-            int64_t max = INT32_MAX;
-            int64_t delta = max - min + 1;
+            T* aux = tmp_array;
+            if (radix && aux == NULL)
+                aux = (T*)malloc_aligned(sizeof(T) * size);
 
-            for (uint32_t i = 0; i < size; i++) {
-                const IndexInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                bucket_list[index].push_back(element32);
+#pragma omp parallel for
+            for (int64_t i = 0; i < bucket_count; i++) {
+                std::vector< T >& _bucket = bucket_list[i];
+                if (_bucket.size() == 0)
+                    continue;
+                sort_block(&_bucket[0], _bucket.size(), aux + a_offset[i], radix);
+                memcpy(A + a_offset[i], &_bucket[0], sizeof(T) * _bucket.size());
             }
 
-            int a_offset[bucket_count];
-            int offset = 0;
-            for (int i = 0; i < bucket_count; i++) {
-                a_offset[i] = offset;
-                offset += (int)bucket_list[i].size();
-            }
+            if (aux != tmp_array)
+                free_aligned(aux);
 
-            if (tmp_array == NULL) {
-#pragma omp parallel for
-                for (int i = 0; i < bucket_count; i++) {
-                    std::vector< IndexInt32 >& _bucket = bucket_list[i];
-                    if (_bucket.size() == 0)
-                        continue;
-                    radix_counting_sort_signed_index(&_bucket[0], (uint32_t)_bucket.size(), NULL);
-                    memcpy(A + a_offset[i], &_bucket[0], sizeof(IndexInt32) * _bucket.size());
-                }
-            }
-            else {
-#pragma omp parallel for
-                for (int i = 0; i < bucket_count; i++) {
-                    std::vector< IndexInt32 >& _bucket = bucket_list[i];
-                    if (_bucket.size() == 0)
-                        continue;
-                    radix_counting_sort_signed_index(&_bucket[0], (uint32_t)_bucket.size(), &tmp_array[a_offset[i]]);
-                    memcpy(A + a_offset[i], &_bucket[0], sizeof(IndexInt32) * _bucket.size());
-                }
-            }
             delete[]bucket_list;
         }
 
-        void hybrid_counting_std_signed_OpenMP(int32_t* A, uint32_t size, int32_t* _tmp_array) {
-
+        template <typename T>
+        static void hybrid_counting(T* A, size_t size, T* _tmp_array, bool radix) {
             const int64_t bucket_count = 128;
-            //std::vector< T > bucket_list[bucket_count];
-            counter_type counting[bucket_count];
-            counter_type offset[bucket_count];
-            memset(counting, 0, sizeof(counter_type) * bucket_count);
-
-            int64_t min = INT32_MIN;
-            int64_t max = INT32_MAX;
-            int64_t delta = max - min + 1;
+            size_t counting[bucket_count];
+            size_t offset[bucket_count];
+            memset(counting, 0, sizeof(size_t) * bucket_count);
 
-            int32_t* aux;
+            T* aux;
             if (_tmp_array == NULL)
-                aux = (int32_t*)malloc_aligned(size * sizeof(int32_t));
+                aux = (T*)malloc_aligned(size * sizeof(T));
             else
                 aux = _tmp_array;
 
             //count
-            for (int i = 0; i < size; i++) {
-                int32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                counting[index]++;
-            }
+            for (size_t i = 0; i < size; i++)
+                counting[radix_key_bucket(A[i])]++;
 
             //compute offset
-            counter_type acc = counting[0];
+            size_t acc = counting[0];
             counting[0] = 0;
-            for (uint32_t j = 1; j < bucket_count; j++) {
-                counter_type tmp = counting[j];
+            for (int64_t j = 1; j < bucket_count; j++) {
+                size_t tmp = counting[j];
                 counting[j] = acc;
                 acc += tmp;
             }
 
-            memcpy(offset, counting, sizeof(counter_type) * bucket_count);
+            memcpy(offset, counting, sizeof(size_t) * bucket_count);
 
             // place elements in the output array
-            for (uint32_t i = 0; i < size; i++) {
-                int32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                counter_type out_index = counting[index];
-                counting[index]++;
-                aux[out_index] = element32;
+            for (size_t i = 0; i < size; i++) {
+                const T& element = A[i];
+                aux[counting[radix_key_bucket(element)]++] = element;
             }
 
 #pragma omp parallel for
-            for (int i = 0; i < bucket_count; i++) {
-                int32_t element_count = counting[i] - offset[i];
+            for (int64_t i = 0; i < bucket_count; i++) {
+                size_t element_count = counting[i] - offset[i];
                 if (element_count == 0)
                     continue;
-                std::sort(aux + offset[i], aux + counting[i]);
-                memcpy(A + offset[i], aux + offset[i], element_count * sizeof(int32_t));
+                sort_block(aux + offset[i], element_count, A + offset[i], radix);
+                memcpy(A + offset[i], aux + offset[i], element_count * sizeof(T));
             }
 
             if (_tmp_array == NULL)
                 free_aligned(aux);
         }
 
-        void hybrid_counting_radix_counting_signed_OpenMP(int32_t* A, uint32_t size, int32_t* _tmp_array) {
-
-            const int64_t bucket_count = 128;
-            //std::vector< T > bucket_list[bucket_count];
-            counter_type counting[bucket_count];
-            counter_type offset[bucket_count];
-            memset(counting, 0, sizeof(counter_type) * bucket_count);
+        //
+        // The blocks (one per thread) are sorted and copied to the auxiliary buffer,
+        // then each thread merges one range of the output with the co-rank of the
+        // range in all blocks (multiway merge, AlgorithmsMerge.h).
+        //
+        template <typename T>
+        static void hybrid_merge(T* _array, size_t size, T* _pre_alloc_tmp, bool radix) {
+            T* _aux;
+            if (_pre_alloc_tmp == NULL)
+                _aux = (T*)malloc_aligned(sizeof(T) * size);
+            else
+                _aux = _pre_alloc_tmp;
 
-            int64_t min = INT32_MIN;
-            int64_t max = INT32_MAX;
-            int64_t delta = max - min + 1;
+            int64_t thread_count = PlatformThread::QueryNumberOfSystemThreads();
+            if (thread_count < 1)
+                thread_count = 1;
 
-            int32_t* aux;
-            if (_tmp_array == NULL)
-                aux = (int32_t*)malloc_aligned(size * sizeof(int32_t));
-            else
-                aux = _tmp_array;
+            size_t job_thread_size = size / (size_t)thread_count;// 1 << 16
 
-            //count
-            for (int i = 0; i < size; i++) {
-                int32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                counting[index]++;
-            }
+            if (job_thread_size == 0)
+                job_thread_size = 1;
 
-            //compute offset
-            counter_type acc = counting[0];
-            counting[0] = 0;
-            for (uint32_t j = 1; j < bucket_count; j++) {
-                counter_type tmp = counting[j];
-                counting[j] = acc;
-                acc += tmp;
+            int64_t block_count = (int64_t)((size + job_thread_size - 1) / job_thread_size);
+            std::vector<size_t> run_begin((size_t)block_count);
+            std::vector<size_t> run_end((size_t)block_count);
+            for (int64_t b = 0; b < block_count; b++) {
+                run_begin[b] = (size_t)b * job_thread_size;
+                run_end[b] = run_begin[b] + job_thread_size;
+                if (run_end[b] > size)
+                    run_end[b] = size;
             }
 
-            memcpy(offset, counting, sizeof(counter_type) * bucket_count);
-
-            // place elements in the output array
-            for (uint32_t i = 0; i < size; i++) {
-                int32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                counter_type out_index = counting[index];
-                counting[index]++;
-                aux[out_index] = element32;
+            // sort blocks
+#pragma omp parallel for
+            for (int64_t b = 0; b < block_count; b++) {
+                size_t index_start = run_begin[b];
+                size_t count = run_end[b] - index_start;
+                sort_block(_array + index_start, count, _aux + index_start, radix);
+                memcpy(_aux + index_start, _array + index_start, count * sizeof(T));
             }
 
-            #pragma omp parallel for
-            for (int i = 0; i < bucket_count; i++) {
-                int32_t element_count = counting[i] - offset[i];
-                if (element_count == 0)
-                    continue;
-                radix_counting_sort_signed(aux + offset[i], element_count, A + offset[i]);
-                memcpy(A + offset[i], aux + offset[i], element_count * sizeof(int32_t));
+            // merge the blocks: one output range per thread
+            if (block_count > 1) {
+                int runs = (int)block_count;
+#pragma omp parallel for
+                for (int64_t p = 0; p < thread_count; p++) {
+                    size_t rank_begin = size * (size_t)p / (size_t)thread_count;
+                    size_t rank_end = size * (size_t)(p + 1) / (size_t)thread_count;
+                    if (rank_begin == rank_end)
+                        continue;
+                    std::vector<size_t> begin(runs);
+                    std::vector<size_t> end(runs);
+                    multiway_merge_corank(_aux, &run_begin[0], &run_end[0], runs, rank_begin, &begin[0]);
+                    multiway_merge_corank(_aux, &run_begin[0], &run_end[0], runs, rank_end, &end[0]);
+                    multiway_merge(_aux, &begin[0], &end[0], runs, _array + rank_begin);
+                }
             }
 
-            if (_tmp_array == NULL)
-                free_aligned(aux);
+            if (_pre_alloc_tmp == NULL)
+                free_aligned(_aux);
         }
 
-        void hybrid_counting_radix_counting_signed_index_OpenMP(IndexInt32* A, uint32_t size, IndexInt32* _tmp_array) {
+        //
+        // Sample sort: the splitters come from a sample of the array, each thread
+        // classifies and scatters one part, then the buckets are sorted in parallel
+        // (AlgorithmsSample.h).
+        //
+        template <typename T>
+        static void hybrid_sample(T* A, size_t size, T* _tmp_array, bool radix) {
+            const int64_t bucket_count = SampleSortSplitters<T>::BUCKETS;
 
-            const int64_t bucket_count = 128;
-            //std::vector< T > bucket_list[bucket_count];
-            counter_type counting[bucket_count];
-            counter_type offset[bucket_count];
-            memset(counting, 0, sizeof(counter_type) * bucket_count);
-
-            int64_t min = INT32_MIN;
-            int64_t max = INT32_MAX;
-            int64_t delta = max - min + 1;
+            // nothing to sample
+            if (size < 2)
+                return;
 
-            IndexInt32* aux;
+            T* aux;
             if (_tmp_array == NULL)
-                aux = (IndexInt32*)malloc_aligned(size * sizeof(IndexInt32));
+                aux = (T*)malloc_aligned(size * sizeof(T));
             else
                 aux = _tmp_array;
 
-            //count
-            for (int i = 0; i < size; i++) {
-                const IndexInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                counting[index]++;
-            }
+            int64_t parts = PlatformThread::QueryNumberOfSystemThreads();
+            if (parts < 1)
+                parts = 1;
 
-            //compute offset
-            counter_type acc = counting[0];
-            counting[0] = 0;
-            for (uint32_t j = 1; j < bucket_count; j++) {
-                counter_type tmp = counting[j];
-                counting[j] = acc;
-                acc += tmp;
-            }
+            SampleSortSplitters<T> splitters;
+            splitters.build(A, size);
 
-            memcpy(offset, counting, sizeof(counter_type) * bucket_count);
+            std::vector<uint8_t> oracle(size);
+            std::vector<size_t> count((size_t)(bucket_count * parts), 0);
 
-            // place elements in the output array
-            for (uint32_t i = 0; i < size; i++) {
-                const IndexInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                counter_type out_index = counting[index];
-                counting[index]++;
-                aux[out_index] = element32;
+            // classify
+#pragma omp parallel for
+            for (int64_t p = 0; p < parts; p++) {
+                size_t begin = size * (size_t)p / (size_t)parts;
+                size_t end = size * (size_t)(p + 1) / (size_t)parts;
+                sample_sort_classify(splitters, A, begin, end, &oracle[0], &count[(size_t)(p * bucket_count)]);
+            }
+
+            // offsets: the parts are placed in order inside each bucket
+            std::vector<size_t> bucket_begin((size_t)bucket_count + 1);
+            size_t acc = 0;
+            for (int64_t b = 0; b < bucket_count; b++) {
+                bucket_begin[b] = acc;
+                for (int64_t p = 0; p < parts; p++) {
+                    size_t tmp = count[p * bucket_count + b];
+                    count[p * bucket_count + b] = acc;
+                    acc += tmp;
+                }
             }
+            bucket_begin[bucket_count] = acc;
 
+            // scatter
 #pragma omp parallel for
-            for (int i = 0; i < bucket_count; i++) {
-                int32_t element_count = counting[i] - offset[i];
+            for (int64_t p = 0; p < parts; p++) {
+                size_t begin = size * (size_t)p / (size_t)parts;
+                size_t end = size * (size_t)(p + 1) / (size_t)parts;
+                sample_sort_scatter(A, begin, end, &oracle[0], &count[(size_t)(p * bucket_count)], aux);
+            }
+
+            // sort the buckets (the equality buckets are already sorted)
+#pragma omp parallel for schedule(dynamic)
+            for (int64_t b = 0; b < bucket_count; b++) {
+                size_t offset = bucket_begin[b];
+                size_t element_count = bucket_begin[b + 1] - offset;
                 if (element_count == 0)
                     continue;
-                radix_counting_sort_signed_index(aux + offset[i], element_count, A + offset[i]);
-                memcpy(A + offset[i], aux + offset[i], element_count * sizeof(IndexInt32));
+                if (!SampleSortSplitters<T>::isEqualityBucket((int)b))
+                    sort_block(aux + offset, element_count, A + offset, radix);
+                memcpy(A + offset, aux + offset, element_count * sizeof(T));
             }
 
             if (_tmp_array == NULL)
                 free_aligned(aux);
         }
 
-        void hybrid_merge_std_signed_OpenMP(int32_t* _array, uint32_t size, int32_t* _pre_alloc_tmp) {
-            int32_t* _aux;
-            if (_pre_alloc_tmp == NULL)
-                _aux = (int32_t*)malloc_aligned(sizeof(int32_t) * size);
-            else
-                _aux = _pre_alloc_tmp;
-
-            int job_thread_size = size / PlatformThread::QueryNumberOfSystemThreads();// 1 << 16
+        //
+        // Radix select
+        //
 
-            if (job_thread_size == 0)
-                job_thread_size = 1;
+        // buckets smaller than this are selected with std::nth_element
+        static const size_t SELECT_SEQUENTIAL_SIZE = 4096;
+        // topK up to this k uses a local heap for each thread
+        static const size_t SELECT_HEAP_SIZE = 4096;
 
-            // sort blocks
+        template <typename T>
+        static void select_histogram_parts(const T* A, size_t size, typename SortKeyTraits<T>::radix_type mask,
+            int shift, typename SortKeyTraits<T>::radix_type prefix, int64_t parts, size_t* count) {
 #pragma omp parallel for
-            for (int i = 0; i < size; i += job_thread_size) {
-                int index_start = i;
-                int index_end_exclusive = i + job_thread_size;
-                if (index_end_exclusive > size)
-                    index_end_exclusive = size;
-                std::sort(_array + index_start, _array + index_end_exclusive);
+            for (int64_t p = 0; p < parts; p++) {
+                size_t begin = size * (size_t)p / (size_t)parts;
+                size_t end = size * (size_t)(p + 1) / (size_t)parts;
+                radix_select_histogram(A, begin, end, mask, shift, prefix, count + p * 256);
             }
+        }
 
-            // merge down the blocks
-            int32_t* in = _array;
-            int32_t* out = _aux;
-
-            int element_count = job_thread_size;
-
-            while (element_count < size) {
-
-                //merge operation
+        template <typename T>
+        static void select_collect_parts(const T* A, size_t size, typename SortKeyTraits<T>::radix_type mask,
+            int shift, typename SortKeyTraits<T>::radix_type prefix, int64_t parts, const size_t* offset,
+            typename SortKeyTraits<T>::radix_type* out) {
 #pragma omp parallel for
-                for (int i = 0; i < size; i += (element_count << 1)) {
-
-                    int write_index = i;
-                    int write_max = i + (element_count << 1);
-                    if (write_max > size)
-                        write_max = size;
-
-                    int a_index = i;
-                    int b_index = i + element_count;
-
-                    int a_max = b_index;
-                    int b_max = b_index + element_count;
-
-                    if (a_max > size)
-                        a_max = size;
-                    if (b_max > size)
-                        b_max = size;
-
-                    while (write_index < write_max &&
-                        a_index < a_max &&
-                        b_index < b_max) {
-
-                        int32_t& _a = in[a_index];
-                        int32_t& _b = in[b_index];
-
-                        if (_a > _b) {
-                            out[write_index] = _b;
-                            b_index++;
-                        }
-                        else {
-                            out[write_index] = _a;
-                            a_index++;
-                        }
-
-                        write_index++;
-                    }
-
-                    while (a_index < a_max) {
-                        out[write_index++] = in[a_index++];
-                    }
-                    while (b_index < b_max) {
-                        out[write_index++] = in[b_index++];
-                    }
-
-                }
-
-                //swap in/out
-                int32_t* aux = in;
-                in = out;
-                out = aux;
-
-                element_count = element_count << 1;
+            for (int64_t p = 0; p < parts; p++) {
+                size_t begin = size * (size_t)p / (size_t)parts;
+                size_t end = size * (size_t)(p + 1) / (size_t)parts;
+                radix_select_collect(A, begin, end, mask, shift, prefix, out + offset[p]);
             }
-
-            if (in != _array)
-                memcpy(_array, in, sizeof(int32_t) * size);
-
-            if (_pre_alloc_tmp == NULL)
-                free_aligned(_aux);
         }
 
-        void hybrid_merge_radix_counting_signed_OpenMP(int32_t* _array, uint32_t size, int32_t* _pre_alloc_tmp) {
-            int32_t* _aux;
-            if (_pre_alloc_tmp == NULL)
-                _aux = (int32_t*)malloc_aligned(sizeof(int32_t) * size);
-            else
-                _aux = _pre_alloc_tmp;
-
-            int job_thread_size = size / PlatformThread::QueryNumberOfSystemThreads();// 1 << 16
-
-            if (job_thread_size == 0)
-                job_thread_size = 1;
-
-            // sort blocks
-            #pragma omp parallel for
-            for (int i = 0; i < size; i += job_thread_size) {
-                int index_start = i;
-                int index_end_exclusive = i + job_thread_size;
-                if (index_end_exclusive > size)
-                    index_end_exclusive = size;
-                radix_counting_sort_signed(_array + index_start, index_end_exclusive - index_start, _aux + index_start);
-            }
-
-            // merge down the blocks
-            int32_t* in = _array;
-            int32_t* out = _aux;
-
-            int element_count = job_thread_size;
-
-            while (element_count < size) {
-
-                //merge operation
-                #pragma omp parallel for
-                for (int i = 0; i < size; i += (element_count << 1) ) {
-                    
-                    int write_index = i;
-                    int write_max = i + (element_count << 1);
-                    if (write_max > size)
-                        write_max = size;
-
-                    int a_index = i;
-                    int b_index = i + element_count;
-
-                    int a_max = b_index;
-                    int b_max = b_index + element_count;
-
-                    if (a_max > size)
-                        a_max = size;
-                    if (b_max > size)
-                        b_max = size;
-
-                    while (write_index < write_max &&
-                        a_index < a_max &&
-                        b_index < b_max) {
-
-                        int32_t &_a = in[a_index];
-                        int32_t &_b = in[b_index];
-
-                        if (_a > _b) {
-                            out[write_index] = _b;
-                            b_index++;
-                        }
-                        else {
-                            out[write_index] = _a;
-                            a_index++;
-                        }
-
-                        write_index++;
-                    }
-
-                    while (a_index < a_max) {
-                        out[write_index++] = in[a_index++];
+        // radix key (xor mask) of the element of rank
+        template <typename T>
+        static typename SortKeyTraits<T>::radix_type select_threshold(const T* A, size_t size, size_t rank,
+            typename SortKeyTraits<T>::radix_type mask, int64_t parts) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
+
+            std::vector<size_t> count((size_t)(parts * 256));
+            std::vector<size_t> offset((size_t)parts);
+            std::vector<radix_type> buffer;
+            std::vector<radix_type> next;
+            bool use_buffer = false;
+            size_t current = size;
+            radix_type prefix = 0;
+            int shift = (int)sizeof(radix_type) * 8 - 8;
+
+            while (true) {
+                std::fill(count.begin(), count.end(), 0);
+                if (use_buffer)
+                    select_histogram_parts(&buffer[0], current, (radix_type)0, shift, prefix, parts, &count[0]);
+                else
+                    select_histogram_parts(A, current, mask, shift, prefix, parts, &count[0]);
+
+                size_t total[256];
+                memset(total, 0, sizeof(total));
+                for (int64_t p = 0; p < parts; p++)
+                    for (int i = 0; i < 256; i++)
+                        total[i] += count[p * 256 + i];
+
+                int digit = radix_select_digit(total, &rank);
+                prefix |= (radix_type)digit << shift;
+                size_t bucket_size = total[digit];
+
+                if (shift == 0)
+                    return prefix;
+
+                if (bucket_size <= SELECT_SEQUENTIAL_SIZE || bucket_size * 2 <= current) {
+                    size_t acc = 0;
+                    for (int64_t p = 0; p < parts; p++) {
+                        offset[p] = acc;
+                        acc += count[p * 256 + digit];
                     }
-                    while (b_index < b_max) {
-                        out[write_index++] = in[b_index++];
+                    next.resize(bucket_size);
+                    if (use_buffer)
+                        select_collect_parts(&buffer[0], current, (radix_type)0, shift, prefix, parts, &offset[0], &next[0]);
+                    else
+                        select_collect_parts(A, current, mask, shift, prefix, parts, &offset[0], &next[0]);
+
+                    buffer.swap(next);
+                    use_buffer = true;
+                    current = bucket_size;
+
+                    if (current <= SELECT_SEQUENTIAL_SIZE) {
+                        std::nth_element(buffer.begin(), buffer.begin() + rank, buffer.begin() + current);
+                        return buffer[rank];
                     }
-
                 }
 
-                //swap in/out
-                int32_t* aux = in;
-                in = out;
-                out = aux;
-
-                element_count = element_count << 1;
+                shift -= 8;
             }
-
-            if (in != _array)
-                memcpy(_array, in, sizeof(int32_t) * size);
-
-            if (_pre_alloc_tmp == NULL)
-                free_aligned(_aux);
         }
 
-        void hybrid_merge_radix_counting_signed_index_OpenMP(IndexInt32* _array, uint32_t size, IndexInt32* _pre_alloc_tmp) {
-            IndexInt32* _aux;
-            if (_pre_alloc_tmp == NULL)
-                _aux = (IndexInt32*)malloc_aligned(sizeof(IndexInt32) * size);
-            else
-                _aux = _pre_alloc_tmp;
-
-            int job_thread_size = size / PlatformThread::QueryNumberOfSystemThreads();// 1 << 16
+        // three way partition of A to out by the threshold (stable)
+        template <typename T>
+        static void select_partition(const T* A, size_t size, typename SortKeyTraits<T>::radix_type threshold,
+            typename SortKeyTraits<T>::radix_type mask, int64_t parts, size_t equal_end, bool keep_greater, T* out) {
 
-            if (job_thread_size == 0)
-                job_thread_size = 1;
+            std::vector<size_t> count((size_t)(parts * 2), 0);
 
-            // sort blocks
 #pragma omp parallel for
-            for (int i = 0; i < size; i += job_thread_size) {
-                int index_start = i;
-                int index_end_exclusive = i + job_thread_size;
-                if (index_end_exclusive > size)
-                    index_end_exclusive = size;
-                radix_counting_sort_signed_index(_array + index_start, index_end_exclusive - index_start, _aux + index_start);
+            for (int64_t p = 0; p < parts; p++) {
+                size_t begin = size * (size_t)p / (size_t)parts;
+                size_t end = size * (size_t)(p + 1) / (size_t)parts;
+                select_partition_count(A, begin, end, mask, threshold, &count[p * 2], &count[p * 2 + 1]);
+            }
+
+            size_t less_total = 0, equal_total = 0;
+            for (int64_t p = 0; p < parts; p++) {
+                less_total += count[p * 2];
+                equal_total += count[p * 2 + 1];
+            }
+            if (equal_end > less_total + equal_total)
+                equal_end = less_total + equal_total;
+
+            // positions of each part: less, equal, greater
+            std::vector<size_t> position((size_t)(parts * 3));
+            size_t less_pos = 0;
+            size_t equal_pos = less_total;
+            size_t greater_pos = less_total + equal_total;
+            for (int64_t p = 0; p < parts; p++) {
+                size_t begin = size * (size_t)p / (size_t)parts;
+                size_t end = size * (size_t)(p + 1) / (size_t)parts;
+                position[p * 3] = less_pos;
+                position[p * 3 + 1] = equal_pos;
+                position[p * 3 + 2] = keep_greater ? greater_pos : SIZE_MAX;
+                less_pos += count[p * 2];
+                equal_pos += count[p * 2 + 1];
+                greater_pos += (end - begin) - count[p * 2] - count[p * 2 + 1];
             }
 
-            // merge down the blocks
-            IndexInt32* in = _array;
-            IndexInt32* out = _aux;
-
-            int element_count = job_thread_size;
-
-            while (element_count < size) {
-
-                //merge operation
 #pragma omp parallel for
-                for (int i = 0; i < size; i += (element_count << 1)) {
-
-                    int write_index = i;
-                    int write_max = i + (element_count << 1);
-                    if (write_max > size)
-                        write_max = size;
-
-                    int a_index = i;
-                    int b_index = i + element_count;
-
-                    int a_max = b_index;
-                    int b_max = b_index + element_count;
-
-                    if (a_max > size)
-                        a_max = size;
-                    if (b_max > size)
-                        b_max = size;
-
-                    while (write_index < write_max &&
-                        a_index < a_max &&
-                        b_index < b_max) {
-
-                        const IndexInt32& _a = in[a_index];
-                        const IndexInt32& _b = in[b_index];
-
-                        if (_a.toSort > _b.toSort) {
-                            out[write_index] = _b;
-                            b_index++;
-                        }
-                        else {
-                            out[write_index] = _a;
-                            a_index++;
-                        }
-
-                        write_index++;
-                    }
-
-                    while (a_index < a_max) {
-                        out[write_index++] = in[a_index++];
-                    }
-                    while (b_index < b_max) {
-                        out[write_index++] = in[b_index++];
-                    }
-
-                }
-
-                //swap in/out
-                IndexInt32* aux = in;
-                in = out;
-                out = aux;
-
-                element_count = element_count << 1;
+            for (int64_t p = 0; p < parts; p++) {
+                size_t begin = size * (size_t)p / (size_t)parts;
+                size_t end = size * (size_t)(p + 1) / (size_t)parts;
+                select_partition_scatter(A, begin, end, mask, threshold,
+                    position[p * 3], position[p * 3 + 1], equal_end, position[p * 3 + 2], out);
             }
-
-            if (in != _array)
-                memcpy(_array, in, sizeof(IndexInt32) * size);
-
-            if (_pre_alloc_tmp == NULL)
-                free_aligned(_aux);
         }
 
-        
-
-        void hybrid_bucket_std_unsigned_OpenMP(uint32_t* A, uint32_t size) {
-            const int64_t bucket_count = 128;
-            std::vector< uint32_t >* bucket_list = new std::vector< uint32_t >[bucket_count];
-
-            int64_t min = 0;
-            int64_t max = UINT32_MAX;
-            int64_t delta = max - min + 1;
-
-            for (int i = 0; i < size; i++) {
-                uint32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                bucket_list[index].push_back(element32);
-            }
-
-            int a_offset[bucket_count];
-            int offset = 0;
-            for (int i = 0; i < bucket_count; i++) {
-                a_offset[i] = offset;
-                offset += (int)bucket_list[i].size();
-            }
-
-            #pragma omp parallel for
-            for (int i = 0; i < bucket_count; i++) {
-                std::vector< uint32_t >& _bucket = bucket_list[i];
-                if (_bucket.size() == 0)
-                    continue;
-                std::sort(_bucket.begin(), _bucket.end());
-                memcpy(A + a_offset[i], &_bucket[0], sizeof(uint32_t) * _bucket.size());
-            }
-
-            delete[]bucket_list;
+        static int64_t select_parts(size_t size) {
+            if (size < SELECT_SEQUENTIAL_SIZE)
+                return 1;
+            int64_t parts = PlatformThread::QueryNumberOfSystemThreads();
+            if (parts < 1)
+                parts = 1;
+            return parts;
         }
 
-        void hybrid_bucket_radix_counting_unsigned_OpenMP(uint32_t* A, uint32_t size, uint32_t* tmp_array) {
-            const int64_t bucket_count = 128;
-            std::vector< uint32_t >* bucket_list = new std::vector< uint32_t >[bucket_count];
+        template <typename T>
+        void topK_OpenMP(const T* A, size_t size, size_t k, T* out, bool largest) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
 
-            int64_t min = 0;
-            int64_t max = UINT32_MAX;
-            int64_t delta = max - min + 1;
+            if (k > size)
+                k = size;
+            if (k == 0)
+                return;
 
-            for (uint32_t i = 0; i < size; i++) {
-                uint32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                bucket_list[index].push_back(element32);
-            }
+            int64_t parts = select_parts(size);
+            radix_type mask = largest ? ~(radix_type)0 : 0;
 
-            int a_offset[bucket_count];
-            int offset = 0;
-            for (int i = 0; i < bucket_count; i++) {
-                a_offset[i] = offset;
-                offset += (int)bucket_list[i].size();
-            }
+            if (k <= SELECT_HEAP_SIZE && k < size) {
+                typedef std::pair<radix_type, size_t> heap_entry;
+                std::vector<heap_entry> heap((size_t)parts * k);
+                std::vector<size_t> count((size_t)parts);
 
-            if (tmp_array == NULL) {
-#pragma omp parallel for
-                for (int i = 0; i < bucket_count; i++) {
-                    std::vector< uint32_t >& _bucket = bucket_list[i];
-                    if (_bucket.size() == 0)
-                        continue;
-                    radix_counting_sort_unsigned(&_bucket[0], (uint32_t)_bucket.size(), NULL);
-                    memcpy(A + a_offset[i], &_bucket[0], sizeof(uint32_t) * _bucket.size());
-                }
-            }
-            else {
 #pragma omp parallel for
-                for (int i = 0; i < bucket_count; i++) {
-                    std::vector< uint32_t >& _bucket = bucket_list[i];
-                    if (_bucket.size() == 0)
-                        continue;
-                    radix_counting_sort_unsigned(&_bucket[0], (uint32_t)_bucket.size(), &tmp_array[a_offset[i]]);
-                    memcpy(A + a_offset[i], &_bucket[0], sizeof(uint32_t) * _bucket.size());
+                for (int64_t p = 0; p < parts; p++) {
+                    size_t begin = size * (size_t)p / (size_t)parts;
+                    size_t end = size * (size_t)(p + 1) / (size_t)parts;
+                    count[p] = select_heap(A, begin, end, mask, k, &heap[(size_t)p * k]);
                 }
-            }
-            delete[]bucket_list;
-        }
-
-        void hybrid_bucket_radix_counting_unsigned_index_OpenMP(IndexUInt32* A, uint32_t size, IndexUInt32* tmp_array) {
-            const int64_t bucket_count = 128;
-            std::vector< IndexUInt32 >* bucket_list = new std::vector< IndexUInt32 >[bucket_count];
-
-            int64_t min = 0;
-            int64_t max = UINT32_MAX;
-            int64_t delta = max - min + 1;
-
-            for (uint32_t i = 0; i < size; i++) {
-                const IndexUInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort;
-                uint32_t index = ((element64 - min) * bucket_count) / delta;
-                bucket_list[index].push_back(element32);
-            }
-
-            int a_offset[bucket_count];
-            int offset = 0;
-            for (int i = 0; i < bucket_count; i++) {
-                a_offset[i] = offset;
-                offset += (int)bucket_list[i].size();
-            }
 
-            if (tmp_array == NULL) {
-#pragma omp parallel for
-                for (int i = 0; i < bucket_count; i++) {
-                    std::vector< IndexUInt32 >& _bucket = bucket_list[i];
-                    if (_bucket.size() == 0)
-                        continue;
-                    radix_counting_sort_unsigned_index(&_bucket[0], (uint32_t)_bucket.size(), NULL);
-                    memcpy(A + a_offset[i], &_bucket[0], sizeof(IndexUInt32) * _bucket.size());
-                }
-            }
-            else {
-#pragma omp parallel for
-                for (int i = 0; i < bucket_count; i++) {
-                    std::vector< IndexUInt32 >& _bucket = bucket_list[i];
-                    if (_bucket.size() == 0)
-                        continue;
-                    radix_counting_sort_unsigned_index(&_bucket[0], (uint32_t)_bucket.size(), &tmp_array[a_offset[i]]);
-                    memcpy(A + a_offset[i], &_bucket[0], sizeof(IndexUInt32) * _bucket.size());
+                // merge: the (key, position) order is the stable order of the output
+                // (the heaps are moved down to be contiguous: total <= k * p)
+                size_t total = count[0];
+                for (int64_t p = 1; p < parts; p++) {
+                    size_t begin = (size_t)p * k;
+                    if (total != begin)
+                        std::copy(heap.begin() + begin, heap.begin() + begin + count[p], heap.begin() + total);
+                    total += count[p];
                 }
+                std::partial_sort(heap.begin(), heap.begin() + k, heap.begin() + total);
+                for (size_t i = 0; i < k; i++)
+                    out[i] = A[heap[i].second];
+                return;
             }
-            delete[]bucket_list;
-        }
-
-        void hybrid_counting_std_unsigned_OpenMP(uint32_t* A, uint32_t size, uint32_t* _tmp_array) {
-
-            const int64_t bucket_count = 128;
-            //std::vector< T > bucket_list[bucket_count];
-            counter_type counting[bucket_count];
-            counter_type offset[bucket_count];
-            memset(counting, 0, sizeof(counter_type) * bucket_count);
-
-            int64_t min = 0;
-            int64_t max = UINT32_MAX;
-            int64_t delta = max - min + 1;
 
-            uint32_t* aux;
-            if (_tmp_array == NULL)
-                aux = (uint32_t*)malloc_aligned(size * sizeof(uint32_t));
-            else
-                aux = _tmp_array;
-
-            //count
-            for (int i = 0; i < size; i++) {
-                uint32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32 - min;
-                uint32_t index = (element64 * bucket_count) / delta;
-                counting[index]++;
-            }
-
-            //compute offset
-            counter_type acc = counting[0];
-            counting[0] = 0;
-            for (uint32_t j = 1; j < bucket_count; j++) {
-                counter_type tmp = counting[j];
-                counting[j] = acc;
-                acc += tmp;
-            }
-
-            memcpy(offset, counting, sizeof(counter_type) * bucket_count);
-
-            // place elements in the output array
-            for (uint32_t i = 0; i < size; i++) {
-                uint32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32 - min;
-                uint32_t index = (element64 * bucket_count) / delta;
-                counter_type out_index = counting[index];
-                counting[index]++;
-                aux[out_index] = element32;
-            }
-
-#pragma omp parallel for
-            for (int i = 0; i < bucket_count; i++) {
-                int32_t element_count = counting[i] - offset[i];
-                if (element_count == 0)
-                    continue;
-                std::sort(aux + offset[i], aux + counting[i]);
-                memcpy(A + offset[i], aux + offset[i], element_count * sizeof(uint32_t));
+            if (k == size)
+                memcpy(out, A, sizeof(T) * size);
+            else {
+                radix_type threshold = select_threshold(A, size, k - 1, mask, parts);
+                select_partition(A, size, threshold, mask, parts, k, false, out);
             }
 
-            if (_tmp_array == NULL)
-                free_aligned(aux);
+            hybrid_counting(out, k, (T*)NULL, true);
+            if (largest)
+                select_reverse_stable(out, k);
         }
 
-        void hybrid_counting_radix_counting_unsigned_OpenMP(uint32_t* A, uint32_t size, uint32_t* _tmp_array) {
-
-            const int64_t bucket_count = 128;
-            //std::vector< T > bucket_list[bucket_count];
-            counter_type counting[bucket_count];
-            counter_type offset[bucket_count];
-            memset(counting, 0, sizeof(counter_type) * bucket_count);
-
-            int64_t min = 0;
-            int64_t max = UINT32_MAX;
-            int64_t delta = max - min + 1;
-
-            uint32_t* aux;
-            if (_tmp_array == NULL)
-                aux = (uint32_t*)malloc_aligned(size * sizeof(uint32_t));
-            else
-                aux = _tmp_array;
-
-            //count
-            for (int i = 0; i < size; i++) {
-                uint32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32 - min;
-                uint32_t index = (element64 * bucket_count) / delta;
-                counting[index]++;
-            }
-
-            //compute offset
-            counter_type acc = counting[0];
-            counting[0] = 0;
-            for (uint32_t j = 1; j < bucket_count; j++) {
-                counter_type tmp = counting[j];
-                counting[j] = acc;
-                acc += tmp;
+        template <typename T>
+        void partialSort_OpenMP(T* A, size_t size, size_t k) {
+            if (k >= size) {
+                hybrid_counting(A, size, (T*)NULL, true);
+                return;
             }
+            if (k == 0)
+                return;
 
-            memcpy(offset, counting, sizeof(counter_type) * bucket_count);
+            int64_t parts = select_parts(size);
+            T* aux = (T*)malloc_aligned(size * sizeof(T));
 
-            // place elements in the output array
-            for (uint32_t i = 0; i < size; i++) {
-                uint32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32 - min;
-                uint32_t index = (element64 * bucket_count) / delta;
-                counter_type out_index = counting[index];
-                counting[index]++;
-                aux[out_index] = element32;
-            }
+            typename SortKeyTraits<T>::radix_type threshold = select_threshold(A, size, k - 1, 0, parts);
+            select_partition(A, size, threshold, 0, parts, SIZE_MAX, true, aux);
+            hybrid_counting(aux, k, (T*)NULL, true);
 
 #pragma omp parallel for
-            for (int i = 0; i < bucket_count; i++) {
-                int32_t element_count = counting[i] - offset[i];
-                if (element_count == 0)
-                    continue;
-                radix_counting_sort_unsigned(aux + offset[i], element_count, A + offset[i]);
-                memcpy(A + offset[i], aux + offset[i], element_count * sizeof(uint32_t));
+            for (int64_t p = 0; p < parts; p++) {
+                size_t begin = size * (size_t)p / (size_t)parts;
+                size_t end = size * (size_t)(p + 1) / (size_t)parts;
+                memcpy(A + begin, aux + begin, (end - begin) * sizeof(T));
             }
 
-            if (_tmp_array == NULL)
-                free_aligned(aux);
+            free_aligned(aux);
         }
 
-        void hybrid_counting_radix_counting_unsigned_index_OpenMP(IndexUInt32* A, uint32_t size, IndexUInt32* _tmp_array) {
+        template <typename T>
+        void nthElement_OpenMP(T* A, size_t size, size_t nth) {
+            if (nth >= size)
+                return;
 
-            const int64_t bucket_count = 128;
-            //std::vector< T > bucket_list[bucket_count];
-            counter_type counting[bucket_count];
-            counter_type offset[bucket_count];
-            memset(counting, 0, sizeof(counter_type) * bucket_count);
+            int64_t parts = select_parts(size);
+            T* aux = (T*)malloc_aligned(size * sizeof(T));
 
-            int64_t min = 0;
-            int64_t max = UINT32_MAX;
-            int64_t delta = max - min + 1;
-
-            IndexUInt32* aux;
-            if (_tmp_array == NULL)
-                aux = (IndexUInt32*)malloc_aligned(size * sizeof(IndexUInt32));
-            else
-                aux = _tmp_array;
-
-            //count
-            for (int i = 0; i < size; i++) {
-                const IndexUInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort - min;
-                uint32_t index = (element64 * bucket_count) / delta;
-                counting[index]++;
-            }
-
-            //compute offset
-            counter_type acc = counting[0];
-            counting[0] = 0;
-            for (uint32_t j = 1; j < bucket_count; j++) {
-                counter_type tmp = counting[j];
-                counting[j] = acc;
-                acc += tmp;
-            }
-
-            memcpy(offset, counting, sizeof(counter_type) * bucket_count);
-
-            // place elements in the output array
-            for (uint32_t i = 0; i < size; i++) {
-                const IndexUInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort - min;
-                uint32_t index = (element64 * bucket_count) / delta;
-                counter_type out_index = counting[index];
-                counting[index]++;
-                aux[out_index] = element32;
-            }
+            typename SortKeyTraits<T>::radix_type threshold = select_threshold(A, size, nth, 0, parts);
+            select_partition(A, size, threshold, 0, parts, SIZE_MAX, true, aux);
 
 #pragma omp parallel for
-            for (int i = 0; i < bucket_count; i++) {
-                int32_t element_count = counting[i] - offset[i];
-                if (element_count == 0)
-                    continue;
-                radix_counting_sort_unsigned_index(aux + offset[i], element_count, A + offset[i]);
-                memcpy(A + offset[i], aux + offset[i], element_count * sizeof(IndexUInt32));
+            for (int64_t p = 0; p < parts; p++) {
+                size_t begin = size * (size_t)p / (size_t)parts;
+                size_t end = size * (size_t)(p + 1) / (size_t)parts;
+                memcpy(A + begin, aux + begin, (end - begin) * sizeof(T));
             }
 
-            if (_tmp_array == NULL)
-                free_aligned(aux);
+            free_aligned(aux);
         }
 
+        //
+        // Generic entry points
+        //
 
-        void hybrid_merge_std_unsigned_OpenMP(uint32_t* _array, uint32_t size, uint32_t* _pre_alloc_tmp) {
-            uint32_t* _aux;
-            if (_pre_alloc_tmp == NULL)
-                _aux = (uint32_t*)malloc_aligned(sizeof(uint32_t) * size);
-            else
-                _aux = _pre_alloc_tmp;
-
-            int job_thread_size = size / PlatformThread::QueryNumberOfSystemThreads();// 1 << 16
-            //job_thread_size /= 4;
-
-            if (job_thread_size == 0)
-                job_thread_size = 1;
-
-            // sort blocks
-#pragma omp parallel for
-            for (int i = 0; i < size; i += job_thread_size) {
-                int index_start = i;
-                int index_end_exclusive = i + job_thread_size;
-                if (index_end_exclusive > size)
-                    index_end_exclusive = size;
-                std::sort(_array + index_start, _array + index_end_exclusive);
-            }
-
-            // merge down the blocks
-            uint32_t* in = _array;
-            uint32_t* out = _aux;
-
-            int element_count = job_thread_size;
-
-            while (element_count < size) {
-
-                //merge operation
-#pragma omp parallel for
-                for (int i = 0; i < size; i += (element_count << 1)) {
-
-                    int write_index = i;
-                    int write_max = i + (element_count << 1);
-                    if (write_max > size)
-                        write_max = size;
-
-                    int a_index = i;
-                    int b_index = i + element_count;
-
-                    int a_max = b_index;
-                    int b_max = b_index + element_count;
-
-                    if (a_max > size)
-                        a_max = size;
-                    if (b_max > size)
-                        b_max = size;
-
-                    while (write_index < write_max &&
-                        a_index < a_max &&
-                        b_index < b_max) {
-
-                        uint32_t& _a = in[a_index];
-                        uint32_t& _b = in[b_index];
-
-                        if (_a > _b) {
-                            out[write_index] = _b;
-                            b_index++;
-                        }
-                        else {
-                            out[write_index] = _a;
-                            a_index++;
-                        }
-
-                        write_index++;
-                    }
-
-                    while (a_index < a_max) {
-                        out[write_index++] = in[a_index++];
-                    }
-                    while (b_index < b_max) {
-                        out[write_index++] = in[b_index++];
-                    }
-
-                }
-
-                //swap in/out
-                uint32_t* aux = in;
-                in = out;
-                out = aux;
-
-                element_count = element_count << 1;
-            }
-
-            if (in != _array)
-                memcpy(_array, in, sizeof(int32_t) * size);
-
-            if (_pre_alloc_tmp == NULL)
-                free_aligned(_aux);
+        template <typename T>
+        void hybrid_bucket_OpenMP(T* A, size_t size, bool radix, T* tmp_array) {
+            hybrid_bucket(A, size, tmp_array, radix);
         }
 
-        void hybrid_merge_radix_counting_unsigned_OpenMP(uint32_t* _array, uint32_t size, uint32_t* _pre_alloc_tmp) {
-            uint32_t* _aux;
-            if (_pre_alloc_tmp == NULL)
-                _aux = (uint32_t*)malloc_aligned(sizeof(uint32_t) * size);
-            else
-                _aux = _pre_alloc_tmp;
-
-            int job_thread_size = size / PlatformThread::QueryNumberOfSystemThreads();// 1 << 16
-            //job_thread_size /= 4;
-
-            if (job_thread_size == 0)
-                job_thread_size = 1;
-
-            // sort blocks
-#pragma omp parallel for
-            for (int i = 0; i < size; i += job_thread_size) {
-                int index_start = i;
-                int index_end_exclusive = i + job_thread_size;
-                if (index_end_exclusive > size)
-                    index_end_exclusive = size;
-                radix_counting_sort_unsigned(_array + index_start, index_end_exclusive - index_start, _aux + index_start);
-            }
-
-            // merge down the blocks
-            uint32_t* in = _array;
-            uint32_t* out = _aux;
-
-            int element_count = job_thread_size;
-
-            while (element_count < size) {
-
-                //merge operation
-#pragma omp parallel for
-                for (int i = 0; i < size; i += (element_count << 1)) {
-
-                    int write_index = i;
-                    int write_max = i + (element_count << 1);
-                    if (write_max > size)
-                        write_max = size;
-
-                    int a_index = i;
-                    int b_index = i + element_count;
-
-                    int a_max = b_index;
-                    int b_max = b_index + element_count;
-
-                    if (a_max > size)
-                        a_max = size;
-                    if (b_max > size)
-                        b_max = size;
-
-                    while (write_index < write_max &&
-                        a_index < a_max &&
-                        b_index < b_max) {
-
-                        uint32_t& _a = in[a_index];
-                        uint32_t& _b = in[b_index];
-
-                        if (_a > _b) {
-                            out[write_index] = _b;
-                            b_index++;
-                        }
-                        else {
-                            out[write_index] = _a;
-                            a_index++;
-                        }
-
-                        write_index++;
-                    }
-
-                    while (a_index < a_max) {
-                        out[write_index++] = in[a_index++];
-                    }
-                    while (b_index < b_max) {
-                        out[write_index++] = in[b_index++];
-                    }
-
-                }
-
-                //swap in/out
-                uint32_t* aux = in;
-                in = out;
-                out = aux;
-
-                element_count = element_count << 1;
-            }
-
-            if (in != _array)
-                memcpy(_array, in, sizeof(uint32_t) * size);
-
-            if (_pre_alloc_tmp == NULL)
-                free_aligned(_aux);
+        template <typename T>
+        void hybrid_counting_OpenMP(T* A, size_t size, bool radix, T* tmp_array) {
+            hybrid_counting(A, size, tmp_array, radix);
         }
 
-        void hybrid_merge_radix_counting_unsigned_index_OpenMP(IndexUInt32* _array, uint32_t size, IndexUInt32* _pre_alloc_tmp) {
-            IndexUInt32* _aux;
-            if (_pre_alloc_tmp == NULL)
-                _aux = (IndexUInt32*)malloc_aligned(sizeof(IndexUInt32) * size);
-            else
-                _aux = _pre_alloc_tmp;
-
-            int job_thread_size = size / PlatformThread::QueryNumberOfSystemThreads();// 1 << 16
-            //job_thread_size /= 4;
-
-            if (job_thread_size == 0)
-                job_thread_size = 1;
+        template <typename T>
+        void hybrid_merge_OpenMP(T* A, size_t size, bool radix, T* pre_alloc_tmp) {
+            hybrid_merge(A, size, pre_alloc_tmp, radix);
+        }
 
-            // sort blocks
-#pragma omp parallel for
-            for (int i = 0; i < size; i += job_thread_size) {
-                int index_start = i;
-                int index_end_exclusive = i + job_thread_size;
-                if (index_end_exclusive > size)
-                    index_end_exclusive = size;
-                radix_counting_sort_unsigned_index(_array + index_start, index_end_exclusive - index_start, _aux + index_start);
-            }
+        template <typename T>
+        void hybrid_sample_OpenMP(T* A, size_t size, bool radix, T* tmp_array) {
+            hybrid_sample(A, size, tmp_array, radix);
+        }
 
-            // merge down the blocks
-            IndexUInt32* in = _array;
-            IndexUInt32* out = _aux;
+#define ARIBEIRO_SORT_OPENMP_INSTANTIATE(T) \
+        template void hybrid_bucket_OpenMP<T>(T* A, size_t size, bool radix, T* tmp_array); \
+        template void hybrid_counting_OpenMP<T>(T* A, size_t size, bool radix, T* tmp_array); \
+        template void hybrid_merge_OpenMP<T>(T* A, size_t size, bool radix, T* pre_alloc_tmp); \
+        template void hybrid_sample_OpenMP<T>(T* A, size_t size, bool radix, T* tmp_array); \
+        template void topK_OpenMP<T>(const T* A, size_t size, size_t k, T* out, bool largest); \
+        template void partialSort_OpenMP<T>(T* A, size_t size, size_t k); \
+        template void nthElement_OpenMP<T>(T* A, size_t size, size_t nth);
+
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(int32_t)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(uint32_t)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(int64_t)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(uint64_t)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(float)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(double)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(IndexInt32)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(IndexUInt32)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(IndexInt32_64)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(IndexUInt32_64)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(IndexInt64)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(IndexUInt64)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(IndexFloat)
+        ARIBEIRO_SORT_OPENMP_INSTANTIATE(IndexDouble)
+
+#undef ARIBEIRO_SORT_OPENMP_INSTANTIATE
+
+        //
+        // signed
+        //
+
+        void hybrid_bucket_std_signed_OpenMP(int32_t* A, size_t size) {
+            hybrid_bucket<int32_t>(A, size, NULL, false);
+        }
 
-            int element_count = job_thread_size;
+        void hybrid_bucket_radix_counting_signed_OpenMP(int32_t* A, size_t size, int32_t* tmp_array) {
+            hybrid_bucket(A, size, tmp_array, true);
+        }
 
-            while (element_count < size) {
+        void hybrid_bucket_radix_counting_signed_index_OpenMP(IndexInt32* A, size_t size, IndexInt32* tmp_array) {
+            hybrid_bucket(A, size, tmp_array, true);
+        }
 
-                //merge operation
-#pragma omp parallel for
-                for (int i = 0; i < size; i += (element_count << 1)) {
+        void hybrid_counting_std_signed_OpenMP(int32_t* A, size_t size, int32_t* _tmp_array) {
+            hybrid_counting(A, size, _tmp_array, false);
+        }
 
-                    int write_index = i;
-                    int write_max = i + (element_count << 1);
-                    if (write_max > size)
-                        write_max = size;
+        void hybrid_counting_radix_counting_signed_OpenMP(int32_t* A, size_t size, int32_t* _tmp_array) {
+            hybrid_counting(A, size, _tmp_array, true);
+        }
 
-                    int a_index = i;
-                    int b_index = i + element_count;
+        void hybrid_counting_radix_counting_signed_index_OpenMP(IndexInt32* A, size_t size, IndexInt32* _tmp_array) {
+            hybrid_counting(A, size, _tmp_array, true);
+        }
 
-                    int a_max = b_index;
-                    int b_max = b_index + element_count;
+        void hybrid_merge_std_signed_OpenMP(int32_t* _array, size_t size, int32_t* _pre_alloc_tmp) {
+            hybrid_merge(_array, size, _pre_alloc_tmp, false);
+        }
 
-                    if (a_max > size)
-                        a_max = size;
-                    if (b_max > size)
-                        b_max = size;
+        void hybrid_merge_radix_counting_signed_OpenMP(int32_t* _array, size_t size, int32_t* _pre_alloc_tmp) {
+            hybrid_merge(_array, size, _pre_alloc_tmp, true);
+        }
 
-                    while (write_index < write_max &&
-                        a_index < a_max &&
-                        b_index < b_max) {
+        void hybrid_merge_radix_counting_signed_index_OpenMP(IndexInt32* _array, size_t size, IndexInt32* _pre_alloc_tmp) {
+            hybrid_merge(_array, size, _pre_alloc_tmp, true);
+        }
 
-                        const IndexUInt32& _a = in[a_index];
-                        const IndexUInt32& _b = in[b_index];
+        //
+        // unsigned
+        //
 
-                        if (_a.toSort > _b.toSort) {
-                            out[write_index] = _b;
-                            b_index++;
-                        }
-                        else {
-                            out[write_index] = _a;
-                            a_index++;
-                        }
+        void hybrid_bucket_std_unsigned_OpenMP(uint32_t* A, size_t size) {
+            hybrid_bucket<uint32_t>(A, size, NULL, false);
+        }
 
-                        write_index++;
-                    }
+        void hybrid_bucket_radix_counting_unsigned_OpenMP(uint32_t* A, size_t size, uint32_t* tmp_array) {
+            hybrid_bucket(A, size, tmp_array, true);
+        }
 
-                    while (a_index < a_max) {
-                        out[write_index++] = in[a_index++];
-                    }
-                    while (b_index < b_max) {
-                        out[write_index++] = in[b_index++];
-                    }
+        void hybrid_bucket_radix_counting_unsigned_index_OpenMP(IndexUInt32* A, size_t size, IndexUInt32* tmp_array) {
+            hybrid_bucket(A, size, tmp_array, true);
+        }
 
-                }
+        void hybrid_counting_std_unsigned_OpenMP(uint32_t* A, size_t size, uint32_t* _tmp_array) {
+            hybrid_counting(A, size, _tmp_array, false);
+        }
 
-                //swap in/out
-                IndexUInt32* aux = in;
-                in = out;
-                out = aux;
+        void hybrid_counting_radix_counting_unsigned_OpenMP(uint32_t* A, size_t size, uint32_t* _tmp_array) {
+            hybrid_counting(A, size, _tmp_array, true);
+        }
 
-                element_count = element_count << 1;
-            }
+        void hybrid_counting_radix_counting_unsigned_index_OpenMP(IndexUInt32* A, size_t size, IndexUInt32* _tmp_array) {
+            hybrid_counting(A, size, _tmp_array, true);
+        }
 
-            if (in != _array)
-                memcpy(_array, in, sizeof(IndexUInt32) * size);
+        void hybrid_merge_std_unsigned_OpenMP(uint32_t* _array, size_t size, uint32_t* _pre_alloc_tmp) {
+            hybrid_merge(_array, size, _pre_alloc_tmp, false);
+        }
 
-            if (_pre_alloc_tmp == NULL)
-                free_aligned(_aux);
+        void hybrid_merge_radix_counting_unsigned_OpenMP(uint32_t* _array, size_t size, uint32_t* _pre_alloc_tmp) {
+            hybrid_merge(_array, size, _pre_alloc_tmp, true);
         }
 
+        void hybrid_merge_radix_counting_unsigned_index_OpenMP(IndexUInt32* _array, size_t size, IndexUInt32* _pre_alloc_tmp) {
+            hybrid_merge(_array, size, _pre_alloc_tmp, true);
+        }
 
     }
 }
@@ -3,33 +3,74 @@
 
 #include <aRibeiroCore/common.h>
 #include <aRibeiroCore/Algorithms.h>
+#include <aRibeiroPlatform/AlgorithmsKeyTraits.h>
+#include <aRibeiroPlatform/AlgorithmsMerge.h>
+#include <aRibeiroPlatform/AlgorithmsSample.h>
+#include <aRibeiroPlatform/AlgorithmsSelect.h>
 
 namespace aRibeiro {
     namespace Sorting {
 
-        void hybrid_bucket_std_signed_OpenMP(int32_t* A, uint32_t size);
-        void hybrid_bucket_radix_counting_signed_OpenMP(int32_t* A, uint32_t size, int32_t* tmp_array = NULL);
-        void hybrid_bucket_radix_counting_signed_index_OpenMP(IndexInt32* A, uint32_t size, IndexInt32* tmp_array = NULL);
+        //
+        // The element counts are size_t: arrays bigger than 4G elements are supported.
+        //
+
+        void hybrid_bucket_std_signed_OpenMP(int32_t* A, size_t size);
+        void hybrid_bucket_radix_counting_signed_OpenMP(int32_t* A, size_t size, int32_t* tmp_array = NULL);
+        void hybrid_bucket_radix_counting_signed_index_OpenMP(IndexInt32* A, size_t size, IndexInt32* tmp_array = NULL);
         
-        void hybrid_counting_std_signed_OpenMP(int32_t* A, uint32_t size, int32_t* tmp_array = NULL);
-        void hybrid_counting_radix_counting_signed_OpenMP(int32_t* A, uint32_t size, int32_t* tmp_array = NULL);
-        void hybrid_counting_radix_counting_signed_index_OpenMP(IndexInt32* A, uint32_t size, IndexInt32* tmp_array = NULL);
+        void hybrid_counting_std_signed_OpenMP(int32_t* A, size_t size, int32_t* tmp_array = NULL);
+        void hybrid_counting_radix_counting_signed_OpenMP(int32_t* A, size_t size, int32_t* tmp_array = NULL);
+        void hybrid_counting_radix_counting_signed_index_OpenMP(IndexInt32* A, size_t size, IndexInt32* tmp_array = NULL);
+
+        void hybrid_merge_std_signed_OpenMP(int32_t* _array, size_t size, int32_t* pre_alloc_tmp = NULL);
+        void hybrid_merge_radix_counting_signed_OpenMP(int32_t* _array, size_t size, int32_t* pre_alloc_tmp = NULL);
+        void hybrid_merge_radix_counting_signed_index_OpenMP(IndexInt32* _array, size_t size, IndexInt32* pre_alloc_tmp = NULL);
+
+        void hybrid_bucket_std_unsigned_OpenMP(uint32_t* A, size_t size);
+        void hybrid_bucket_radix_counting_unsigned_OpenMP(uint32_t* A, size_t size, uint32_t* tmp_array = NULL);
+        void hybrid_bucket_radix_counting_unsigned_index_OpenMP(IndexUInt32* A, size_t size, IndexUInt32* tmp_array = NULL);
 
-        void hybrid_merge_std_signed_OpenMP(int32_t* _array, uint32_t size, int32_t* pre_alloc_tmp = NULL);
-        void hybrid_merge_radix_counting_signed_OpenMP(int32_t* _array, uint32_t size, int32_t* pre_alloc_tmp = NULL);
-        void hybrid_merge_radix_counting_signed_index_OpenMP(IndexInt32* _array, uint32_t size, IndexInt32* pre_alloc_tmp = NULL);
+        void hybrid_counting_std_unsigned_OpenMP(uint32_t* A, size_t size, uint32_t* tmp_array = NULL);
+        void hybrid_counting_radix_counting_unsigned_OpenMP(uint32_t* A, size_t size, uint32_t* tmp_array = NULL);
+        void hybrid_counting_radix_counting_unsigned_index_OpenMP(IndexUInt32* A, size_t size, IndexUInt32* tmp_array = NULL);
 
-        void hybrid_bucket_std_unsigned_OpenMP(uint32_t* A, uint32_t size);
-        void hybrid_bucket_radix_counting_unsigned_OpenMP(uint32_t* A, uint32_t size, uint32_t* tmp_array = NULL);
-        void hybrid_bucket_radix_counting_unsigned_index_OpenMP(IndexUInt32* A, uint32_t size, IndexUInt32* tmp_array = NULL);
+        void hybrid_merge_std_unsigned_OpenMP(uint32_t* _array, size_t size, uint32_t* pre_alloc_tmp = NULL);
+        void hybrid_merge_radix_counting_unsigned_OpenMP(uint32_t* _array, size_t size, uint32_t* pre_alloc_tmp = NULL);
+        void hybrid_merge_radix_counting_unsigned_index_OpenMP(IndexUInt32* _array, size_t size, IndexUInt32* pre_alloc_tmp = NULL);
 
-        void hybrid_counting_std_unsigned_OpenMP(uint32_t* A, uint32_t size, uint32_t* tmp_array = NULL);
-        void hybrid_counting_radix_counting_unsigned_OpenMP(uint32_t* A, uint32_t size, uint32_t* tmp_array = NULL);
-        void hybrid_counting_radix_counting_unsigned_index_OpenMP(IndexUInt32* A, uint32_t size, IndexUInt32* tmp_array = NULL);
+        //
+        // Any element type with SortKeyTraits (AlgorithmsKeyTraits.h):
+        //   int32_t, uint32_t, int64_t, uint64_t, float, double,
+        //   IndexInt32, IndexUInt32 and IndexKey64<K>.
+        //
+        // radix: true to sort the blocks with the radix sort, false to use the std::sort.
+        //
+        template <typename T>
+        void hybrid_bucket_OpenMP(T* A, size_t size, bool radix = true, T* tmp_array = NULL);
+        template <typename T>
+        void hybrid_counting_OpenMP(T* A, size_t size, bool radix = true, T* tmp_array = NULL);
+        template <typename T>
+        void hybrid_merge_OpenMP(T* A, size_t size, bool radix = true, T* pre_alloc_tmp = NULL);
+        // splitters from a sample of the array: balanced buckets with skewed keys
+        template <typename T>
+        void hybrid_sample_OpenMP(T* A, size_t size, bool radix = true, T* tmp_array = NULL);
 
-        void hybrid_merge_std_unsigned_OpenMP(uint32_t* _array, uint32_t size, uint32_t* pre_alloc_tmp = NULL);
-        void hybrid_merge_radix_counting_unsigned_OpenMP(uint32_t* _array, uint32_t size, uint32_t* pre_alloc_tmp = NULL);
-        void hybrid_merge_radix_counting_unsigned_index_OpenMP(IndexUInt32* _array, uint32_t size, IndexUInt32* pre_alloc_tmp = NULL);
+        //
+        // Radix select (AlgorithmsSelect.h):
+        //
+        // topK: the k smallest elements (or biggest with largest = true) sorted to out,
+        //       the equal elements keep their order.
+        // partialSort: A[0 .. k) sorted, the remaining elements after them.
+        // nthElement: A[nth] is the element of the sorted array, the elements before
+        //             it are less or equal, and the elements after it greater or equal.
+        //
+        template <typename T>
+        void topK_OpenMP(const T* A, size_t size, size_t k, T* out, bool largest = false);
+        template <typename T>
+        void partialSort_OpenMP(T* A, size_t size, size_t k);
+        template <typename T>
+        void nthElement_OpenMP(T* A, size_t size, size_t nth);
 
     }
 }
@@ -0,0 +1,323 @@
+#include "AlgorithmsRadixSIMD.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define ARIBEIRO_RADIX_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+        // MSVC accepts the intrinsics without target flags
+        #define ARIBEIRO_TARGET_AVX512
+    #else
+        #define ARIBEIRO_TARGET_AVX512 __attribute__((target("avx512f")))
+    #endif
+#endif
+
+namespace aRibeiro {
+    namespace Sorting {
+
+        //
+        // CPU detection
+        //
+
+        static RadixSortSIMD __detect_simd() {
+#if defined(ARIBEIRO_RADIX_X86)
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return RadixSortSIMD_None;
+            __cpuid(info, 1);
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            bool avx = (info[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx)
+                return RadixSortSIMD_None;
+            // the OS saves the zmm registers
+            unsigned long long xcr0 = _xgetbv(0);
+            __cpuidex(info, 7, 0);
+            if ((info[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6)
+                return RadixSortSIMD_AVX512;
+#else
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f"))
+                return RadixSortSIMD_AVX512;
+#endif
+#endif
+            return RadixSortSIMD_None;
+        }
+
+        static RadixSortSIMD& __simd_level() {
+            static RadixSortSIMD level = radix_sort_simd_supported();
+            return level;
+        }
+
+        RadixSortSIMD radix_sort_simd_supported() {
+            static RadixSortSIMD supported = __detect_simd();
+            return supported;
+        }
+
+        RadixSortSIMD radix_sort_simd_level() {
+            return __simd_level();
+        }
+
+        void radix_sort_set_simd_level(RadixSortSIMD level) {
+            if (level > radix_sort_simd_supported())
+                level = radix_sort_simd_supported();
+            __simd_level() = level;
+        }
+
+        //
+        // Layout of the elements: the key is the first uint32_t of the element.
+        //
+        //   xor_mask: converts the key to the radix key (sign flip of the signed keys)
+        //   stride: uint32_t words per element
+        //
+        template <typename T>
+        struct __RadixLayout;
+
+        template <>
+        struct __RadixLayout<uint32_t> {
+            static const uint32_t xor_mask = 0;
+            static const int stride = 1;
+        };
+
+        template <>
+        struct __RadixLayout<int32_t> {
+            static const uint32_t xor_mask = UINT32_C(0x80000000);
+            static const int stride = 1;
+        };
+
+        template <>
+        struct __RadixLayout<IndexUInt32> {
+            static const uint32_t xor_mask = 0;
+            static const int stride = 2;
+        };
+
+        template <>
+        struct __RadixLayout<IndexInt32> {
+            static const uint32_t xor_mask = UINT32_C(0x80000000);
+            static const int stride = 2;
+        };
+
+        template <typename T>
+        static ARIBEIRO_INLINE uint32_t __radix_key(const T& element) {
+            uint32_t key;
+            memcpy(&key, &element, sizeof(uint32_t));
+            return key ^ __RadixLayout<T>::xor_mask;
+        }
+
+        //
+        // Histogram of the 4 digits
+        //
+
+        template <typename T>
+        static void __histogram_scalar(const T* A, size_t size, size_t counting[4][256]) {
+            for (size_t i = 0; i < size; i++) {
+                uint32_t k = __radix_key(A[i]);
+                counting[0][k & 0xff]++;
+                counting[1][(k >> 8) & 0xff]++;
+                counting[2][(k >> 16) & 0xff]++;
+                counting[3][k >> 24]++;
+            }
+        }
+
+#if defined(ARIBEIRO_RADIX_X86)
+
+        //
+        // Histogram of the key/index pairs:
+        //   one permute extracts the 16 keys of 2 vectors,
+        //   the vector is stored and the digits are counted from the stored words.
+        //
+        template <typename T>
+        ARIBEIRO_TARGET_AVX512 static void __histogram_index_avx512(const T* A, size_t size, size_t counting[4][256]) {
+            const uint32_t* words = (const uint32_t*)A;
+            const __m512i mask = _mm512_set1_epi32((int)__RadixLayout<T>::xor_mask);
+            // even lanes of the two vectors (keys)
+            const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+
+            alignas(64) uint32_t keys[16];
+
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                __m512i k = _mm512_permutex2var_epi32(
+                    _mm512_loadu_si512((const void*)(words + i * 2)),
+                    even,
+                    _mm512_loadu_si512((const void*)(words + i * 2 + 16)));
+                k = _mm512_xor_si512(k, mask);
+                _mm512_store_si512((void*)keys, k);
+                for (int j = 0; j < 16; j++) {
+                    uint32_t key = keys[j];
+                    counting[0][key & 0xff]++;
+                    counting[1][(key >> 8) & 0xff]++;
+                    counting[2][(key >> 16) & 0xff]++;
+                    counting[3][key >> 24]++;
+                }
+            }
+
+            __histogram_scalar(A + i, size - i, counting);
+        }
+
+#endif
+
+        //
+        // Scatter
+        //
+
+        template <typename T>
+        static void __scatter(const T* in, T* out, size_t size, size_t* offset, int shift) {
+            for (size_t i = 0; i < size; i++) {
+                const T& element = in[i];
+                out[offset[(__radix_key(element) >> shift) & 0xff]++] = element;
+            }
+        }
+
+#if defined(ARIBEIRO_RADIX_X86)
+
+        // non-temporal write of one cache line: it goes to memory without being read (no RFO)
+        static ARIBEIRO_INLINE void __stream_line(void* dst, const void* src) {
+            const __m128i* s = (const __m128i*)src;
+            __m128i* d = (__m128i*)dst;
+            _mm_stream_si128(d, _mm_load_si128(s));
+            _mm_stream_si128(d + 1, _mm_load_si128(s + 1));
+            _mm_stream_si128(d + 2, _mm_load_si128(s + 2));
+            _mm_stream_si128(d + 3, _mm_load_si128(s + 3));
+        }
+
+        //
+        // Write-combining scatter:
+        //
+        // the elements are written to a line buffer of its digit,
+        // and the buffer goes to the output when it is full.
+        //
+        // The output must be 64 bytes aligned: the buffer slots follow the output
+        // cache lines, so all full writes are aligned lines.
+        // The first and last lines of a digit are shared with the neighbor digits,
+        // they are written with memcpy.
+        //
+        template <typename T>
+        static void __scatter_wc(const T* in, T* out, size_t size, size_t* offset, int shift) {
+            const size_t LINE = 64 / sizeof(T);
+
+            alignas(64) uint8_t buffer_memory[256 * 64];
+            T* buffer = (T*)buffer_memory;
+            // output index of the slot 0 of the buffer
+            size_t line_begin[256];
+            // first valid slot, and the next free slot
+            uint32_t start[256];
+            uint32_t fill[256];
+
+            for (int d = 0; d < 256; d++) {
+                uint32_t slot = (uint32_t)(offset[d] & (LINE - 1));
+                line_begin[d] = offset[d] - slot;
+                start[d] = slot;
+                fill[d] = slot;
+            }
+
+            for (size_t i = 0; i < size; i++) {
+                const T& element = in[i];
+                uint32_t d = (__radix_key(element) >> shift) & 0xff;
+                T* line = buffer + d * LINE;
+                line[fill[d]++] = element;
+                if (fill[d] == LINE) {
+                    if (start[d] == 0)
+                        __stream_line(out + line_begin[d], line);
+                    else
+                        memcpy(out + line_begin[d] + start[d], line + start[d], (LINE - start[d]) * sizeof(T));
+                    line_begin[d] += LINE;
+                    start[d] = 0;
+                    fill[d] = 0;
+                }
+            }
+
+            for (int d = 0; d < 256; d++) {
+                if (fill[d] > start[d])
+                    memcpy(out + line_begin[d] + start[d], buffer + d * LINE + start[d], (fill[d] - start[d]) * sizeof(T));
+            }
+
+            _mm_sfence();
+        }
+
+#endif
+
+        //
+        // The write-combining scatter pays only with the non-temporal stores:
+        // when the output does not fit in the cache.
+        // Below this size the direct scatter is faster (the output lines stay in the cache).
+        //
+        static const size_t WC_STREAM_BYTES = 16 * 1024 * 1024;
+
+        template <typename T>
+        static void __radix_sort32(T* A, size_t size, T* tmp) {
+            if (size < 2)
+                return;
+
+            size_t counting[4][256];
+            memset(counting, 0, sizeof(counting));
+
+            // With the contiguous keys the histogram is bound by the counter increments,
+            // and the vector loads do not make it faster (measured with AVX2 and AVX-512).
+            // With the key/index pairs, the AVX-512 permute of the keys pays.
+            if (__RadixLayout<T>::stride > 1 && radix_sort_simd_level() == RadixSortSIMD_AVX512)
+                __histogram_index_avx512(A, size, counting);
+            else
+                __histogram_scalar(A, size, counting);
+
+            bool stream = size * sizeof(T) >= WC_STREAM_BYTES;
+
+            T* in = A;
+            T* out = tmp;
+
+            for (int p = 0; p < 4; p++) {
+                int shift = p << 3;
+                size_t* count = counting[p];
+
+                // all elements have the same digit
+                if (count[(__radix_key(in[0]) >> shift) & 0xff] == size)
+                    continue;
+
+                size_t acc = 0;
+                for (int j = 0; j < 256; j++) {
+                    size_t tmp_count = count[j];
+                    count[j] = acc;
+                    acc += tmp_count;
+                }
+
+#if defined(ARIBEIRO_RADIX_X86)
+                if (stream && ((uintptr_t)out & 63) == 0)
+                    __scatter_wc(in, out, size, count, shift);
+                else
+#endif
+                    __scatter(in, out, size, count, shift);
+
+                T* swap = in;
+                in = out;
+                out = swap;
+            }
+
+            if (in != A)
+                memcpy(A, in, size * sizeof(T));
+        }
+
+        bool radix_counting_sort_simd(int32_t* A, size_t size, int32_t* tmp) {
+            __radix_sort32(A, size, tmp);
+            return true;
+        }
+
+        bool radix_counting_sort_simd(uint32_t* A, size_t size, uint32_t* tmp) {
+            __radix_sort32(A, size, tmp);
+            return true;
+        }
+
+        bool radix_counting_sort_simd(IndexInt32* A, size_t size, IndexInt32* tmp) {
+            __radix_sort32(A, size, tmp);
+            return true;
+        }
+
+        bool radix_counting_sort_simd(IndexUInt32* A, size_t size, IndexUInt32* tmp) {
+            __radix_sort32(A, size, tmp);
+            return true;
+        }
+
+    }
+}
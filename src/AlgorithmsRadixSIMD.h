@@ -0,0 +1,54 @@
+#ifndef __algorithms__radix_simd__h__
+#define __algorithms__radix_simd__h__
+
+#include <aRibeiroCore/common.h>
+#include <aRibeiroCore/Algorithms.h>
+
+namespace aRibeiro {
+    namespace Sorting {
+
+        enum RadixSortSIMD {
+            RadixSortSIMD_None = 0,
+            RadixSortSIMD_AVX512
+        };
+
+        //
+        // Instruction set used by the radix sort kernels of the 32 bits keys.
+        //
+        // The supported level is detected at the first call (cpuid).
+        //
+        RadixSortSIMD radix_sort_simd_supported();
+        RadixSortSIMD radix_sort_simd_level();
+
+        //
+        // Use a lower level (benchmark / test of the fallbacks).
+        // The level is clamped to the supported one.
+        // Not thread safe: call it before starting the sorts.
+        //
+        void radix_sort_set_simd_level(RadixSortSIMD level);
+
+        //
+        // LSD radix sort kernels of the 32 bits keys:
+        //
+        //  - histogram of the 4 digits in one read pass
+        //    (AVX-512 key extraction of the Index types, with runtime dispatch)
+        //  - scatter of big arrays through write-combining buffers: one cache line per digit
+        //    (16KB, L1 resident), written to the output as aligned lines with non-temporal stores
+        //
+        // radix_counting_sort_key calls them for int32_t, uint32_t, IndexInt32 and IndexUInt32.
+        // Returns false for the other types.
+        //
+        template <typename T>
+        ARIBEIRO_INLINE bool radix_counting_sort_simd(T* A, size_t size, T* tmp) {
+            return false;
+        }
+
+        bool radix_counting_sort_simd(int32_t* A, size_t size, int32_t* tmp);
+        bool radix_counting_sort_simd(uint32_t* A, size_t size, uint32_t* tmp);
+        bool radix_counting_sort_simd(IndexInt32* A, size_t size, IndexInt32* tmp);
+        bool radix_counting_sort_simd(IndexUInt32* A, size_t size, IndexUInt32* tmp);
+
+    }
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef __algorithms__sample__h__
+#define __algorithms__sample__h__
+
+#include <aRibeiroCore/common.h>
+#include <aRibeiroPlatform/AlgorithmsKeyTraits.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace aRibeiro {
+    namespace Sorting {
+
+        //
+        // Sample sort (super scalar sample sort):
+        //
+        // the splitters are chosen from a random sample of the array, so the buckets
+        // have about the same size with any key distribution (clustered keys,
+        // timestamps, sequential IDs).
+        //
+        // Each splitter has an equality bucket: the elements with the key of the
+        // splitter go to it and do not need to be sorted. Many equal keys do not
+        // make one bucket bigger than the others.
+        //
+        // Bucket 2*i: keys between the splitters i-1 and i
+        // Bucket 2*i+1: keys equal to the splitter i
+        //
+        template <typename T>
+        class SampleSortSplitters {
+        public:
+            typedef SortKeyTraits<T> Traits;
+            typedef typename Traits::radix_type radix_type;
+
+            static const int LOG_BUCKETS = 7;
+            // buckets of the tree
+            static const int TREE_BUCKETS = 1 << LOG_BUCKETS;
+            // tree buckets plus the equality buckets (fits in uint8_t)
+            static const int BUCKETS = TREE_BUCKETS * 2;
+            // samples for each bucket
+            static const int OVERSAMPLING = 64;
+
+            // implicit binary search tree of the splitters: tree[1 .. TREE_BUCKETS - 1]
+            radix_type tree[TREE_BUCKETS];
+            // sorted splitters, the last one is the max key
+            radix_type splitter[TREE_BUCKETS];
+
+            // chooses the splitters from a sample of A
+            void build(const T* A, size_t size) {
+                const int sample_count = TREE_BUCKETS * OVERSAMPLING;
+                std::vector<radix_type> sample(sample_count);
+
+                // LCG with a fixed seed: the same input gives the same buckets
+                uint64_t seed = UINT64_C(0x9E3779B97F4A7C15) ^ (uint64_t)size;
+                for (int i = 0; i < sample_count; i++) {
+                    seed = seed * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+                    size_t index;
+                    if ((uint64_t)size <= UINT32_MAX)
+                        index = (size_t)(((seed >> 32) * (uint64_t)size) >> 32);
+                    else
+                        index = (size_t)((seed >> 1) % (uint64_t)size);
+                    sample[i] = Traits::radixKey(A[index]);
+                }
+
+                std::sort(sample.begin(), sample.end());
+
+                for (int i = 0; i < TREE_BUCKETS - 1; i++)
+                    splitter[i] = sample[(i + 1) * OVERSAMPLING - 1];
+                splitter[TREE_BUCKETS - 1] = ~(radix_type)0;
+
+                int next = 0;
+                fillTree(1, &next);
+                tree[0] = 0;
+            }
+
+            // bucket of one element: log2(TREE_BUCKETS) comparisons without branches
+            ARIBEIRO_INLINE int classify(const T& element) const {
+                radix_type key = Traits::radixKey(element);
+                int j = 1;
+                for (int l = 0; l < LOG_BUCKETS; l++)
+                    j = (j << 1) + (int)(key > tree[j]);
+                int b = j - TREE_BUCKETS;
+                return (b << 1) + (int)(key == splitter[b]);
+            }
+
+            static ARIBEIRO_INLINE bool isEqualityBucket(int bucket) {
+                return (bucket & 1) != 0;
+            }
+
+        private:
+            // in-order fill: the tree leaf of a key is the count of splitters less than it
+            void fillTree(int j, int* next) {
+                if (j >= TREE_BUCKETS)
+                    return;
+                fillTree(j << 1, next);
+                tree[j] = splitter[(*next)++];
+                fillTree((j << 1) + 1, next);
+            }
+        };
+
+        //
+        // Classification of the range [begin, end):
+        //   oracle[i] receives the bucket of A[i], and count[bucket] is incremented.
+        //
+        // 4 elements go down the tree at the same time: the searches are independent,
+        // so the loads of the tree levels overlap.
+        //
+        template <typename T>
+        void sample_sort_classify(const SampleSortSplitters<T>& splitters, const T* A, size_t begin, size_t end, uint8_t* oracle, size_t* count) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
+            const int TREE_BUCKETS = SampleSortSplitters<T>::TREE_BUCKETS;
+            const radix_type* tree = splitters.tree;
+            const radix_type* splitter = splitters.splitter;
+
+            size_t i = begin;
+            for (; i + 4 <= end; i += 4) {
+                radix_type k0 = SortKeyTraits<T>::radixKey(A[i]);
+                radix_type k1 = SortKeyTraits<T>::radixKey(A[i + 1]);
+                radix_type k2 = SortKeyTraits<T>::radixKey(A[i + 2]);
+                radix_type k3 = SortKeyTraits<T>::radixKey(A[i + 3]);
+                int j0 = 1, j1 = 1, j2 = 1, j3 = 1;
+                for (int l = 0; l < SampleSortSplitters<T>::LOG_BUCKETS; l++) {
+                    j0 = (j0 << 1) + (int)(k0 > tree[j0]);
+                    j1 = (j1 << 1) + (int)(k1 > tree[j1]);
+                    j2 = (j2 << 1) + (int)(k2 > tree[j2]);
+                    j3 = (j3 << 1) + (int)(k3 > tree[j3]);
+                }
+                j0 -= TREE_BUCKETS;
+                j1 -= TREE_BUCKETS;
+                j2 -= TREE_BUCKETS;
+                j3 -= TREE_BUCKETS;
+                j0 = (j0 << 1) + (int)(k0 == splitter[j0]);
+                j1 = (j1 << 1) + (int)(k1 == splitter[j1]);
+                j2 = (j2 << 1) + (int)(k2 == splitter[j2]);
+                j3 = (j3 << 1) + (int)(k3 == splitter[j3]);
+                oracle[i] = (uint8_t)j0;
+                oracle[i + 1] = (uint8_t)j1;
+                oracle[i + 2] = (uint8_t)j2;
+                oracle[i + 3] = (uint8_t)j3;
+                count[j0]++;
+                count[j1]++;
+                count[j2]++;
+                count[j3]++;
+            }
+            for (; i < end; i++) {
+                int b = splitters.classify(A[i]);
+                oracle[i] = (uint8_t)b;
+                count[b]++;
+            }
+        }
+
+        //
+        // Copy of the range [begin, end) to the buckets of out:
+        //   offset[bucket] is the next position of the bucket (incremented).
+        //
+        // The order of the elements in each bucket is kept (stable).
+        //
+        template <typename T>
+        void sample_sort_scatter(const T* A, size_t begin, size_t end, const uint8_t* oracle, size_t* offset, T* out) {
+            for (size_t i = begin; i < end; i++)
+                out[offset[oracle[i]]++] = A[i];
+        }
+
+    }
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef __algorithms__select__h__
+#define __algorithms__select__h__
+
+#include <aRibeiroCore/common.h>
+#include <aRibeiroPlatform/AlgorithmsKeyTraits.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace aRibeiro {
+    namespace Sorting {
+
+        //
+        // Radix select: kernels of the parallel topK, partialSort and nthElement.
+        //
+        // The element of rank r is found from the most significant digit (8 bits):
+        // each thread counts the digits of its part, the bucket with the rank is chosen,
+        // and the next digit is counted only for the elements of that bucket.
+        // When the bucket is small, its keys are copied to a buffer and the next
+        // rounds read the buffer.
+        //
+        // The topK of a small k uses a local heap for each thread instead (select_heap).
+        //
+        // The keys are the radix keys xor mask:
+        //   mask = 0: smallest first, mask = ~0: biggest first.
+        //
+
+        template <typename T>
+        ARIBEIRO_INLINE typename SortKeyTraits<T>::radix_type select_key(const T& element, typename SortKeyTraits<T>::radix_type mask) {
+            return SortKeyTraits<T>::radixKey(element) ^ mask;
+        }
+
+        //
+        // Histogram of the digit at shift of the keys with the prefix
+        // (the digits above shift equal to the digits of the prefix).
+        //
+        template <typename T>
+        void radix_select_histogram(const T* A, size_t begin, size_t end, typename SortKeyTraits<T>::radix_type mask,
+            int shift, typename SortKeyTraits<T>::radix_type prefix, size_t* count) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
+            if (shift + 8 >= (int)sizeof(radix_type) * 8) {
+                for (size_t i = begin; i < end; i++)
+                    count[(select_key(A[i], mask) >> shift) & 0xff]++;
+                return;
+            }
+            radix_type high = prefix >> (shift + 8);
+            for (size_t i = begin; i < end; i++) {
+                radix_type key = select_key(A[i], mask);
+                if ((key >> (shift + 8)) == high)
+                    count[(key >> shift) & 0xff]++;
+            }
+        }
+
+        //
+        // Copy of the keys with the prefix (the digits from shift up) to out.
+        // Returns the number of keys copied.
+        //
+        template <typename T>
+        size_t radix_select_collect(const T* A, size_t begin, size_t end, typename SortKeyTraits<T>::radix_type mask,
+            int shift, typename SortKeyTraits<T>::radix_type prefix, typename SortKeyTraits<T>::radix_type* out) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
+            radix_type high = prefix >> shift;
+            size_t count = 0;
+            for (size_t i = begin; i < end; i++) {
+                radix_type key = select_key(A[i], mask);
+                if ((key >> shift) == high)
+                    out[count++] = key;
+            }
+            return count;
+        }
+
+        //
+        // Digit of the bucket with the element of *rank.
+        // The rank becomes the rank inside the bucket.
+        //
+        ARIBEIRO_INLINE int radix_select_digit(const size_t* count, size_t* rank) {
+            int digit = 0;
+            while (*rank >= count[digit]) {
+                *rank -= count[digit];
+                digit++;
+            }
+            return digit;
+        }
+
+        //
+        // Three way partition by the threshold key: count of the elements
+        // less than and equal to the threshold.
+        //
+        template <typename T>
+        void select_partition_count(const T* A, size_t begin, size_t end, typename SortKeyTraits<T>::radix_type mask,
+            typename SortKeyTraits<T>::radix_type threshold, size_t* less, size_t* equal) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
+            size_t l = 0, e = 0;
+            for (size_t i = begin; i < end; i++) {
+                radix_type key = select_key(A[i], mask);
+                l += (size_t)(key < threshold);
+                e += (size_t)(key == threshold);
+            }
+            *less += l;
+            *equal += e;
+        }
+
+        //
+        // Three way partition of [begin, end) to out, keeping the order of the elements:
+        //   less: out[less_pos ...]
+        //   equal: out[equal_pos ... equal_end), the others are discarded
+        //   greater: out[greater_pos ...], or discarded when greater_pos is SIZE_MAX
+        //
+        template <typename T>
+        void select_partition_scatter(const T* A, size_t begin, size_t end, typename SortKeyTraits<T>::radix_type mask,
+            typename SortKeyTraits<T>::radix_type threshold,
+            size_t less_pos, size_t equal_pos, size_t equal_end, size_t greater_pos, T* out) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
+            bool keep_greater = greater_pos != SIZE_MAX;
+            for (size_t i = begin; i < end; i++) {
+                radix_type key = select_key(A[i], mask);
+                if (key < threshold)
+                    out[less_pos++] = A[i];
+                else if (key == threshold) {
+                    if (equal_pos < equal_end)
+                        out[equal_pos++] = A[i];
+                }
+                else if (keep_greater)
+                    out[greater_pos++] = A[i];
+            }
+        }
+
+        //
+        // Local heap of the k smallest keys of [begin, end) (small k):
+        //   (key, position) pairs, so the equal keys keep the first positions.
+        //
+        // One pass over the data: most elements are only compared with the top of the heap.
+        // The heaps of the threads are merged by sorting the pairs.
+        // Returns the number of pairs in the heap.
+        //
+        template <typename T>
+        size_t select_heap(const T* A, size_t begin, size_t end, typename SortKeyTraits<T>::radix_type mask, size_t k,
+            std::pair<typename SortKeyTraits<T>::radix_type, size_t>* heap) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
+            size_t count = 0;
+            size_t i = begin;
+            for (; i < end && count < k; i++) {
+                heap[count++] = std::make_pair(select_key(A[i], mask), i);
+                std::push_heap(heap, heap + count);
+            }
+            for (; i < end; i++) {
+                radix_type key = select_key(A[i], mask);
+                if (key < heap[0].first) {
+                    std::pop_heap(heap, heap + k);
+                    heap[k - 1] = std::make_pair(key, i);
+                    std::push_heap(heap, heap + k);
+                }
+            }
+            return count;
+        }
+
+        //
+        // Sorted in the reverse order of the keys, and the equal keys keep their order:
+        //   reverses the array and each run of equal keys.
+        //
+        template <typename T>
+        void select_reverse_stable(T* A, size_t size) {
+            std::reverse(A, A + size);
+            size_t begin = 0;
+            while (begin < size) {
+                size_t end = begin + 1;
+                while (end < size && SortKeyTraits<T>::radixKey(A[end]) == SortKeyTraits<T>::radixKey(A[begin]))
+                    end++;
+                std::reverse(A + begin, A + end);
+                begin = end;
+            }
+        }
+
+    }
+}
+
+#endif
@@ -1,164 +1,258 @@
 #include "AlgorithmsThread.h"
 
 #include <aRibeiroCore/Algorithms.h>
+#include <aRibeiroPlatform/PlatformPath.h>
+#include <aRibeiroPlatform/PlatformTime.h>
 
 #include <algorithm>
+#include <math.h>
+#include <stdio.h>
 
 namespace aRibeiro {
     namespace Sorting {
 
-        static DynamicSortJob CreateSortAndCopyInt32(
-            DynamicSortAlgorithm algorithm,
-            int32_t* _array_int32, uint32_t _size, int32_t* _tmp_array_int32,
-            void* _Dst, const void* _Src, size_t _Size) {
-
-            DynamicSortJob result;
-
-            result.type = DynamicSortJob_SortAndCopy;
-            result.input_data_type = DynamicSortData_Int32;
-            result.algorithm = algorithm;
+        //
+        // Sort jobs of each element type
+        //
 
-            result.sort_copy.sort._array_int32 = _array_int32;
-            result.sort_copy.sort._size = _size;
-            result.sort_copy.sort._tmp_array_int32 = _tmp_array_int32;
+        //
+        // In-place MSD radix sort (American flag sort)
+        //
+        // 8 bits digits from the most significant one. The elements are moved
+        // to their buckets with swap cycles, so there is no auxiliary buffer.
+        // The small buckets are sorted with std::sort.
+        //
 
-            result.sort_copy.copy._Dst = _Dst;
-            result.sort_copy.copy._Src = _Src;
-            result.sort_copy.copy._Size = _Size;
+        static const size_t MSD_STD_SORT_SIZE = 64;
 
-            return result;
+        template <typename T>
+        static ARIBEIRO_INLINE uint32_t msd_digit(const T& element, int shift) {
+            return (uint32_t)(SortKeyTraits<T>::radixKey(element) >> shift) & 0xff;
         }
 
-        static DynamicSortJob CreateSortAndCopyUInt32(
-            DynamicSortAlgorithm algorithm,
-            uint32_t* _array_uint32, uint32_t _size, uint32_t* _tmp_array_uint32,
-            void* _Dst, const void* _Src, size_t _Size) {
-
-            DynamicSortJob result;
-
-            result.type = DynamicSortJob_SortAndCopy;
-            result.input_data_type = DynamicSortData_UInt32;
-            result.algorithm = algorithm;
-
-            result.sort_copy.sort._array_uint32 = _array_uint32;
-            result.sort_copy.sort._size = _size;
-            result.sort_copy.sort._tmp_array_uint32 = _tmp_array_uint32;
-
-            result.sort_copy.copy._Dst = _Dst;
-            result.sort_copy.copy._Src = _Src;
-            result.sort_copy.copy._Size = _Size;
-
-            return result;
+        // shift of the most significant digit
+        template <typename T>
+        static ARIBEIRO_INLINE int msd_top_shift() {
+            return (int)sizeof(typename SortKeyTraits<T>::radix_type) * 8 - 8;
         }
 
-        static DynamicSortJob CreateOnlySortInt32(
-            DynamicSortAlgorithm algorithm,
-            int32_t* _array_int32, uint32_t _size, int32_t* _tmp_array_int32) {
-
-            DynamicSortJob result;
-
-            result.type = DynamicSortJob_OnlySort;
-            result.input_data_type = DynamicSortData_Int32;
-            result.algorithm = algorithm;
+        template <typename T>
+        static void msd_inplace_sort(T* A, size_t size, int shift) {
+            if (size <= MSD_STD_SORT_SIZE) {
+                std::sort(A, A + size, SortKeyLess<T>());
+                return;
+            }
 
-            result.sort_copy.sort._array_int32 = _array_int32;
-            result.sort_copy.sort._size = _size;
-            result.sort_copy.sort._tmp_array_int32 = _tmp_array_int32;
+            size_t head[256];
+            size_t tail[256];
+            memset(tail, 0, sizeof(size_t) * 256);
 
-            return result;
-        }
+            for (size_t i = 0; i < size; i++)
+                tail[msd_digit(A[i], shift)]++;
 
-        static DynamicSortJob CreateOnlySortUInt32(
-            DynamicSortAlgorithm algorithm,
-            uint32_t* _array_uint32, uint32_t _size, uint32_t* _tmp_array_uint32) {
+            // all elements have the same digit
+            if (tail[msd_digit(A[0], shift)] == size) {
+                if (shift > 0)
+                    msd_inplace_sort(A, size, shift - 8);
+                return;
+            }
 
-            DynamicSortJob result;
+            size_t acc = 0;
+            for (int i = 0; i < 256; i++) {
+                head[i] = acc;
+                acc += tail[i];
+                tail[i] = acc;
+            }
 
-            result.type = DynamicSortJob_OnlySort;
-            result.input_data_type = DynamicSortData_UInt32;
-            result.algorithm = algorithm;
+            for (uint32_t i = 0; i < 256; i++) {
+                while (head[i] < tail[i]) {
+                    T v = A[head[i]];
+                    uint32_t k = msd_digit(v, shift);
+                    while (k != i) {
+                        std::swap(v, A[head[k]++]);
+                        k = msd_digit(v, shift);
+                    }
+                    A[head[i]++] = v;
+                }
+            }
 
-            result.sort_copy.sort._array_uint32 = _array_uint32;
-            result.sort_copy.sort._size = _size;
-            result.sort_copy.sort._tmp_array_uint32 = _tmp_array_uint32;
+            if (shift == 0)
+                return;
 
-            return result;
+            size_t begin = 0;
+            for (int i = 0; i < 256; i++) {
+                size_t end = tail[i];
+                if (end - begin > 1)
+                    msd_inplace_sort(A + begin, end - begin, shift - 8);
+                begin = end;
+            }
         }
 
-
-        static DynamicSortJob CreateMergeInt32(int32_t* in, int32_t* out, int i, int element_count, int size) {
-
-            DynamicSortJob result;
-
-            result.type = DynamicSortJob_Merge;
-            result.input_data_type = DynamicSortData_Int32;
-
-            result.merge.in_int32 = in;
-            result.merge.out_int32 = out;
-            result.merge.i = i;
-            result.merge.element_count = element_count;
-            result.merge.size = size;
-
-            return result;
+        template <typename T>
+        static void msd_histogram(const T* A, size_t begin, size_t end, int shift, size_t* count) {
+            memset(count, 0, sizeof(size_t) * 256);
+            for (size_t i = begin; i < end; i++)
+                count[msd_digit(A[i], shift)]++;
         }
 
-        static DynamicSortJob CreateMergeUInt32(uint32_t* in, uint32_t* out, int i, int element_count, int size) {
-
-            DynamicSortJob result;
-
-            result.type = DynamicSortJob_Merge;
-            result.input_data_type = DynamicSortData_UInt32;
-
-            result.merge.in_uint32 = in;
-            result.merge.out_uint32 = out;
-            result.merge.i = i;
-            result.merge.element_count = element_count;
-            result.merge.size = size;
-
-            return result;
+        //
+        // Speculative permutation of one part (PARADIS):
+        //
+        // each thread owns one part of the range of each bucket, and moves the elements
+        // only inside its parts. When the part of the destination bucket is full,
+        // the element stays in the current position.
+        //
+        // At the end, the part of the bucket i is:
+        //   [part begin, head[i]) elements of the bucket i
+        //   [head[i], tail[i])    elements of other buckets (to repair)
+        //
+        template <typename T>
+        static void msd_permute(T* A, int shift, size_t* head, const size_t* tail) {
+            for (uint32_t i = 0; i < 256; i++) {
+                size_t h = head[i];
+                while (h < tail[i]) {
+                    T v = A[h];
+                    uint32_t k = msd_digit(v, shift);
+                    while (k != i && head[k] < tail[k]) {
+                        std::swap(v, A[head[k]++]);
+                        k = msd_digit(v, shift);
+                    }
+                    if (k == i) {
+                        A[h++] = A[head[i]];
+                        A[head[i]++] = v;
+                    }
+                    else
+                        A[h++] = v;
+                }
+            }
         }
 
-
         //
-        // Index data Types
+        // Repair of the bucket range [begin, end) after the speculative permutation:
         //
+        // moves the elements of the bucket to the beginning of the range,
+        // and the elements of other buckets to the end.
+        // Only the misplaced elements and the elements in the end are touched.
+        //
+        // Returns the begin of the range still to be filled.
+        //
+        template <typename T>
+        static size_t msd_repair(T* A, size_t begin, size_t end, int bucket, int parts, const size_t* head) {
+            size_t length = end - begin;
+
+            size_t misplaced = 0;
+            for (int p = 0; p < parts; p++)
+                misplaced += (begin + length * (p + 1) / parts) - head[p * 256 + bucket];
+
+            size_t boundary = end - misplaced;
+
+            // y: next element of the bucket after the boundary
+            int q = 0;
+            size_t y = 0;
+
+            for (int p = 0; p < parts; p++) {
+                size_t hole_end = begin + length * (p + 1) / parts;
+                if (hole_end > boundary)
+                    hole_end = boundary;
+                for (size_t x = head[p * 256 + bucket]; x < hole_end; x++) {
+                    for (;;) {
+                        size_t placed_begin = begin + length * q / parts;
+                        if (placed_begin < boundary)
+                            placed_begin = boundary;
+                        if (y < placed_begin)
+                            y = placed_begin;
+                        if (y < head[q * 256 + bucket])
+                            break;
+                        q++;
+                    }
+                    std::swap(A[x], A[y]);
+                    y++;
+                }
+            }
 
-        static DynamicSortJob CreateSortAndCopyIndexInt32(
-            DynamicSortAlgorithm algorithm,
-            IndexInt32* _array_IndexInt32, uint32_t _size, IndexInt32* _tmp_array_IndexInt32,
-            void* _Dst, const void* _Src, size_t _Size) {
-
-            DynamicSortJob result;
-
-            result.type = DynamicSortJob_SortAndCopy;
-            result.input_data_type = DynamicSortData_IndexInt32;
-            result.algorithm = algorithm;
+            return boundary;
+        }
 
-            result.sort_copy.sort._array_IndexInt32 = _array_IndexInt32;
-            result.sort_copy.sort._size = _size;
-            result.sort_copy.sort._tmp_array_IndexInt32 = _tmp_array_IndexInt32;
+        template <typename T>
+        static void sort_block(DynamicSortAlgorithm algorithm, T* A, size_t size, T* tmp) {
+            switch (algorithm) {
+            case DynamicSortAlgorithm_radix_counting:
+                radix_counting_sort_key(A, size, tmp);
+                break;
+            case DynamicSortAlgorithm_std:
+                std::sort(A, A + size, SortKeyLess<T>());
+                break;
+            case DynamicSortAlgorithm_radix_msd_inplace:
+                msd_inplace_sort(A, size, msd_top_shift<T>());
+                break;
+            default:
+                break;
+            }
+        }
 
-            result.sort_copy.copy._Dst = _Dst;
-            result.sort_copy.copy._Src = _Src;
-            result.sort_copy.copy._Size = _Size;
+        // merge of the output range [rank_begin, rank_end) of the sorted runs
+        template <typename T>
+        static void merge_job(const T* in, T* out, const size_t* run_begin, const size_t* run_end, int runs, size_t rank_begin, size_t rank_end) {
+            std::vector<size_t> begin(runs);
+            std::vector<size_t> end(runs);
+            multiway_merge_corank(in, run_begin, run_end, runs, rank_begin, &begin[0]);
+            multiway_merge_corank(in, run_begin, run_end, runs, rank_end, &end[0]);
+            multiway_merge(in, &begin[0], &end[0], runs, out + rank_begin);
+        }
 
-            return result;
+        template <typename T>
+        static void run_job(const DynamicSortJob& job) {
+            switch (job.type) {
+            case DynamicSortJob_SortAndCopy:
+                sort_block(job.algorithm, (T*)job.sort_copy.sort._array, job.sort_copy.sort._size, (T*)job.sort_copy.sort._tmp_array);
+                memcpy(job.sort_copy.copy._Dst, job.sort_copy.copy._Src, job.sort_copy.copy._Size);
+                break;
+            case DynamicSortJob_OnlySort:
+                sort_block(job.algorithm, (T*)job.sort_copy.sort._array, job.sort_copy.sort._size, (T*)job.sort_copy.sort._tmp_array);
+                break;
+            case DynamicSortJob_Merge:
+                merge_job((const T*)job.merge.in, (T*)job.merge.out, job.merge.run_begin, job.merge.run_end, job.merge.runs, job.merge.rank_begin, job.merge.rank_end);
+                break;
+            case DynamicSortJob_MSDHistogram:
+                msd_histogram((const T*)job.msd._array, job.msd.begin, job.msd.end, job.msd.shift, job.msd.head);
+                break;
+            case DynamicSortJob_MSDPermute:
+                msd_permute((T*)job.msd._array, job.msd.shift, job.msd.head, job.msd.tail);
+                break;
+            case DynamicSortJob_MSDRepair:
+                *job.msd.result = msd_repair((T*)job.msd._array, job.msd.begin, job.msd.end, job.msd.part, job.msd.parts, job.msd.head);
+                break;
+            case DynamicSortJob_MSDSort:
+                msd_inplace_sort((T*)job.msd._array + job.msd.begin, job.msd.end - job.msd.begin, job.msd.shift);
+                break;
+            case DynamicSortJob_SampleClassify:
+                sample_sort_classify(*(const SampleSortSplitters<T>*)job.sample.splitters, (const T*)job.sample.in,
+                    job.sample.begin, job.sample.end, job.sample.oracle, job.sample.count);
+                break;
+            case DynamicSortJob_SampleScatter:
+                sample_sort_scatter((const T*)job.sample.in, job.sample.begin, job.sample.end, job.sample.oracle,
+                    job.sample.count, (T*)job.sample.out);
+                break;
+            default:
+                break;
+            }
         }
 
-        static DynamicSortJob CreateSortAndCopyIndexUInt32(
+        template <typename T>
+        static DynamicSortJob CreateSortAndCopy(
             DynamicSortAlgorithm algorithm,
-            IndexUInt32* _array_IndexUInt32, uint32_t _size, IndexUInt32* _tmp_array_IndexUInt32,
+            T* _array, size_t _size, T* _tmp_array,
             void* _Dst, const void* _Src, size_t _Size) {
 
             DynamicSortJob result;
 
             result.type = DynamicSortJob_SortAndCopy;
-            result.input_data_type = DynamicSortData_IndexUInt32;
             result.algorithm = algorithm;
+            result.run = &run_job<T>;
 
-            result.sort_copy.sort._array_IndexUInt32 = _array_IndexUInt32;
+            result.sort_copy.sort._array = _array;
             result.sort_copy.sort._size = _size;
-            result.sort_copy.sort._tmp_array_IndexUInt32 = _tmp_array_IndexUInt32;
+            result.sort_copy.sort._tmp_array = _tmp_array;
 
             result.sort_copy.copy._Dst = _Dst;
             result.sort_copy.copy._Src = _Src;
@@ -167,257 +261,269 @@ namespace aRibeiro {
             return result;
         }
 
-        static DynamicSortJob CreateOnlySortIndexInt32(
+        template <typename T>
+        static DynamicSortJob CreateOnlySort(
             DynamicSortAlgorithm algorithm,
-            IndexInt32* _array_IndexInt32, uint32_t _size, IndexInt32* _tmp_array_IndexInt32) {
+            T* _array, size_t _size, T* _tmp_array) {
 
             DynamicSortJob result;
 
             result.type = DynamicSortJob_OnlySort;
-            result.input_data_type = DynamicSortData_IndexInt32;
             result.algorithm = algorithm;
+            result.run = &run_job<T>;
 
-            result.sort_copy.sort._array_IndexInt32 = _array_IndexInt32;
+            result.sort_copy.sort._array = _array;
             result.sort_copy.sort._size = _size;
-            result.sort_copy.sort._tmp_array_IndexInt32 = _tmp_array_IndexInt32;
+            result.sort_copy.sort._tmp_array = _tmp_array;
 
             return result;
         }
 
-        static DynamicSortJob CreateOnlySortIndexUInt32(
-            DynamicSortAlgorithm algorithm,
-            IndexUInt32* _array_IndexUInt32, uint32_t _size, IndexUInt32* _tmp_array_IndexUInt32) {
+        template <typename T>
+        static DynamicSortJob CreateMerge(const T* in, T* out, const size_t* run_begin, const size_t* run_end, int runs, size_t rank_begin, size_t rank_end) {
 
             DynamicSortJob result;
 
-            result.type = DynamicSortJob_OnlySort;
-            result.input_data_type = DynamicSortData_IndexUInt32;
-            result.algorithm = algorithm;
+            result.type = DynamicSortJob_Merge;
+            result.algorithm = DynamicSortAlgorithm_none;
+            result.run = &run_job<T>;
 
-            result.sort_copy.sort._array_IndexUInt32 = _array_IndexUInt32;
-            result.sort_copy.sort._size = _size;
-            result.sort_copy.sort._tmp_array_IndexUInt32 = _tmp_array_IndexUInt32;
+            result.merge.in = in;
+            result.merge.out = out;
+            result.merge.run_begin = run_begin;
+            result.merge.run_end = run_end;
+            result.merge.runs = runs;
+            result.merge.rank_begin = rank_begin;
+            result.merge.rank_end = rank_end;
 
             return result;
         }
 
-
-        static DynamicSortJob CreateMergeIndexInt32(IndexInt32* in, IndexInt32* out, int i, int element_count, int size) {
+        template <typename T>
+        static DynamicSortJob CreateMSD(DynamicSortJob_type type, T* _array, size_t begin, size_t end, int shift,
+            int part = 0, int parts = 0, size_t* head = NULL, size_t* tail = NULL, size_t* result_ptr = NULL) {
 
             DynamicSortJob result;
 
-            result.type = DynamicSortJob_Merge;
-            result.input_data_type = DynamicSortData_IndexInt32;
+            result.type = type;
+            result.algorithm = DynamicSortAlgorithm_radix_msd_inplace;
+            result.run = &run_job<T>;
 
-            result.merge.in_IndexInt32 = in;
-            result.merge.out_IndexInt32 = out;
-            result.merge.i = i;
-            result.merge.element_count = element_count;
-            result.merge.size = size;
+            result.msd._array = _array;
+            result.msd.begin = begin;
+            result.msd.end = end;
+            result.msd.shift = shift;
+            result.msd.part = part;
+            result.msd.parts = parts;
+            result.msd.head = head;
+            result.msd.tail = tail;
+            result.msd.result = result_ptr;
 
             return result;
         }
 
-        static DynamicSortJob CreateMergeIndexUInt32(IndexUInt32* in, IndexUInt32* out, int i, int element_count, int size) {
+        template <typename T>
+        static DynamicSortJob CreateSample(DynamicSortJob_type type, const T* in, T* out, size_t begin, size_t end,
+            const SampleSortSplitters<T>* splitters, uint8_t* oracle, size_t* count) {
 
             DynamicSortJob result;
 
-            result.type = DynamicSortJob_Merge;
-            result.input_data_type = DynamicSortData_IndexUInt32;
+            result.type = type;
+            result.algorithm = DynamicSortAlgorithm_none;
+            result.run = &run_job<T>;
 
-            result.merge.in_IndexUInt32 = in;
-            result.merge.out_IndexUInt32 = out;
-            result.merge.i = i;
-            result.merge.element_count = element_count;
-            result.merge.size = size;
+            result.sample.in = in;
+            result.sample.out = out;
+            result.sample.begin = begin;
+            result.sample.end = end;
+            result.sample.splitters = splitters;
+            result.sample.oracle = oracle;
+            result.sample.count = count;
 
             return result;
         }
 
+        //
+        // Key column jobs (argsort, sortByKey)
+        //
 
-        void DynamicSort::merge_job_int32(const int32_t* in, int32_t* out, int i, int element_count, int size) {
-
-            int write_index = i;
-            int write_max = i + (element_count << 1);
-            if (write_max > size)
-                write_max = size;
-
-            int a_index = i;
-            int b_index = i + element_count;
-
-            int a_max = b_index;
-            int b_max = b_index + element_count;
-
-            if (a_max > size)
-                a_max = size;
-            if (b_max > size)
-                b_max = size;
-
-            while (write_index < write_max &&
-                a_index < a_max &&
-                b_index < b_max) {
-
-                const int32_t& _a = in[a_index];
-                const int32_t& _b = in[b_index];
-
-                if (_a > _b) {
-                    out[write_index] = _b;
-                    b_index++;
+        template <typename K, typename P>
+        static void run_key_column_job(const DynamicSortJob& job) {
+            typedef decltype(((P*)NULL)->index) index_type;
+            switch (job.type) {
+            case DynamicSortJob_KeyFill: {
+                const K* keys = (const K*)job.column.in;
+                P* pairs = (P*)job.column.out;
+                for (size_t i = job.column.begin; i < job.column.end; i++) {
+                    pairs[i].toSort = keys[i];
+                    pairs[i].index = (index_type)i;
+                }
+                break;
+            }
+            case DynamicSortJob_KeyExtract: {
+                const P* pairs = (const P*)job.column.in;
+                K* keys = (K*)job.column.out;
+                if (keys != NULL) {
+                    for (size_t i = job.column.begin; i < job.column.end; i++)
+                        keys[i] = pairs[i].toSort;
+                }
+                if (job.column.indexBytes == 4) {
+                    uint32_t* permutation = (uint32_t*)job.column.permutation;
+                    for (size_t i = job.column.begin; i < job.column.end; i++)
+                        permutation[i] = (uint32_t)pairs[i].index;
                 }
                 else {
-                    out[write_index] = _a;
-                    a_index++;
+                    uint64_t* permutation = (uint64_t*)job.column.permutation;
+                    for (size_t i = job.column.begin; i < job.column.end; i++)
+                        permutation[i] = (uint64_t)pairs[i].index;
                 }
-
-                write_index++;
-            }
-
-            while (a_index < a_max) {
-                out[write_index++] = in[a_index++];
+                break;
             }
-            while (b_index < b_max) {
-                out[write_index++] = in[b_index++];
+            default:
+                break;
             }
-
         }
 
-        void DynamicSort::merge_job_uint32(const uint32_t* in, uint32_t* out, int i, int element_count, int size) {
-
-            int write_index = i;
-            int write_max = i + (element_count << 1);
-            if (write_max > size)
-                write_max = size;
-
-            int a_index = i;
-            int b_index = i + element_count;
-
-            int a_max = b_index;
-            int b_max = b_index + element_count;
-
-            if (a_max > size)
-                a_max = size;
-            if (b_max > size)
-                b_max = size;
-
-            while (write_index < write_max &&
-                a_index < a_max &&
-                b_index < b_max) {
+        struct ColumnElement16 {
+            uint64_t v[2];
+        };
 
-                const uint32_t& _a = in[a_index];
-                const uint32_t& _b = in[b_index];
+        template <typename E, typename I>
+        static void permute_column(const E* in, E* out, const I* permutation, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                out[i] = in[permutation[i]];
+        }
 
-                if (_a > _b) {
-                    out[write_index] = _b;
-                    b_index++;
-                }
-                else {
-                    out[write_index] = _a;
-                    a_index++;
-                }
+        template <typename I>
+        static void permute_column_bytes(const uint8_t* in, uint8_t* out, const I* permutation, size_t begin, size_t end, size_t elementSize) {
+            for (size_t i = begin; i < end; i++)
+                memcpy(out + i * elementSize, in + (size_t)permutation[i] * elementSize, elementSize);
+        }
 
-                write_index++;
+        template <typename I>
+        static void permute_column_job(const DynamicSortJob& job) {
+            const I* permutation = (const I*)job.column.permutation;
+            size_t begin = job.column.begin;
+            size_t end = job.column.end;
+            switch (job.column.elementSize) {
+            case 1:
+                permute_column((const uint8_t*)job.column.in, (uint8_t*)job.column.out, permutation, begin, end);
+                break;
+            case 2:
+                permute_column((const uint16_t*)job.column.in, (uint16_t*)job.column.out, permutation, begin, end);
+                break;
+            case 4:
+                permute_column((const uint32_t*)job.column.in, (uint32_t*)job.column.out, permutation, begin, end);
+                break;
+            case 8:
+                permute_column((const uint64_t*)job.column.in, (uint64_t*)job.column.out, permutation, begin, end);
+                break;
+            case 16:
+                permute_column((const ColumnElement16*)job.column.in, (ColumnElement16*)job.column.out, permutation, begin, end);
+                break;
+            default:
+                permute_column_bytes((const uint8_t*)job.column.in, (uint8_t*)job.column.out, permutation, begin, end, job.column.elementSize);
+                break;
             }
+        }
 
-            while (a_index < a_max) {
-                out[write_index++] = in[a_index++];
-            }
-            while (b_index < b_max) {
-                out[write_index++] = in[b_index++];
+        static void run_column_job(const DynamicSortJob& job) {
+            switch (job.type) {
+            case DynamicSortJob_ColumnPermute:
+                if (job.column.indexBytes == 4)
+                    permute_column_job<uint32_t>(job);
+                else
+                    permute_column_job<uint64_t>(job);
+                break;
+            case DynamicSortJob_ColumnCopy:
+                memcpy((uint8_t*)job.column.out + job.column.begin * job.column.elementSize,
+                    (const uint8_t*)job.column.in + job.column.begin * job.column.elementSize,
+                    (job.column.end - job.column.begin) * job.column.elementSize);
+                break;
+            default:
+                break;
             }
-
         }
 
+        static DynamicSortJob CreateColumn(DynamicSortJob_type type, void (*run)(const DynamicSortJob& job),
+            const void* in, void* out, void* permutation, size_t elementSize, int indexBytes) {
 
-        void DynamicSort::merge_job_IndexInt32(const IndexInt32* in, IndexInt32* out, int i, int element_count, int size) {
-
-            int write_index = i;
-            int write_max = i + (element_count << 1);
-            if (write_max > size)
-                write_max = size;
-
-            int a_index = i;
-            int b_index = i + element_count;
-
-            int a_max = b_index;
-            int b_max = b_index + element_count;
-
-            if (a_max > size)
-                a_max = size;
-            if (b_max > size)
-                b_max = size;
+            DynamicSortJob result;
 
-            while (write_index < write_max &&
-                a_index < a_max &&
-                b_index < b_max) {
+            result.type = type;
+            result.algorithm = DynamicSortAlgorithm_none;
+            result.run = run;
 
-                const IndexInt32& _a = in[a_index];
-                const IndexInt32& _b = in[b_index];
+            result.column.in = in;
+            result.column.out = out;
+            result.column.permutation = permutation;
+            result.column.begin = 0;
+            result.column.end = 0;
+            result.column.elementSize = elementSize;
+            result.column.indexBytes = indexBytes;
 
-                if (_a.toSort > _b.toSort) {
-                    out[write_index] = _b;
-                    b_index++;
-                }
-                else {
-                    out[write_index] = _a;
-                    a_index++;
-                }
+            return result;
+        }
 
-                write_index++;
-            }
+        //
+        // Radix select jobs (topK, partialSort, nthElement)
+        //
 
-            while (a_index < a_max) {
-                out[write_index++] = in[a_index++];
-            }
-            while (b_index < b_max) {
-                out[write_index++] = in[b_index++];
+        // buckets smaller than this are selected with std::nth_element in the calling thread
+        static const size_t SELECT_SEQUENTIAL_SIZE = 4096;
+        // topK up to this k uses a local heap for each part
+        static const size_t SELECT_HEAP_SIZE = 4096;
+
+        template <typename T>
+        static void run_select_job(const DynamicSortJob& job) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
+            const T* A = (const T*)job.select.in;
+            radix_type mask = (radix_type)job.select.mask;
+            radix_type key = (radix_type)job.select.key;
+            switch (job.type) {
+            case DynamicSortJob_SelectHistogram:
+                radix_select_histogram(A, job.select.begin, job.select.end, mask, job.select.shift, key, job.select.count);
+                break;
+            case DynamicSortJob_SelectCollect:
+                *job.select.count = radix_select_collect(A, job.select.begin, job.select.end, mask, job.select.shift, key, (radix_type*)job.select.out);
+                break;
+            case DynamicSortJob_SelectCount:
+                select_partition_count(A, job.select.begin, job.select.end, mask, key, &job.select.count[0], &job.select.count[1]);
+                break;
+            case DynamicSortJob_SelectScatter:
+                select_partition_scatter(A, job.select.begin, job.select.end, mask, key,
+                    job.select.position[0], job.select.position[1], job.select.position[2], job.select.position[3], (T*)job.select.out);
+                break;
+            case DynamicSortJob_SelectHeap:
+                *job.select.count = select_heap(A, job.select.begin, job.select.end, mask, job.select.position[0],
+                    (std::pair<radix_type, size_t>*)job.select.out);
+                break;
+            default:
+                break;
             }
-
         }
 
-        void DynamicSort::merge_job_IndexUInt32(const IndexUInt32* in, IndexUInt32* out, int i, int element_count, int size) {
-
-            int write_index = i;
-            int write_max = i + (element_count << 1);
-            if (write_max > size)
-                write_max = size;
-
-            int a_index = i;
-            int b_index = i + element_count;
-
-            int a_max = b_index;
-            int b_max = b_index + element_count;
+        template <typename T>
+        static DynamicSortJob CreateSelect(DynamicSortJob_type type, const T* in, void* out, size_t begin, size_t end,
+            int shift, uint64_t mask, uint64_t key, size_t* count) {
 
-            if (a_max > size)
-                a_max = size;
-            if (b_max > size)
-                b_max = size;
-
-            while (write_index < write_max &&
-                a_index < a_max &&
-                b_index < b_max) {
-
-                const IndexUInt32& _a = in[a_index];
-                const IndexUInt32& _b = in[b_index];
-
-                if (_a.toSort > _b.toSort) {
-                    out[write_index] = _b;
-                    b_index++;
-                }
-                else {
-                    out[write_index] = _a;
-                    a_index++;
-                }
+            DynamicSortJob result;
 
-                write_index++;
-            }
+            result.type = type;
+            result.algorithm = DynamicSortAlgorithm_none;
+            result.run = &run_select_job<T>;
 
-            while (a_index < a_max) {
-                out[write_index++] = in[a_index++];
-            }
-            while (b_index < b_max) {
-                out[write_index++] = in[b_index++];
-            }
+            result.select.in = in;
+            result.select.out = out;
+            result.select.begin = begin;
+            result.select.end = end;
+            result.select.shift = shift;
+            result.select.mask = mask;
+            result.select.key = key;
+            result.select.count = count;
+            memset(result.select.position, 0, sizeof(result.select.position));
 
+            return result;
         }
 
         void DynamicSort::task_run() {
@@ -425,925 +531,762 @@ namespace aRibeiro {
             DynamicSortJob job = queue.dequeue(&isSignaled);
             if (isSignaled)
                 return;
+            job.run(job);
+        }
 
-            switch (job.input_data_type) {
-            case DynamicSortData_Int32:
-                //
-                // Int32
-                //
-                switch (job.type) {
-                case DynamicSortJob_SortAndCopy:
-                    switch (job.algorithm) {
-                    case DynamicSortAlgorithm_radix_counting:
-                        radix_counting_sort_signed(job.sort_copy.sort._array_int32, job.sort_copy.sort._size, job.sort_copy.sort._tmp_array_int32);
-                        break;
-                    case DynamicSortAlgorithm_std:
-                        std::sort(job.sort_copy.sort._array_int32, job.sort_copy.sort._array_int32 + job.sort_copy.sort._size);
-                        break;
-                    default:
-                        break;
-                    }
-                    memcpy(job.sort_copy.copy._Dst, job.sort_copy.copy._Src, job.sort_copy.copy._Size);
-                    break;
-                case DynamicSortJob_OnlySort:
-                    switch (job.algorithm) {
-                    case DynamicSortAlgorithm_radix_counting:
-                        radix_counting_sort_signed(job.sort_copy.sort._array_int32, job.sort_copy.sort._size, job.sort_copy.sort._tmp_array_int32);
-                        break;
-                    case DynamicSortAlgorithm_std:
-                        std::sort(job.sort_copy.sort._array_int32, job.sort_copy.sort._array_int32 + job.sort_copy.sort._size);
-                        break;
-                    default:
-                        break;
-                    }
-                    break;
-                case DynamicSortJob_Merge:
-                    merge_job_int32(job.merge.in_int32, job.merge.out_int32, job.merge.i, job.merge.element_count, job.merge.size);
-                    break;
-                default:
-                    break;
-                }
-                break;
-            case DynamicSortData_UInt32:
-                //
-                // UInt32
-                //
-                switch (job.type) {
-                case DynamicSortJob_SortAndCopy:
-                    switch (job.algorithm) {
-                    case DynamicSortAlgorithm_radix_counting:
-                        radix_counting_sort_unsigned(job.sort_copy.sort._array_uint32, job.sort_copy.sort._size, job.sort_copy.sort._tmp_array_uint32);
-                        break;
-                    case DynamicSortAlgorithm_std:
-                        std::sort(job.sort_copy.sort._array_uint32, job.sort_copy.sort._array_uint32 + job.sort_copy.sort._size);
-                        break;
-                    default:
-                        break;
-                    }
-                    memcpy(job.sort_copy.copy._Dst, job.sort_copy.copy._Src, job.sort_copy.copy._Size);
-                    break;
-                case DynamicSortJob_OnlySort:
-                    switch (job.algorithm) {
-                    case DynamicSortAlgorithm_radix_counting:
-                        radix_counting_sort_unsigned(job.sort_copy.sort._array_uint32, job.sort_copy.sort._size, job.sort_copy.sort._tmp_array_uint32);
-                        break;
-                    case DynamicSortAlgorithm_std:
-                        std::sort(job.sort_copy.sort._array_uint32, job.sort_copy.sort._array_uint32 + job.sort_copy.sort._size);
-                        break;
-                    default:
-                        break;
-                    }
-                    break;
-                case DynamicSortJob_Merge:
-                    merge_job_uint32(job.merge.in_uint32, job.merge.out_uint32, job.merge.i, job.merge.element_count, job.merge.size);
-                    break;
-                default:
-                    break;
+        void DynamicSort::enqueueJob(const DynamicSortJob& job) {
+            if (!queue.tryEnqueue(job)) {
+                // full queue: start processing the jobs already enqueued
+                postQueueTasks();
+                while (!queue.tryEnqueue(job)) {
+                    if (!threadPool->runPendingTask())
+                        PlatformSleep::yield();
                 }
-                break;
-            case DynamicSortData_IndexInt32:
-                //
-                // IndexInt32
-                //
-                switch (job.type) {
-                case DynamicSortJob_SortAndCopy:
-                    switch (job.algorithm) {
-                    case DynamicSortAlgorithm_radix_counting:
-                        radix_counting_sort_signed_index(job.sort_copy.sort._array_IndexInt32, job.sort_copy.sort._size, job.sort_copy.sort._tmp_array_IndexInt32);
-                        break;
-                    case DynamicSortAlgorithm_std:
-                        std::sort(
-                            job.sort_copy.sort._array_IndexInt32, 
-                            job.sort_copy.sort._array_IndexInt32 + job.sort_copy.sort._size,
-                            IndexInt32::comparator
-                        );
-                        //ARIBEIRO_ABORT(true, "comparator not implemented\n");
-                        break;
-                    default:
-                        break;
-                    }
-                    memcpy(job.sort_copy.copy._Dst, job.sort_copy.copy._Src, job.sort_copy.copy._Size);
-                    break;
-                case DynamicSortJob_OnlySort:
-                    switch (job.algorithm) {
-                    case DynamicSortAlgorithm_radix_counting:
-                        radix_counting_sort_signed_index(job.sort_copy.sort._array_IndexInt32, job.sort_copy.sort._size, job.sort_copy.sort._tmp_array_IndexInt32);
-                        break;
-                    case DynamicSortAlgorithm_std:
-                        std::sort(
-                            job.sort_copy.sort._array_IndexInt32, 
-                            job.sort_copy.sort._array_IndexInt32 + job.sort_copy.sort._size,
-                            IndexInt32::comparator
-                        );
-                        //ARIBEIRO_ABORT(true, "comparator not implemented\n");
-                        break;
-                    default:
-                        break;
-                    }
-                    break;
-                case DynamicSortJob_Merge:
-                    merge_job_int32(job.merge.in_int32, job.merge.out_int32, job.merge.i, job.merge.element_count, job.merge.size);
-                    break;
-                default:
-                    break;
-                }
-                break;
-            case DynamicSortData_IndexUInt32:
-                //
-                // IndexUInt32
-                //
-                switch (job.type) {
-                case DynamicSortJob_SortAndCopy:
-                    switch (job.algorithm) {
-                    case DynamicSortAlgorithm_radix_counting:
-                        radix_counting_sort_unsigned_index(job.sort_copy.sort._array_IndexUInt32, job.sort_copy.sort._size, job.sort_copy.sort._tmp_array_IndexUInt32);
-                        break;
-                    case DynamicSortAlgorithm_std:
-                        std::sort(
-                            job.sort_copy.sort._array_IndexUInt32, 
-                            job.sort_copy.sort._array_IndexUInt32 + job.sort_copy.sort._size,
-                            IndexUInt32::comparator
-                        );
-                        //ARIBEIRO_ABORT(true, "comparator not implemented\n");
-                        break;
-                    default:
-                        break;
-                    }
-                    memcpy(job.sort_copy.copy._Dst, job.sort_copy.copy._Src, job.sort_copy.copy._Size);
-                    break;
-                case DynamicSortJob_OnlySort:
-                    switch (job.algorithm) {
-                    case DynamicSortAlgorithm_radix_counting:
-                        radix_counting_sort_unsigned_index(job.sort_copy.sort._array_IndexUInt32, job.sort_copy.sort._size, job.sort_copy.sort._tmp_array_IndexUInt32);
-                        break;
-                    case DynamicSortAlgorithm_std:
-                        std::sort(
-                            job.sort_copy.sort._array_IndexUInt32, 
-                            job.sort_copy.sort._array_IndexUInt32 + job.sort_copy.sort._size,
-                            IndexUInt32::comparator
-                        );
-                        //ARIBEIRO_ABORT(true, "comparator not implemented\n");
-                        break;
-                    default:
-                        break;
-                    }
-                    break;
-                case DynamicSortJob_Merge:
-                    merge_job_uint32(job.merge.in_uint32, job.merge.out_uint32, job.merge.i, job.merge.element_count, job.merge.size);
-                    break;
-                default:
-                        break;
-                }
-                break;
-            default:
-                break;
             }
-
-            semaphore.release();
+            queued_jobs++;
         }
 
-        void DynamicSort::bucket_int32_t(int32_t* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            const int64_t bucket_count = 128;
-            std::vector< int32_t >* bucket_list = new std::vector< int32_t >[bucket_count];
+        void DynamicSort::postQueueTasks() {
+            uint32_t count = queued_jobs;
+            queued_jobs = 0;
+            if (count == 0)
+                return;
+            // one task for each job in the queue, published as one batch
+            std::vector<TaskMethod_Fnc> tasks(count, TaskMethod_Fnc(this, &DynamicSort::task_run));
+            threadPool->postTasks(&tasks[0], count, &taskGroup);
+        }
 
-            int64_t min = INT32_MIN;
-            int64_t max = INT32_MAX;
-            int64_t delta = max - min + 1;
+        template <typename T>
+        void DynamicSort::bucket(T* A, size_t size, DynamicSortAlgorithm algorithm) {
+            const size_t bucket_count = 128;
+            std::vector< T >* bucket_list = new std::vector< T >[bucket_count];
 
-            for (uint32_t i = 0; i < size; i++) {
-                int32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                //uint32_t index = ((element64 - min) * bucket_count) / delta;
-                uint32_t index = ((element64 - min) * bucket_count) >> 32;
-                bucket_list[index].push_back(element32);
+            for (size_t i = 0; i < size; i++) {
+                const T& element = A[i];
+                bucket_list[radix_key_bucket(element)].push_back(element);
             }
 
-            int a_offset[bucket_count];
-            int offset = 0;
-            for (int i = 0; i < bucket_count; i++) {
+            size_t a_offset[bucket_count];
+            size_t offset = 0;
+            for (size_t i = 0; i < bucket_count; i++) {
                 a_offset[i] = offset;
-                offset += (int)bucket_list[i].size();
+                offset += bucket_list[i].size();
             }
 
-            for (int i = 0; i < bucket_count; i++) {
-                std::vector< int32_t >& _bucket = bucket_list[i];
-                if (_bucket.size() == 0) {
-                    semaphore.release();
+            T* aux = (T*)auxBuffer;
+
+            for (size_t i = 0; i < bucket_count; i++) {
+                std::vector< T >& _bucket = bucket_list[i];
+                if (_bucket.size() == 0)
                     continue;
-                }
-                DynamicSortJob job = CreateSortAndCopyInt32(
+                DynamicSortJob job = CreateSortAndCopy<T>(
                     //algorithm
                     algorithm,
                     //sort
-                    &_bucket[0], (uint32_t)_bucket.size(), ((int32_t*)auxBuffer.data) + a_offset[i],
+                    &_bucket[0], _bucket.size(), aux + a_offset[i],
                     //copy
-                    A + a_offset[i], &_bucket[0], sizeof(int32_t) * _bucket.size() );
+                    A + a_offset[i], &_bucket[0], sizeof(T) * _bucket.size() );
 
-                queue.enqueue(job);
+                enqueueJob(job);
             }
 
             // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
+            postQueueTasks();
 
-            for (int i = 0; i < bucket_count; i++)
-                semaphore.blockingAcquire();
+            threadPool->waitAll(&taskGroup);
 
             delete[]bucket_list;
 
         }
 
+        template <typename T>
+        void DynamicSort::counting(T* A, size_t size, DynamicSortAlgorithm algorithm) {
+            const size_t bucket_count = 128;
+            size_t counting[bucket_count];
+            size_t offset[bucket_count];
+            memset(counting, 0, sizeof(size_t) * bucket_count);
 
-        void DynamicSort::counting_int32_t(int32_t* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            const int64_t bucket_count = 128;
-            //std::vector< T > bucket_list[bucket_count];
-            counter_type counting[bucket_count];
-            counter_type offset[bucket_count];
-            memset(counting, 0, sizeof(counter_type) * bucket_count);
-
-            int64_t min = INT32_MIN;
-            int64_t max = INT32_MAX;
-            int64_t delta = max - min + 1;
-
-            int32_t* aux = ((int32_t*)auxBuffer.data);
+            T* aux = (T*)auxBuffer;
 
             //count
-            for (int i = 0; i < size; i++) {
-                int32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                //uint32_t index = ((element64 - min) * bucket_count) / delta;
-                uint32_t index = ((element64 - min) * bucket_count) >> 32;
-                counting[index]++;
-            }
+            for (size_t i = 0; i < size; i++)
+                counting[radix_key_bucket(A[i])]++;
 
             //compute offset
-            counter_type acc = counting[0];
+            size_t acc = counting[0];
             counting[0] = 0;
-            for (uint32_t j = 1; j < bucket_count; j++) {
-                counter_type tmp = counting[j];
+            for (size_t j = 1; j < bucket_count; j++) {
+                size_t tmp = counting[j];
                 counting[j] = acc;
                 acc += tmp;
             }
 
-            memcpy(offset, counting, sizeof(counter_type) * bucket_count);
+            memcpy(offset, counting, sizeof(size_t) * bucket_count);
 
             // place elements in the output array
-            for (uint32_t i = 0; i < size; i++) {
-                int32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                //uint32_t index = ((element64 - min) * bucket_count) / delta;
-                uint32_t index = ((element64 - min) * bucket_count) >> 32;
-                counter_type out_index = counting[index];
-                counting[index]++;
-                aux[out_index] = element32;
+            for (size_t i = 0; i < size; i++) {
+                const T& element = A[i];
+                aux[counting[radix_key_bucket(element)]++] = element;
             }
 
-            for (int i = 0; i < bucket_count; i++) {
-                int32_t element_count = counting[i] - offset[i];
-                if (element_count == 0) {
-                    semaphore.release();
+            for (size_t i = 0; i < bucket_count; i++) {
+                size_t element_count = counting[i] - offset[i];
+                if (element_count == 0)
                     continue;
-                }
 
-                DynamicSortJob job = CreateSortAndCopyInt32(
+                DynamicSortJob job = CreateSortAndCopy<T>(
                     //algorithm
                     algorithm,
                     //sort
                     aux + offset[i], element_count, A + offset[i],
                     //copy
-                    A + offset[i], aux + offset[i], element_count * sizeof(int32_t));
+                    A + offset[i], aux + offset[i], element_count * sizeof(T));
 
-                queue.enqueue(job);
+                enqueueJob(job);
             }
 
             // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
+            postQueueTasks();
 
-            for (int i = 0; i < bucket_count; i++)
-                semaphore.blockingAcquire();
+            threadPool->waitAll(&taskGroup);
 
         }
 
-
-        void DynamicSort::merge_int32_t(int32_t* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            int32_t* _aux = ((int32_t*)auxBuffer.data);
-
-            int job_thread_size = size / PlatformThread::QueryNumberOfSystemThreads();// 1 << 16
-
+        //
+        // Merge gather:
+        //
+        //  1) one block per thread is sorted and copied to the auxiliary buffer
+        //  2) the output is split in one range per thread, and each job computes the
+        //     co-rank of its range in all blocks and merges them (loser tree) to the array
+        //
+        // All threads work in the merge, and the data is merged in one pass.
+        //
+        template <typename T>
+        void DynamicSort::merge(T* A, size_t size, DynamicSortAlgorithm algorithm) {
+            T* _aux = (T*)auxBuffer;
+
+            int thread_count = threadPool->getThreadCount();
+            if (thread_count < 1)
+                thread_count = 1;
+
+            size_t job_thread_size = size / thread_count;// 1 << 16
+
             if (job_thread_size == 0)
                 job_thread_size = 1;
 
+            int runs = (int)((size + job_thread_size - 1) / job_thread_size);
+            size_t* run_begin = (size_t*)auxArena.allocate(sizeof(size_t) * runs, 64);
+            size_t* run_end = (size_t*)auxArena.allocate(sizeof(size_t) * runs, 64);
+
             // sort blocks
-            for (int i = 0; i < size; i += job_thread_size) {
-                int index_start = i;
-                int index_end_exclusive = i + job_thread_size;
+            for (int r = 0; r < runs; r++) {
+                size_t index_start = (size_t)r * job_thread_size;
+                size_t index_end_exclusive = index_start + job_thread_size;
                 if (index_end_exclusive > size)
                     index_end_exclusive = size;
 
-                DynamicSortJob job = CreateOnlySortInt32(
-                    algorithm,
-                    A + index_start, index_end_exclusive - index_start, _aux + index_start);
-                
-                queue.enqueue(job);
-            }
-
-            // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
-
-            for (int i = 0; i < size; i += job_thread_size)
-                semaphore.blockingAcquire();
-
-
-
-            // merge down the blocks
-            int32_t* in = A;
-            int32_t* out = _aux;
-
-            int element_count = job_thread_size;
-
-            while (element_count < size) {
-
-                //merge operation
-                for (int i = 0; i < size; i += (element_count << 1)) {
-                    DynamicSortJob job = CreateMergeInt32(in, out, i, element_count, size);
-                    queue.enqueue(job);
-                }
-                // post task for processing the created queue
-                for (int i = (int)queue.size() - 1; i >= 0; i--)
-                    threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
-                for (int i = 0; i < size; i += (element_count << 1))
-                    semaphore.blockingAcquire();
-
-                //swap in/out
-                int32_t* aux = in;
-                in = out;
-                out = aux;
-
-                element_count = element_count << 1;
-            }
-
-            if (in != A)
-                memcpy(A, in, sizeof(int32_t) * size);
-        }
-
-        void DynamicSort::bucket_uint32_t(uint32_t* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            const int64_t bucket_count = 128;
-            std::vector< uint32_t >* bucket_list = new std::vector< uint32_t >[bucket_count];
+                run_begin[r] = index_start;
+                run_end[r] = index_end_exclusive;
 
-            int64_t min = 0;
-            int64_t max = UINT32_MAX;
-            int64_t delta = max - min + 1;
-
-            for (uint32_t i = 0; i < size; i++) {
-                uint32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32;
-                //uint32_t index = ((element64 - min) * bucket_count) / delta;
-                uint32_t index = ((element64 - min) * bucket_count) >> 32;
-                bucket_list[index].push_back(element32);
-            }
-
-            int a_offset[bucket_count];
-            int offset = 0;
-            for (int i = 0; i < bucket_count; i++) {
-                a_offset[i] = offset;
-                offset += (int)bucket_list[i].size();
-            }
-
-            for (int i = 0; i < bucket_count; i++) {
-                std::vector< uint32_t >& _bucket = bucket_list[i];
-
-                if (_bucket.size() == 0) {
-                    semaphore.release();
-                    continue;
-                }
-
-                DynamicSortJob job = CreateSortAndCopyUInt32(
+                size_t count = index_end_exclusive - index_start;
+                DynamicSortJob job = CreateSortAndCopy<T>(
                     //algorithm
                     algorithm,
                     //sort
-                    &_bucket[0], (uint32_t)_bucket.size(), ((uint32_t*)auxBuffer.data) + a_offset[i],
+                    A + index_start, count, _aux + index_start,
                     //copy
-                    A + a_offset[i], &_bucket[0], sizeof(uint32_t) * _bucket.size());
+                    _aux + index_start, A + index_start, count * sizeof(T));
 
-                queue.enqueue(job);
+                enqueueJob(job);
             }
             // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
-            
-            for (int i = 0; i < bucket_count; i++)
-                semaphore.blockingAcquire();
-
-            delete[]bucket_list;
-        }
-        void DynamicSort::counting_uint32_t(uint32_t* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            const int64_t bucket_count = 128;
-            //std::vector< T > bucket_list[bucket_count];
-            counter_type counting[bucket_count];
-            counter_type offset[bucket_count];
-            memset(counting, 0, sizeof(counter_type) * bucket_count);
-
-            int64_t min = 0;
-            int64_t max = UINT32_MAX;
-            int64_t delta = max - min + 1;
-
-            uint32_t* aux = ((uint32_t*)auxBuffer.data);
-
-            //count
-            for (int i = 0; i < size; i++) {
-                uint32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32 - min;
-                //uint32_t index = (element64 * bucket_count) / delta;
-                uint32_t index = (element64 * bucket_count) >> 32;
-                counting[index]++;
-                //printf("index %u\n", index);
-            }
-
-            //compute offset
-            counter_type acc = counting[0];
-            counting[0] = 0;
-            for (uint32_t j = 1; j < bucket_count; j++) {
-                counter_type tmp = counting[j];
-                counting[j] = acc;
-                acc += tmp;
-            }
+            postQueueTasks();
 
-            memcpy(offset, counting, sizeof(counter_type) * bucket_count);
+            threadPool->waitAll(&taskGroup);
 
-            // place elements in the output array
-            for (uint32_t i = 0; i < size; i++) {
-                uint32_t element32 = A[i];
-                int64_t element64 = (int64_t)element32 - min;
-                //uint32_t index = (element64 * bucket_count) / delta;
-                uint32_t index = (element64 * bucket_count) >> 32;
-                counter_type out_index = counting[index];
-                counting[index]++;
-                aux[out_index] = element32;
-            }
-
-            for (int i = 0; i < bucket_count; i++) {
-                int32_t element_count = counting[i] - offset[i];
+            if (runs == 1)
+                return;
 
-                if (element_count == 0) {
-                    semaphore.release();
+            // merge the blocks: one output range per thread
+            for (int p = 0; p < thread_count; p++) {
+                size_t rank_begin = size * p / thread_count;
+                size_t rank_end = size * (p + 1) / thread_count;
+                if (rank_begin == rank_end)
                     continue;
-                }
-
-                DynamicSortJob job = CreateSortAndCopyUInt32(
-                    //algorithm
-                    algorithm,
-                    //sort
-                    aux + offset[i], element_count, A + offset[i],
-                    //copy
-                    A + offset[i], aux + offset[i], element_count * sizeof(uint32_t));
-
-                queue.enqueue(job);
+                DynamicSortJob job = CreateMerge<T>(_aux, A, run_begin, run_end, runs, rank_begin, rank_end);
+                enqueueJob(job);
             }
             // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
-
-            for (int i = 0; i < bucket_count; i++)
-                semaphore.blockingAcquire();
-
+            postQueueTasks();
 
-        }
-        void DynamicSort::merge_uint32_t(uint32_t* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            uint32_t* _aux = ((uint32_t*)auxBuffer.data);
-
-            int job_thread_size = size / PlatformThread::QueryNumberOfSystemThreads();// 1 << 16
-            //job_thread_size /= 4;
-
-            if (job_thread_size == 0)
-                job_thread_size = 1;
-
-            // sort blocks
-            for (int i = 0; i < size; i += job_thread_size) {
-                int index_start = i;
-                int index_end_exclusive = i + job_thread_size;
-                if (index_end_exclusive > size)
-                    index_end_exclusive = size;
-
-                DynamicSortJob job = CreateOnlySortUInt32(
-                    algorithm,
-                    A + index_start, index_end_exclusive - index_start, _aux + index_start);
-
-                queue.enqueue(job);
-            }
-            // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
-
-            for (int i = 0; i < size; i += job_thread_size)
-                semaphore.blockingAcquire();
-
-            // merge down the blocks
-            uint32_t* in = A;
-            uint32_t* out = _aux;
-
-            int element_count = job_thread_size;
-
-            while (element_count < size) {
-
-                //merge operation
-                for (int i = 0; i < size; i += (element_count << 1)) {
-                    DynamicSortJob job = CreateMergeUInt32(in, out, i, element_count, size);
-                    queue.enqueue(job);
-                }
-                // post task for processing the created queue
-                for (int i = (int)queue.size() - 1; i >= 0; i--)
-                    threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
-
-                for (int i = 0; i < size; i += (element_count << 1))
-                    semaphore.blockingAcquire();
-
-                //swap in/out
-                uint32_t* aux = in;
-                in = out;
-                out = aux;
-
-                element_count = element_count << 1;
-            }
-
-            if (in != A)
-                memcpy(A, in, sizeof(uint32_t) * size);
+            threadPool->waitAll(&taskGroup);
         }
 
         //
-        // IndexInt32 and IndexUInt32 versions
+        // Sample gather:
         //
-
-        void DynamicSort::bucket_IndexInt32(IndexInt32* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            const int64_t bucket_count = 128;
-            std::vector< IndexInt32 >* bucket_list = new std::vector< IndexInt32 >[bucket_count];
-
-            int64_t min = INT32_MIN;
-            int64_t max = INT32_MAX;
-            int64_t delta = max - min + 1;
-
-            for (uint32_t i = 0; i < size; i++) {
-                const IndexInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort;
-                //uint32_t index = ((element64 - min) * bucket_count) / delta;
-                uint32_t index = ((element64 - min) * bucket_count) >> 32;
-                bucket_list[index].push_back(element32);
+        //  1) the splitters are chosen from a sample of the array (AlgorithmsSample.h)
+        //  2) classification: one job per part counts the buckets of its elements
+        //     and keeps the bucket of each element (1 byte per element)
+        //  3) scatter: one job per part copies its elements to the auxiliary buffer
+        //  4) one job per bucket sorts it and copies it back to the array
+        //     (the equality buckets are only copied)
+        //
+        // The bucket sizes do not depend on the key distribution.
+        //
+        template <typename T>
+        void DynamicSort::sample(T* A, size_t size, DynamicSortAlgorithm algorithm) {
+            const int bucket_count = SampleSortSplitters<T>::BUCKETS;
+            T* aux = (T*)auxBuffer;
+
+            int parts = threadPool->getThreadCount();
+            if (parts < 1)
+                parts = 1;
+
+            SampleSortSplitters<T>* splitters = (SampleSortSplitters<T>*)auxArena.allocate(sizeof(SampleSortSplitters<T>), 64);
+            splitters->build(A, size);
+
+            uint8_t* oracle = (uint8_t*)auxArena.allocate(size, 64);
+            size_t* count = (size_t*)auxArena.allocate(sizeof(size_t) * bucket_count * parts, 64);
+            memset(count, 0, sizeof(size_t) * bucket_count * parts);
+
+            // classify
+            for (int p = 0; p < parts; p++) {
+                size_t begin = size * p / parts;
+                size_t end = size * (p + 1) / parts;
+                enqueueJob(CreateSample<T>(DynamicSortJob_SampleClassify, A, aux, begin, end,
+                    splitters, oracle, count + p * bucket_count));
             }
-
-            int a_offset[bucket_count];
-            int offset = 0;
-            for (int i = 0; i < bucket_count; i++) {
-                a_offset[i] = offset;
-                offset += (int)bucket_list[i].size();
+            postQueueTasks();
+            threadPool->waitAll(&taskGroup);
+
+            // offsets: the parts are placed in order inside each bucket
+            size_t bucket_begin[bucket_count + 1];
+            size_t acc = 0;
+            for (int b = 0; b < bucket_count; b++) {
+                bucket_begin[b] = acc;
+                for (int p = 0; p < parts; p++) {
+                    size_t tmp = count[p * bucket_count + b];
+                    count[p * bucket_count + b] = acc;
+                    acc += tmp;
+                }
             }
-
-            for (int i = 0; i < bucket_count; i++) {
-                std::vector< IndexInt32 >& _bucket = bucket_list[i];
-                if (_bucket.size() == 0) {
-                    semaphore.release();
+            bucket_begin[bucket_count] = acc;
+
+            // scatter
+            for (int p = 0; p < parts; p++) {
+                size_t begin = size * p / parts;
+                size_t end = size * (p + 1) / parts;
+                enqueueJob(CreateSample<T>(DynamicSortJob_SampleScatter, A, aux, begin, end,
+                    splitters, oracle, count + p * bucket_count));
+            }
+            postQueueTasks();
+            threadPool->waitAll(&taskGroup);
+
+            // sort the buckets
+            for (int b = 0; b < bucket_count; b++) {
+                size_t offset = bucket_begin[b];
+                size_t element_count = bucket_begin[b + 1] - offset;
+                if (element_count == 0)
                     continue;
-                }
-                DynamicSortJob job = CreateSortAndCopyIndexInt32(
-                    //algorithm
-                    algorithm,
+
+                DynamicSortJob job = CreateSortAndCopy<T>(
+                    //algorithm (the equality buckets are already sorted)
+                    SampleSortSplitters<T>::isEqualityBucket(b) ? DynamicSortAlgorithm_none : algorithm,
                     //sort
-                    &_bucket[0], (uint32_t)_bucket.size(), ((IndexInt32*)auxBuffer.data) + a_offset[i],
+                    aux + offset, element_count, A + offset,
                     //copy
-                    A + a_offset[i], &_bucket[0], sizeof(IndexInt32) * _bucket.size());
+                    A + offset, aux + offset, element_count * sizeof(T));
 
-                queue.enqueue(job);
+                enqueueJob(job);
             }
-            // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
-
-            for (int i = 0; i < bucket_count; i++)
-                semaphore.blockingAcquire();
 
-            delete[]bucket_list;
+            // post task for processing the created queue
+            postQueueTasks();
 
+            threadPool->waitAll(&taskGroup);
         }
 
-
-        void DynamicSort::counting_IndexInt32(IndexInt32* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            const int64_t bucket_count = 128;
-            //std::vector< T > bucket_list[bucket_count];
-            counter_type counting[bucket_count];
-            counter_type offset[bucket_count];
-            memset(counting, 0, sizeof(counter_type) * bucket_count);
-
-            int64_t min = INT32_MIN;
-            int64_t max = INT32_MAX;
-            int64_t delta = max - min + 1;
-
-            IndexInt32* aux = ((IndexInt32*)auxBuffer.data);
-
-            //count
-            for (int i = 0; i < size; i++) {
-                const IndexInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort;
-                //uint32_t index = ((element64 - min) * bucket_count) / delta;
-                uint32_t index = ((element64 - min) * bucket_count) >> 32;
-                counting[index]++;
+        //
+        // Parallel in-place MSD radix sort:
+        //
+        //  1) histogram of the digit: one job per part of the array
+        //  2) speculative permutation: one job per part (each part owns a slice of every bucket)
+        //  3) repair: one job per bucket, the misplaced elements go to the end of the bucket range
+        //  4) 2 and 3 repeat over the ranges still to be filled; the last round runs
+        //     in one thread (one part always places all elements)
+        //  5) the buckets bigger than the parallelSize / threads are distributed again
+        //     in parallel, the others are sorted by one job each
+        //
+        // The extra memory is 2 * 256 counters per thread, allocated from the auxArena.
+        //
+        template <typename T>
+        void DynamicSort::msd(T* A, size_t size, int shift, size_t parallelSize) {
+            int parts = threadPool->getThreadCount();
+            if (parts < 1)
+                parts = 1;
+
+            size_t* part_head = (size_t*)auxArena.allocate(sizeof(size_t) * 256 * parts, 64);
+            size_t* part_tail = (size_t*)auxArena.allocate(sizeof(size_t) * 256 * parts, 64);
+            size_t* bucket_head = (size_t*)auxArena.allocate(sizeof(size_t) * 256, 64);
+            size_t* bucket_end = (size_t*)auxArena.allocate(sizeof(size_t) * 256, 64);
+
+            // histogram
+            for (int p = 0; p < parts; p++) {
+                enqueueJob(CreateMSD<T>(DynamicSortJob_MSDHistogram, A,
+                    size * p / parts, size * (p + 1) / parts, shift,
+                    p, parts, part_head + p * 256));
             }
-
-            //compute offset
-            counter_type acc = counting[0];
-            counting[0] = 0;
-            for (uint32_t j = 1; j < bucket_count; j++) {
-                counter_type tmp = counting[j];
-                counting[j] = acc;
-                acc += tmp;
+            postQueueTasks();
+            threadPool->waitAll(&taskGroup);
+
+            size_t acc = 0;
+            for (int i = 0; i < 256; i++) {
+                size_t count = 0;
+                for (int p = 0; p < parts; p++)
+                    count += part_head[p * 256 + i];
+                bucket_head[i] = acc;
+                acc += count;
+                bucket_end[i] = acc;
             }
 
-            memcpy(offset, counting, sizeof(counter_type) * bucket_count);
-
-            // place elements in the output array
-            for (uint32_t i = 0; i < size; i++) {
-                const IndexInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort;
-                //uint32_t index = ((element64 - min) * bucket_count) / delta;
-                uint32_t index = ((element64 - min) * bucket_count) >> 32;
-                counter_type out_index = counting[index];
-                counting[index]++;
-                aux[out_index] = element32;
+            // all elements have the same digit
+            uint32_t first = msd_digit(A[0], shift);
+            if (bucket_end[first] - bucket_head[first] == size) {
+                if (shift > 0)
+                    msd(A, size, shift - 8, parallelSize);
+                return;
             }
 
-            for (int i = 0; i < bucket_count; i++) {
-                int32_t element_count = counting[i] - offset[i];
-                if (element_count == 0) {
-                    semaphore.release();
-                    continue;
-                }
+            // permutation rounds
+            const int max_parallel_rounds = 8;
+            for (int round = 0; ; round++) {
+                size_t remaining = 0;
+                for (int i = 0; i < 256; i++)
+                    remaining += bucket_end[i] - bucket_head[i];
+                if (remaining == 0)
+                    break;
 
-                DynamicSortJob job = CreateSortAndCopyIndexInt32(
-                    //algorithm
-                    algorithm,
-                    //sort
-                    aux + offset[i], element_count, A + offset[i],
-                    //copy
-                    A + offset[i], aux + offset[i], element_count * sizeof(IndexInt32));
+                if (parts == 1 || round >= max_parallel_rounds || remaining < useMultithreadStartingAtCount) {
+                    // one part: all elements are placed
+                    memcpy(part_head, bucket_head, sizeof(size_t) * 256);
+                    msd_permute(A, shift, part_head, bucket_end);
+                    break;
+                }
 
-                queue.enqueue(job);
+                for (int p = 0; p < parts; p++) {
+                    size_t* head = part_head + p * 256;
+                    size_t* tail = part_tail + p * 256;
+                    for (int i = 0; i < 256; i++) {
+                        size_t length = bucket_end[i] - bucket_head[i];
+                        head[i] = bucket_head[i] + length * p / parts;
+                        tail[i] = bucket_head[i] + length * (p + 1) / parts;
+                    }
+                    enqueueJob(CreateMSD<T>(DynamicSortJob_MSDPermute, A, 0, size, shift,
+                        p, parts, head, tail));
+                }
+                postQueueTasks();
+                threadPool->waitAll(&taskGroup);
+
+                for (int i = 0; i < 256; i++) {
+                    if (bucket_end[i] == bucket_head[i])
+                        continue;
+                    enqueueJob(CreateMSD<T>(DynamicSortJob_MSDRepair, A, bucket_head[i], bucket_end[i], shift,
+                        i, parts, part_head, NULL, &bucket_head[i]));
+                }
+                postQueueTasks();
+                threadPool->waitAll(&taskGroup);
             }
-            // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
 
-            for (int i = 0; i < bucket_count; i++)
-                semaphore.blockingAcquire();
+            if (shift == 0)
+                return;
 
+            // sort the buckets
+            size_t big_bucket = parallelSize / parts;
+            if (big_bucket < useMultithreadStartingAtCount)
+                big_bucket = useMultithreadStartingAtCount;
+
+            size_t begin = 0;
+            for (int i = 0; i < 256; i++) {
+                size_t end = bucket_end[i];
+                size_t count = end - begin;
+                if (count >= big_bucket)
+                    msd(A + begin, count, shift - 8, parallelSize);
+                else if (count > 1)
+                    enqueueJob(CreateMSD<T>(DynamicSortJob_MSDSort, A, begin, end, shift - 8));
+                begin = end;
+            }
+            postQueueTasks();
+            threadPool->waitAll(&taskGroup);
         }
 
 
-        void DynamicSort::merge_IndexInt32(IndexInt32* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            IndexInt32* _aux = ((IndexInt32*)auxBuffer.data);
-
-            int job_thread_size = size / PlatformThread::QueryNumberOfSystemThreads();// 1 << 16
-
-            if (job_thread_size == 0)
-                job_thread_size = 1;
-
-            // sort blocks
-            for (int i = 0; i < size; i += job_thread_size) {
-                int index_start = i;
-                int index_end_exclusive = i + job_thread_size;
-                if (index_end_exclusive > size)
-                    index_end_exclusive = size;
-
-                DynamicSortJob job = CreateOnlySortIndexInt32(
-                    algorithm,
-                    A + index_start, index_end_exclusive - index_start, _aux + index_start);
+        //
+        // Calibration of the auto mode
+        //
 
-                queue.enqueue(job);
-            }
-            // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
+        static const size_t CALIBRATION_SIZES[DynamicSortCalibration::SIZES] = { 1 << 14, 1 << 17, 1 << 20 };
+        // presorted calibration input: sorted, then 1% of the elements swapped
+        static const size_t CALIBRATION_PRESORTED_SWAPS = 100;
+        // the counting gather is not used when a bucket of the most significant bits
+        // has more than this fraction of the sampled keys
+        static const float AUTO_MAX_BUCKET_SHARE = 1.0f / 8.0f;
+        // the input is treated as presorted when this fraction of the sampled pairs is in order
+        static const float AUTO_PRESORTED = 0.9f;
+        static const int AUTO_SAMPLES = 1024;
+
+        DynamicSortCalibration::DynamicSortCalibration() {
+            valid = false;
+            threadCount = 0;
+            memset(cost, 0, sizeof(cost));
+        }
 
-            for (int i = 0; i < size; i += job_thread_size)
-                semaphore.blockingAcquire();
+        //
+        // Built-in estimates (nanoseconds per element), used before the calibration:
+        //   std::sort: log2(size) * 3.5ns on random keys, 8ns on presorted keys
+        //   radix_counting: 2.5ns per radix pass of the 32 bits keys, 3ns of the 64 bits keys
+        //   gathers: the block sort is split by the parallel threads, plus the
+        //            gather pass (counting 3ns, merge 2ns per merge level, sample 5ns)
+        //            and about 30us to post and wait the jobs
+        //
+        void DynamicSortCalibration::setDefault(int parallelThreads) {
+            if (parallelThreads < 1)
+                parallelThreads = 1;
+            double merge_levels = log2((double)parallelThreads);
+            if (merge_levels < 1.0)
+                merge_levels = 1.0;
+
+            valid = false;
+            threadCount = parallelThreads;
+            for (int k = 0; k < KEYS; k++)
+                for (int c = 0; c < CLASSES; c++)
+                    for (int s = 0; s < SIZES; s++) {
+                        double size = (double)CALIBRATION_SIZES[s];
+                        for (int i = 0; i < CANDIDATES; i++) {
+                            double block;
+                            if (algorithmOf(i) == DynamicSortAlgorithm_radix_counting)
+                                block = (k == 0) ? 2.5 * 4.0 : 3.0 * 8.0;
+                            else
+                                block = (c == 1) ? 8.0 : log2(size) * 3.5;
+
+                            double estimate;
+                            switch (gatherOf(i)) {
+                            case DynamicSortGather_counting:
+                                estimate = block / (double)parallelThreads + 3.0;
+                                break;
+                            case DynamicSortGather_merge:
+                                estimate = block / (double)parallelThreads + 2.0 * merge_levels;
+                                break;
+                            case DynamicSortGather_sample:
+                                estimate = block / (double)parallelThreads + 5.0;
+                                break;
+                            default:
+                                estimate = block;
+                                break;
+                            }
+                            if (gatherOf(i) != DynamicSortGather_none)
+                                estimate += 30000.0 / size;
+                            cost[k][c][s][i] = (float)estimate;
+                        }
+                    }
+        }
 
+        bool DynamicSortCalibration::load(const std::string& filename) {
+            valid = false;
+            FILE* in = fopen(filename.c_str(), "rb");
+            if (in == NULL)
+                return false;
+            int version = 0;
+            bool ok = fscanf(in, "DynamicSortCalibration %i\n", &version) == 1 && version == 1;
+            ok = ok && fscanf(in, "threads %i\n", &threadCount) == 1;
+            for (int k = 0; ok && k < KEYS; k++)
+                for (int c = 0; ok && c < CLASSES; c++)
+                    for (int s = 0; ok && s < SIZES; s++)
+                        for (int i = 0; ok && i < CANDIDATES; i++)
+                            ok = fscanf(in, "%f", &cost[k][c][s][i]) == 1 && cost[k][c][s][i] > 0.0f;
+            fclose(in);
+            valid = ok;
+            return valid;
+        }
 
+        bool DynamicSortCalibration::save(const std::string& filename) const {
+            if (!valid)
+                return false;
+            FILE* out = fopen(filename.c_str(), "wb");
+            if (out == NULL)
+                return false;
+            fprintf(out, "DynamicSortCalibration %i\n", 1);
+            fprintf(out, "threads %i\n", threadCount);
+            // one line per key size, input class and array size: nanoseconds per element
+            for (int k = 0; k < KEYS; k++)
+                for (int c = 0; c < CLASSES; c++)
+                    for (int s = 0; s < SIZES; s++) {
+                        for (int i = 0; i < CANDIDATES; i++)
+                            fprintf(out, "%s%.3f", (i == 0) ? "" : " ", cost[k][c][s][i]);
+                        fprintf(out, "\n");
+                    }
+            fclose(out);
+            return true;
+        }
 
-            // merge down the blocks
-            IndexInt32* in = A;
-            IndexInt32* out = _aux;
+        size_t DynamicSortCalibration::sizeOf(int size_index) {
+            return CALIBRATION_SIZES[size_index];
+        }
 
-            int element_count = job_thread_size;
+        DynamicSortGather DynamicSortCalibration::gatherOf(int candidate) {
+            ARIBEIRO_ABORT(candidate < 0 || candidate >= CANDIDATES, "DynamicSortCalibration: invalid candidate %i.\n", candidate);
+            const DynamicSortGather gathers[4] = {
+                DynamicSortGather_none,
+                DynamicSortGather_counting,
+                DynamicSortGather_merge,
+                DynamicSortGather_sample
+            };
+            return gathers[candidate >> 1];
+        }
 
-            while (element_count < size) {
+        DynamicSortAlgorithm DynamicSortCalibration::algorithmOf(int candidate) {
+            ARIBEIRO_ABORT(candidate < 0 || candidate >= CANDIDATES, "DynamicSortCalibration: invalid candidate %i.\n", candidate);
+            return (candidate & 1) ? DynamicSortAlgorithm_radix_counting : DynamicSortAlgorithm_std;
+        }
 
-                //merge operation
-                for (int i = 0; i < size; i += (element_count << 1)) {
-                    DynamicSortJob job = CreateMergeIndexInt32(in, out, i, element_count, size);
-                    queue.enqueue(job);
+        //
+        // Sample of the input used by the auto mode:
+        //
+        //   active_passes: radix digits that change inside the sampled key range
+        //                  (the radix sort skips the digits with one value)
+        //   in_order: fraction of the sampled neighbor pairs already in order
+        //   bucket_share: biggest fraction of the samples in one bucket of the
+        //                 counting gather (7 most significant bits)
+        //
+        template <typename T>
+        static void sample_input(const T* A, size_t size, int* active_passes, float* in_order, float* bucket_share) {
+            typedef SortKeyTraits<T> Traits;
+            typedef typename Traits::radix_type radix_type;
+
+            int samples = AUTO_SAMPLES;
+            if ((size_t)samples > size - 1)
+                samples = (int)(size - 1);
+
+            radix_type key_min = ~(radix_type)0;
+            radix_type key_max = 0;
+            int ordered = 0;
+            int buckets[128];
+            memset(buckets, 0, sizeof(buckets));
+
+            uint64_t seed = UINT64_C(0x2545F4914F6CDD1D) ^ (uint64_t)size;
+            for (int i = 0; i < samples; i++) {
+                size_t index;
+                if (samples == (int)(size - 1))
+                    index = (size_t)i;
+                else {
+                    seed = seed * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+                    index = (size_t)((seed >> 1) % (uint64_t)(size - 1));
                 }
-                // post task for processing the created queue
-                for (int i = (int)queue.size() - 1; i >= 0; i--)
-                    threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
-                for (int i = 0; i < size; i += (element_count << 1))
-                    semaphore.blockingAcquire();
-
-                //swap in/out
-                IndexInt32* aux = in;
-                in = out;
-                out = aux;
-
-                element_count = element_count << 1;
+                radix_type a = Traits::radixKey(A[index]);
+                radix_type b = Traits::radixKey(A[index + 1]);
+                ordered += (int)(a <= b);
+                if (a < key_min)
+                    key_min = a;
+                if (a > key_max)
+                    key_max = a;
+                buckets[radix_key_bucket(A[index])]++;
             }
 
-            if (in != A)
-                memcpy(A, in, sizeof(IndexInt32) * size);
+            radix_type diff = key_min ^ key_max;
+            int passes = 0;
+            while (diff != 0) {
+                passes++;
+                diff = (passes < (int)sizeof(radix_type)) ? (diff >> 8) : 0;
+            }
+            *active_passes = passes;
+            *in_order = (float)ordered / (float)samples;
+
+            int biggest = 0;
+            for (int i = 0; i < 128; i++)
+                if (buckets[i] > biggest)
+                    biggest = buckets[i];
+            *bucket_share = (float)biggest / (float)samples;
         }
 
-        void DynamicSort::bucket_IndexUInt32(IndexUInt32* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            const int64_t bucket_count = 128;
-            std::vector< IndexUInt32 >* bucket_list = new std::vector< IndexUInt32 >[bucket_count];
+        template <typename T>
+        bool DynamicSort::chooseAuto(const T* A, size_t size, DynamicSortGather* gather, DynamicSortAlgorithm* algorithm) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
 
-            int64_t min = 0;
-            int64_t max = UINT32_MAX;
-            int64_t delta = max - min + 1;
+            if (size < 2)
+                return false;
 
-            for (uint32_t i = 0; i < size; i++) {
-                const IndexUInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort;
-                //uint32_t index = ((element64 - min) * bucket_count) / delta;
-                uint32_t index = ((element64 - min) * bucket_count) >> 32;
-                bucket_list[index].push_back(element32);
+            if (*algorithm == DynamicSortAlgorithm_radix_msd_inplace) {
+                // the MSD sort does not use the gather
+                *gather = DynamicSortGather_counting;
+                return true;
             }
 
-            int a_offset[bucket_count];
-            int offset = 0;
-            for (int i = 0; i < bucket_count; i++) {
-                a_offset[i] = offset;
-                offset += (int)bucket_list[i].size();
-            }
+            int active_passes;
+            float in_order;
+            float bucket_share;
+            sample_input(A, size, &active_passes, &in_order, &bucket_share);
 
-            for (int i = 0; i < bucket_count; i++) {
-                std::vector< IndexUInt32 >& _bucket = bucket_list[i];
+            // all sampled pairs in order: check the whole array (stops at the first inversion)
+            if (in_order == 1.0f && std::is_sorted(A, A + size, SortKeyLess<T>()))
+                return false;
 
-                if (_bucket.size() == 0) {
-                    semaphore.release();
-                    continue;
-                }
+            // the built-in estimates until calibrate() is called
+            const DynamicSortCalibration& table = calibration.valid ? calibration : defaultCalibration;
 
-                DynamicSortJob job = CreateSortAndCopyIndexUInt32(
-                    //algorithm
-                    algorithm,
-                    //sort
-                    &_bucket[0], (uint32_t)_bucket.size(), ((IndexUInt32*)auxBuffer.data) + a_offset[i],
-                    //copy
-                    A + a_offset[i], &_bucket[0], sizeof(IndexUInt32) * _bucket.size());
+            int key = (sizeof(radix_type) > 4) ? 1 : 0;
+            int input_class = (in_order >= AUTO_PRESORTED) ? 1 : 0;
 
-                queue.enqueue(job);
+            // nearest measured size (log scale)
+            int size_index = 0;
+            for (int s = 1; s < DynamicSortCalibration::SIZES; s++) {
+                double middle = sqrt((double)CALIBRATION_SIZES[s - 1] * (double)CALIBRATION_SIZES[s]);
+                if ((double)size >= middle)
+                    size_index = s;
             }
-            // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
 
-            for (int i = 0; i < bucket_count; i++)
-                semaphore.blockingAcquire();
+            // the calibration keys use all radix digits
+            const int passes = (int)sizeof(radix_type);
+            float radix_scale = (float)(1 + active_passes) / (float)(1 + passes);
 
-            delete[]bucket_list;
-        }
-        void DynamicSort::counting_IndexUInt32(IndexUInt32* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            const int64_t bucket_count = 128;
-            //std::vector< T > bucket_list[bucket_count];
-            counter_type counting[bucket_count];
-            counter_type offset[bucket_count];
-            memset(counting, 0, sizeof(counter_type) * bucket_count);
-
-            int64_t min = 0;
-            int64_t max = UINT32_MAX;
-            int64_t delta = max - min + 1;
-
-            IndexUInt32* aux = ((IndexUInt32*)auxBuffer.data);
-
-            //count
-            for (int i = 0; i < size; i++) {
-                const IndexUInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort - min;
-                //uint32_t index = (element64 * bucket_count) / delta;
-                uint32_t index = (element64 * bucket_count) >> 32;
-                counting[index]++;
-            }
+            bool skewed = threadPool->getThreadCount() > 1 && bucket_share > AUTO_MAX_BUCKET_SHARE;
 
-            //compute offset
-            counter_type acc = counting[0];
-            counting[0] = 0;
-            for (uint32_t j = 1; j < bucket_count; j++) {
-                counter_type tmp = counting[j];
-                counting[j] = acc;
-                acc += tmp;
-            }
+            int best = -1;
+            float best_cost = 0.0f;
+            for (int i = 0; i < DynamicSortCalibration::CANDIDATES; i++) {
+                DynamicSortGather candidate_gather = DynamicSortCalibration::gatherOf(i);
+                DynamicSortAlgorithm candidate_algorithm = DynamicSortCalibration::algorithmOf(i);
 
-            memcpy(offset, counting, sizeof(counter_type) * bucket_count);
-
-            // place elements in the output array
-            for (uint32_t i = 0; i < size; i++) {
-                const IndexUInt32 &element32 = A[i];
-                int64_t element64 = (int64_t)element32.toSort - min;
-                //uint32_t index = (element64 * bucket_count) / delta;
-                uint32_t index = (element64 * bucket_count) >> 32;
-                counter_type out_index = counting[index];
-                counting[index]++;
-                aux[out_index] = element32;
-            }
-
-            for (int i = 0; i < bucket_count; i++) {
-                int32_t element_count = counting[i] - offset[i];
-
-                if (element_count == 0) {
-                    semaphore.release();
+                if (*gather != DynamicSortGather_auto && candidate_gather != *gather && candidate_gather != DynamicSortGather_none)
+                    continue;
+                if (*algorithm != DynamicSortAlgorithm_auto && candidate_algorithm != *algorithm)
+                    continue;
+                if (skewed && candidate_gather == DynamicSortGather_counting)
                     continue;
-                }
 
-                DynamicSortJob job = CreateSortAndCopyIndexUInt32(
-                    //algorithm
-                    algorithm,
-                    //sort
-                    aux + offset[i], element_count, A + offset[i],
-                    //copy
-                    A + offset[i], aux + offset[i], element_count * sizeof(IndexUInt32));
+                float cost = table.cost[key][input_class][size_index][i];
+                if (candidate_algorithm == DynamicSortAlgorithm_radix_counting)
+                    cost *= radix_scale;
 
-                queue.enqueue(job);
+                if (best == -1 || cost < best_cost) {
+                    best = i;
+                    best_cost = cost;
+                }
             }
-            // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
 
-            for (int i = 0; i < bucket_count; i++)
-                semaphore.blockingAcquire();
+            if (best == -1) {
+                // no candidate with the fixed parameter (e.g. DynamicSortAlgorithm_none):
+                // the algorithm of the caller in the calling thread
+                if (*gather == DynamicSortGather_auto)
+                    *gather = DynamicSortGather_none;
+                if (*algorithm == DynamicSortAlgorithm_auto)
+                    *algorithm = DynamicSortAlgorithm_radix_counting;
+                return true;
+            }
 
+            if (*gather == DynamicSortGather_auto)
+                *gather = DynamicSortCalibration::gatherOf(best);
+            if (*algorithm == DynamicSortAlgorithm_auto)
+                *algorithm = DynamicSortCalibration::algorithmOf(best);
 
+            return true;
         }
-        void DynamicSort::merge_IndexUInt32(IndexUInt32* A, uint32_t size, DynamicSortAlgorithm algorithm) {
-            IndexUInt32* _aux = ((IndexUInt32*)auxBuffer.data);
-
-            int job_thread_size = size / PlatformThread::QueryNumberOfSystemThreads();// 1 << 16
-            //job_thread_size /= 4;
 
-            if (job_thread_size == 0)
-                job_thread_size = 1;
+        template <typename T>
+        void DynamicSort::calibrateKey(int key) {
+            PlatformTime timer;
+            uint64_t seed = UINT64_C(0x9E3779B97F4A7C15);
 
-            // sort blocks
-            for (int i = 0; i < size; i += job_thread_size) {
-                int index_start = i;
-                int index_end_exclusive = i + job_thread_size;
-                if (index_end_exclusive > size)
-                    index_end_exclusive = size;
+            for (int s = 0; s < DynamicSortCalibration::SIZES; s++) {
+                size_t size = CALIBRATION_SIZES[s];
+                std::vector<T> input(size);
+                std::vector<T> work(size);
 
-                DynamicSortJob job = CreateOnlySortIndexUInt32(
-                    algorithm,
-                    A + index_start, index_end_exclusive - index_start, _aux + index_start);
+                for (int c = 0; c < DynamicSortCalibration::CLASSES; c++) {
+                    for (size_t i = 0; i < size; i++) {
+                        seed = seed * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+                        input[i] = (T)(seed ^ (seed >> 29));
+                    }
+                    if (c == 1) {
+                        std::sort(input.begin(), input.end());
+                        for (size_t i = 0; i < size / CALIBRATION_PRESORTED_SWAPS; i++) {
+                            seed = seed * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+                            size_t a = (size_t)((seed >> 1) % size);
+                            size_t b = (size_t)((seed >> 33) % size);
+                            std::swap(input[a], input[b]);
+                        }
+                    }
 
-                queue.enqueue(job);
+                    for (int i = 0; i < DynamicSortCalibration::CANDIDATES; i++) {
+                        // best of 2 runs
+                        int64_t best = 0;
+                        for (int r = 0; r < 2; r++) {
+                            memcpy(&work[0], &input[0], size * sizeof(T));
+                            timer.update();
+                            sortLocked(&work[0], size,
+                                DynamicSortCalibration::gatherOf(i), DynamicSortCalibration::algorithmOf(i), 0);
+                            timer.update();
+                            if (r == 0 || timer.deltaTimeMicro < best)
+                                best = timer.deltaTimeMicro;
+                        }
+                        if (best < 1)
+                            best = 1;
+                        calibration.cost[key][c][s][i] = (float)((double)best * 1000.0 / (double)size);
+                    }
+                }
             }
-            // post task for processing the created queue
-            for (int i = (int)queue.size() - 1; i >= 0; i--)
-                threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
-
-            for (int i = 0; i < size; i += job_thread_size)
-                semaphore.blockingAcquire();
+        }
 
-            // merge down the blocks
-            IndexUInt32* in = A;
-            IndexUInt32* out = _aux;
+        void DynamicSort::calibrateLocked(bool force) {
+            if (calibration.valid && !force)
+                return;
 
-            int element_count = job_thread_size;
+            if (calibrationFileDefault) {
+                char name[64];
+                sprintf(name, "dynamic_sort_%i.cfg", threadPool->getThreadCount());
+                calibrationFile = PlatformPath::getDocumentsPath("aribeiro", "sort") + PlatformPath::SEPARATOR + name;
+                calibrationFileDefault = false;
+            }
 
-            while (element_count < size) {
+            // the file is valid only for the same thread count
+            if (!force && calibrationFile.size() > 0 &&
+                calibration.load(calibrationFile) &&
+                calibration.threadCount == threadPool->getThreadCount())
+                return;
 
-                //merge operation
-                for (int i = 0; i < size; i += (element_count << 1)) {
-                    DynamicSortJob job = CreateMergeIndexUInt32(in, out, i, element_count, size);
-                    queue.enqueue(job);
-                }
-                // post task for processing the created queue
-                for (int i = (int)queue.size() - 1; i >= 0; i--)
-                    threadPool->postTask(TaskMethod_Fnc(this, &DynamicSort::task_run));
+            calibrateKey<uint32_t>(0);
+            calibrateKey<uint64_t>(1);
 
-                for (int i = 0; i < size; i += (element_count << 1))
-                    semaphore.blockingAcquire();
+            calibration.threadCount = threadPool->getThreadCount();
+            calibration.valid = true;
 
-                //swap in/out
-                IndexUInt32* aux = in;
-                in = out;
-                out = aux;
+            if (calibrationFile.size() > 0)
+                calibration.save(calibrationFile);
+        }
 
-                element_count = element_count << 1;
-            }
+        void DynamicSort::calibrate(bool force) {
+            PlatformAutoLock _autoLock(&mutex);
+            calibrateLocked(force);
+        }
 
-            if (in != A)
-                memcpy(A, in, sizeof(IndexUInt32) * size);
+        void DynamicSort::setCalibrationFile(const std::string& filename) {
+            PlatformAutoLock _autoLock(&mutex);
+            calibrationFile = filename;
+            calibrationFileDefault = false;
+            calibration.valid = false;
         }
 
+        const DynamicSortCalibration& DynamicSort::getCalibration() const {
+            return calibration.valid ? calibration : defaultCalibration;
+        }
 
-        DynamicSort::DynamicSort(ThreadPool* _threadPool, uint32_t _useMultithreadStartingAtCount) :semaphore(0) {
+        DynamicSort::DynamicSort(ThreadPool* _threadPool, size_t _useMultithreadStartingAtCount) {
             threadPool = _threadPool;
             useMultithreadStartingAtCount = _useMultithreadStartingAtCount;
+            queued_jobs = 0;
+            auxBuffer = NULL;
+            calibrationFileDefault = true;
+            // the threads of the pool run in parallel up to the number of processors
+            defaultCalibration.setDefault((std::min)(threadPool->getThreadCount(), PlatformThread::QueryNumberOfSystemThreads()));
             /*
 
             for (int i = 0; i < PlatformThread::QueryNumberOfSystemThreads(); i++)
@@ -1368,148 +1311,485 @@ namespace aRibeiro {
             */
         }
 
-        void DynamicSort::sort_int32_t(int32_t* A, uint32_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
-
+        void DynamicSort::setMemoryPolicy(PlatformMemoryPolicy policy, int numaNode) {
             PlatformAutoLock _autoLock(&mutex);
+            // the chunks already allocated are kept by the arena: free them to apply the policy
+            auxArena.release();
+            auxArena.setMemoryPolicy(policy, numaNode);
+        }
 
-            auxBuffer.setSize(size * sizeof(int32_t));
-            if (size < useMultithreadStartingAtCount) {
+        template <typename T>
+        void DynamicSort::sortLocked(T* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm, size_t multithreadStartingAtCount) {
+            MemoryArenaScope auxScope(&auxArena);
 
-                switch (algorithm) {
-                case DynamicSortAlgorithm_radix_counting:
-                    radix_counting_sort_signed(A, size, (int32_t*)auxBuffer.data);
-                    break;
-                case DynamicSortAlgorithm_std:
-                    std::sort(A, A + size);
-                    break;
-                default:
-                    break;
-                }
+            if (algorithm == DynamicSortAlgorithm_radix_msd_inplace) {
+                // in-place: no auxiliary buffer, and the MSD distribution is the gather
+                if (size < multithreadStartingAtCount || gather == DynamicSortGather_none)
+                    sort_block<T>(algorithm, A, size, NULL);
+                else
+                    msd(A, size, msd_top_shift<T>(), size);
+                return;
+            }
+
+            auxBuffer = (uint8_t*)auxArena.allocate(size * sizeof(T), 64);
+            if (size < multithreadStartingAtCount || gather == DynamicSortGather_none) {
+
+                sort_block(algorithm, A, size, (T*)auxBuffer);
 
             }
             else {
                 switch (gather) {
                 case DynamicSortGather_bucket:
-                    bucket_int32_t(A, size, algorithm);
+                    bucket(A, size, algorithm);
                     break;
                 case DynamicSortGather_counting:
-                    counting_int32_t(A, size, algorithm);
+                    counting(A, size, algorithm);
                     break;
                 case DynamicSortGather_merge:
-                    merge_int32_t(A, size, algorithm);
+                    merge(A, size, algorithm);
+                    break;
+                case DynamicSortGather_sample:
+                    sample(A, size, algorithm);
                     break;
                 default:
                     break;
                 }
             }
+            auxBuffer = NULL;
         }
 
-        void DynamicSort::sort_uint32_t(uint32_t* A, uint32_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+        template <typename T>
+        void DynamicSort::sort(T* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
             PlatformAutoLock _autoLock(&mutex);
 
-            auxBuffer.setSize(size * sizeof(uint32_t));
-            if (size < useMultithreadStartingAtCount) {
+            size_t multithreadStartingAtCount = useMultithreadStartingAtCount;
+            if (gather == DynamicSortGather_auto || algorithm == DynamicSortAlgorithm_auto) {
+                // the cost model chooses between the calling thread and the thread pool
+                if (gather == DynamicSortGather_auto)
+                    multithreadStartingAtCount = 0;
+                if (!chooseAuto(A, size, &gather, &algorithm))
+                    return;
+            }
 
-                switch (algorithm) {
-                case DynamicSortAlgorithm_radix_counting:
-                    radix_counting_sort_unsigned(A, size, (uint32_t*)auxBuffer.data);
-                    break;
-                case DynamicSortAlgorithm_std:
-                    std::sort(A, A + size);
-                    break;
-                default:
-                    break;
-                }
+            sortLocked(A, size, gather, algorithm, multithreadStartingAtCount);
+        }
 
+        void DynamicSort::runColumnJob(DynamicSortJob job, size_t size) {
+            int parts = threadPool->getThreadCount();
+            if (size < useMultithreadStartingAtCount || parts <= 1) {
+                job.column.begin = 0;
+                job.column.end = size;
+                job.run(job);
+                return;
             }
-            else {
-                switch (gather) {
-                case DynamicSortGather_bucket:
-                    bucket_uint32_t(A, size, algorithm);
-                    break;
-                case DynamicSortGather_counting:
-                    counting_uint32_t(A, size, algorithm);
-                    break;
-                case DynamicSortGather_merge:
-                    merge_uint32_t(A, size, algorithm);
-                    break;
-                default:
-                    break;
-                }
+            for (int p = 0; p < parts; p++) {
+                job.column.begin = size * p / parts;
+                job.column.end = size * (p + 1) / parts;
+                enqueueJob(job);
             }
+            postQueueTasks();
+            threadPool->waitAll(&taskGroup);
         }
 
+        //
+        // Key column sort:
+        //
+        //  1) the keys are copied to key/index pairs
+        //  2) the pairs are sorted with radix_counting (stable with all gathers)
+        //  3) the keys and the permutation are copied from the pairs
+        //  4) each value column is permuted to the auxiliary buffer and copied back
+        //
+        template <typename K, typename P, typename I>
+        void DynamicSort::keyColumnSort(const K* keys, size_t size, K* keys_out, I* permutation,
+            void* const* columns, const size_t* columnElementSize, int columnCount, DynamicSortGather gather) {
+
+            MemoryArenaScope auxScope(&auxArena);
+
+            P* pairs = (P*)auxArena.allocate(size * sizeof(P), 64);
+            if (permutation == NULL)
+                permutation = (I*)auxArena.allocate(size * sizeof(I), 64);
+
+            runColumnJob(CreateColumn(DynamicSortJob_KeyFill, &run_key_column_job<K, P>,
+                keys, pairs, NULL, sizeof(K), (int)sizeof(I)), size);
+
+            // the algorithm is fixed: the std::sort is not stable
+            DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting;
+            size_t multithreadStartingAtCount = useMultithreadStartingAtCount;
+            bool sorted = false;
+            if (gather == DynamicSortGather_auto) {
+                multithreadStartingAtCount = 0;
+                sorted = !chooseAuto(pairs, size, &gather, &algorithm);
+            }
+            if (!sorted)
+                sortLocked(pairs, size, gather, algorithm, multithreadStartingAtCount);
+
+            runColumnJob(CreateColumn(DynamicSortJob_KeyExtract, &run_key_column_job<K, P>,
+                pairs, keys_out, permutation, sizeof(K), (int)sizeof(I)), size);
+
+            if (columnCount == 0)
+                return;
+
+            size_t maxElementSize = 0;
+            for (int c = 0; c < columnCount; c++)
+                if (columnElementSize[c] > maxElementSize)
+                    maxElementSize = columnElementSize[c];
+            uint8_t* tmp = (uint8_t*)auxArena.allocate(size * maxElementSize, 64);
+
+            for (int c = 0; c < columnCount; c++) {
+                runColumnJob(CreateColumn(DynamicSortJob_ColumnPermute, &run_column_job,
+                    columns[c], tmp, permutation, columnElementSize[c], (int)sizeof(I)), size);
+                runColumnJob(CreateColumn(DynamicSortJob_ColumnCopy, &run_column_job,
+                    tmp, columns[c], NULL, columnElementSize[c], (int)sizeof(I)), size);
+            }
+        }
 
-        void DynamicSort::sort_IndexInt32(IndexInt32* A, uint32_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+        template <typename K, typename I>
+        void DynamicSort::argsort(const K* keys, size_t size, I* permutation, DynamicSortGather gather) {
             PlatformAutoLock _autoLock(&mutex);
+            ARIBEIRO_ABORT(sizeof(I) < 8 && (uint64_t)size > UINT32_MAX, "argsort: use an uint64_t permutation with more than 4G elements.\n");
+            if ((uint64_t)size <= UINT32_MAX)
+                keyColumnSort<K, typename SortKeyIndex<K>::small, I>(keys, size, NULL, permutation, NULL, NULL, 0, gather);
+            else
+                keyColumnSort<K, typename SortKeyIndex<K>::large, I>(keys, size, NULL, permutation, NULL, NULL, 0, gather);
+        }
 
-            auxBuffer.setSize(size * sizeof(IndexInt32));
-            if (size < useMultithreadStartingAtCount) {
+        template <typename K>
+        void DynamicSort::sortByKeyColumns(K* keys, size_t size, void* const* columns, const size_t* columnElementSize, int columnCount, DynamicSortGather gather) {
+            PlatformAutoLock _autoLock(&mutex);
+            if ((uint64_t)size <= UINT32_MAX)
+                keyColumnSort<K, typename SortKeyIndex<K>::small, uint32_t>(keys, size, keys, NULL, columns, columnElementSize, columnCount, gather);
+            else
+                keyColumnSort<K, typename SortKeyIndex<K>::large, uint64_t>(keys, size, keys, NULL, columns, columnElementSize, columnCount, gather);
+        }
 
-                switch (algorithm) {
-                case DynamicSortAlgorithm_radix_counting:
-                    radix_counting_sort_signed_index(A, size, (IndexInt32*)auxBuffer.data);
-                    break;
-                case DynamicSortAlgorithm_std:
-                    std::sort(A, A + size, IndexInt32::comparator);
-                    break;
-                default:
-                    break;
-                }
+#define ARIBEIRO_SORT_KEY_COLUMN_INSTANTIATE(K) \
+        template void DynamicSort::argsort<K, uint32_t>(const K* keys, size_t size, uint32_t* permutation, DynamicSortGather gather); \
+        template void DynamicSort::argsort<K, uint64_t>(const K* keys, size_t size, uint64_t* permutation, DynamicSortGather gather); \
+        template void DynamicSort::sortByKeyColumns<K>(K* keys, size_t size, void* const* columns, const size_t* columnElementSize, int columnCount, DynamicSortGather gather);
 
+        ARIBEIRO_SORT_KEY_COLUMN_INSTANTIATE(int32_t)
+        ARIBEIRO_SORT_KEY_COLUMN_INSTANTIATE(uint32_t)
+        ARIBEIRO_SORT_KEY_COLUMN_INSTANTIATE(int64_t)
+        ARIBEIRO_SORT_KEY_COLUMN_INSTANTIATE(uint64_t)
+        ARIBEIRO_SORT_KEY_COLUMN_INSTANTIATE(float)
+        ARIBEIRO_SORT_KEY_COLUMN_INSTANTIATE(double)
+
+#undef ARIBEIRO_SORT_KEY_COLUMN_INSTANTIATE
+
+        void DynamicSort::runJobs(const DynamicSortJob* jobs, int count) {
+            if (count == 1) {
+                jobs[0].run(jobs[0]);
+                return;
             }
-            else {
-                switch (gather) {
-                case DynamicSortGather_bucket:
-                    bucket_IndexInt32(A, size, algorithm);
-                    break;
-                case DynamicSortGather_counting:
-                    counting_IndexInt32(A, size, algorithm);
-                    break;
-                case DynamicSortGather_merge:
-                    merge_IndexInt32(A, size, algorithm);
-                    break;
-                default:
-                    break;
+            for (int i = 0; i < count; i++)
+                enqueueJob(jobs[i]);
+            postQueueTasks();
+            threadPool->waitAll(&taskGroup);
+        }
+
+        //
+        // Radix select of the element of rank:
+        //
+        //  1) one histogram job per part counts the digit of the keys with the prefix
+        //  2) the digit of the bucket with the rank is added to the prefix
+        //  3) when the bucket has less than half of the keys, its keys are copied to a
+        //     buffer (one job per part), and the next rounds read the buffer
+        //  4) small buckets are finished with std::nth_element
+        //
+        template <typename T>
+        uint64_t DynamicSort::selectThreshold(const T* A, size_t size, size_t rank, uint64_t mask, int parts) {
+            typedef typename SortKeyTraits<T>::radix_type radix_type;
+
+            size_t* count = (size_t*)auxArena.allocate(sizeof(size_t) * 256 * parts, 64);
+            std::vector<DynamicSortJob> jobs(parts);
+
+            // keys of the bucket (NULL: the rounds read A)
+            radix_type* buffer = NULL;
+            size_t current = size;
+            radix_type prefix = 0;
+            int shift = (int)sizeof(radix_type) * 8 - 8;
+
+            while (true) {
+                memset(count, 0, sizeof(size_t) * 256 * parts);
+                for (int p = 0; p < parts; p++) {
+                    size_t begin = current * p / parts;
+                    size_t end = current * (p + 1) / parts;
+                    if (buffer == NULL)
+                        jobs[p] = CreateSelect<T>(DynamicSortJob_SelectHistogram, A, NULL, begin, end, shift, mask, prefix, count + p * 256);
+                    else
+                        jobs[p] = CreateSelect<radix_type>(DynamicSortJob_SelectHistogram, buffer, NULL, begin, end, shift, 0, prefix, count + p * 256);
+                }
+                runJobs(&jobs[0], parts);
+
+                size_t total[256];
+                memset(total, 0, sizeof(total));
+                for (int p = 0; p < parts; p++)
+                    for (int i = 0; i < 256; i++)
+                        total[i] += count[p * 256 + i];
+
+                int digit = radix_select_digit(total, &rank);
+                prefix |= (radix_type)digit << shift;
+                size_t bucket_size = total[digit];
+
+                if (shift == 0)
+                    return prefix;
+
+                if (bucket_size <= SELECT_SEQUENTIAL_SIZE || bucket_size * 2 <= current) {
+                    radix_type* next = (radix_type*)auxArena.allocate(sizeof(radix_type) * bucket_size, 64);
+                    size_t offset = 0;
+                    for (int p = 0; p < parts; p++) {
+                        size_t begin = current * p / parts;
+                        size_t end = current * (p + 1) / parts;
+                        if (buffer == NULL)
+                            jobs[p] = CreateSelect<T>(DynamicSortJob_SelectCollect, A, next + offset, begin, end, shift, mask, prefix, count + p * 256);
+                        else
+                            jobs[p] = CreateSelect<radix_type>(DynamicSortJob_SelectCollect, buffer, next + offset, begin, end, shift, 0, prefix, count + p * 256);
+                        offset += count[p * 256 + digit];
+                    }
+                    runJobs(&jobs[0], parts);
+
+                    buffer = next;
+                    current = bucket_size;
+
+                    if (current <= SELECT_SEQUENTIAL_SIZE) {
+                        std::nth_element(buffer, buffer + rank, buffer + current);
+                        return buffer[rank];
+                    }
                 }
+
+                shift -= 8;
             }
         }
 
-        void DynamicSort::sort_IndexUInt32(IndexUInt32* A, uint32_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+        template <typename T>
+        void DynamicSort::selectPartition(const T* A, size_t size, uint64_t threshold, uint64_t mask, int parts,
+            size_t equalEnd, bool keepGreater, T* out, size_t* less, size_t* equal) {
+
+            size_t* count = (size_t*)auxArena.allocate(sizeof(size_t) * 2 * parts, 64);
+            memset(count, 0, sizeof(size_t) * 2 * parts);
+            std::vector<DynamicSortJob> jobs(parts);
+
+            for (int p = 0; p < parts; p++)
+                jobs[p] = CreateSelect<T>(DynamicSortJob_SelectCount, A, NULL, size * p / parts, size * (p + 1) / parts,
+                    0, mask, threshold, count + p * 2);
+            runJobs(&jobs[0], parts);
+
+            size_t less_total = 0, equal_total = 0;
+            for (int p = 0; p < parts; p++) {
+                less_total += count[p * 2];
+                equal_total += count[p * 2 + 1];
+            }
+            if (equalEnd > less_total + equal_total)
+                equalEnd = less_total + equal_total;
+
+            size_t less_pos = 0;
+            size_t equal_pos = less_total;
+            size_t greater_pos = less_total + equal_total;
+            for (int p = 0; p < parts; p++) {
+                size_t begin = size * p / parts;
+                size_t end = size * (p + 1) / parts;
+                jobs[p] = CreateSelect<T>(DynamicSortJob_SelectScatter, A, out, begin, end, 0, mask, threshold, NULL);
+                jobs[p].select.position[0] = less_pos;
+                jobs[p].select.position[1] = equal_pos;
+                jobs[p].select.position[2] = equalEnd;
+                jobs[p].select.position[3] = keepGreater ? greater_pos : SIZE_MAX;
+                less_pos += count[p * 2];
+                equal_pos += count[p * 2 + 1];
+                greater_pos += (end - begin) - count[p * 2] - count[p * 2 + 1];
+            }
+            runJobs(&jobs[0], parts);
+
+            *less = less_total;
+            *equal = equal_total;
+        }
+
+        template <typename T>
+        void DynamicSort::topK(const T* A, size_t size, size_t k, T* out, bool largest) {
             PlatformAutoLock _autoLock(&mutex);
 
-            auxBuffer.setSize(size * sizeof(IndexUInt32));
-            if (size < useMultithreadStartingAtCount) {
+            if (k > size)
+                k = size;
+            if (k == 0)
+                return;
 
-                switch (algorithm) {
-                case DynamicSortAlgorithm_radix_counting:
-                    radix_counting_sort_unsigned_index(A, size, (IndexUInt32*)auxBuffer.data);
-                    break;
-                case DynamicSortAlgorithm_std:
-                    std::sort(A, A + size, IndexUInt32::comparator);
-                    break;
-                default:
-                    break;
-                }
+            MemoryArenaScope auxScope(&auxArena);
 
+            int parts = (size < useMultithreadStartingAtCount) ? 1 : threadPool->getThreadCount();
+            if (parts < 1)
+                parts = 1;
+            uint64_t mask = largest ? ~(uint64_t)0 : 0;
+
+            if (k <= SELECT_HEAP_SIZE && k < size) {
+                typedef typename SortKeyTraits<T>::radix_type radix_type;
+                typedef std::pair<radix_type, size_t> heap_entry;
+
+                heap_entry* heap = (heap_entry*)auxArena.allocate(sizeof(heap_entry) * k * parts, 64);
+                size_t* count = (size_t*)auxArena.allocate(sizeof(size_t) * parts, 64);
+                std::vector<DynamicSortJob> jobs(parts);
+                for (int p = 0; p < parts; p++) {
+                    jobs[p] = CreateSelect<T>(DynamicSortJob_SelectHeap, A, heap + k * p, size * p / parts, size * (p + 1) / parts,
+                        0, mask, 0, count + p);
+                    jobs[p].select.position[0] = k;
+                }
+                runJobs(&jobs[0], parts);
+
+                // merge: the (key, position) order is the stable order of the output
+                // (the heaps are moved down to be contiguous: total <= k * p)
+                size_t total = count[0];
+                for (int p = 1; p < parts; p++) {
+                    if (total != k * p)
+                        std::copy(heap + k * p, heap + k * p + count[p], heap + total);
+                    total += count[p];
+                }
+                std::partial_sort(heap, heap + k, heap + total);
+                for (size_t i = 0; i < k; i++)
+                    out[i] = A[heap[i].second];
+                return;
             }
+
+            if (k == size)
+                memcpy(out, A, sizeof(T) * size);
             else {
-                switch (gather) {
-                case DynamicSortGather_bucket:
-                    bucket_IndexUInt32(A, size, algorithm);
-                    break;
-                case DynamicSortGather_counting:
-                    counting_IndexUInt32(A, size, algorithm);
-                    break;
-                case DynamicSortGather_merge:
-                    merge_IndexUInt32(A, size, algorithm);
-                    break;
-                default:
-                    break;
-                }
+                uint64_t threshold = selectThreshold(A, size, k - 1, mask, parts);
+                size_t less, equal;
+                selectPartition(A, size, threshold, mask, parts, k, false, out, &less, &equal);
+            }
+
+            sortLocked(out, k, DynamicSortGather_counting, DynamicSortAlgorithm_radix_counting, useMultithreadStartingAtCount);
+            if (largest)
+                select_reverse_stable(out, k);
+        }
+
+        template <typename T>
+        void DynamicSort::partialSort(T* A, size_t size, size_t k) {
+            if (k >= size) {
+                sort(A, size);
+                return;
             }
+            if (k == 0)
+                return;
+
+            PlatformAutoLock _autoLock(&mutex);
+            MemoryArenaScope auxScope(&auxArena);
+
+            int parts = (size < useMultithreadStartingAtCount) ? 1 : threadPool->getThreadCount();
+            if (parts < 1)
+                parts = 1;
+
+            T* aux = (T*)auxArena.allocate(size * sizeof(T), 64);
+            uint64_t threshold = selectThreshold(A, size, k - 1, 0, parts);
+            size_t less, equal;
+            selectPartition(A, size, threshold, 0, parts, SIZE_MAX, true, aux, &less, &equal);
+
+            sortLocked(aux, k, DynamicSortGather_counting, DynamicSortAlgorithm_radix_counting, useMultithreadStartingAtCount);
+
+            runColumnJob(CreateColumn(DynamicSortJob_ColumnCopy, &run_column_job, aux, A, NULL, sizeof(T), 0), size);
+        }
+
+        template <typename T>
+        void DynamicSort::nthElement(T* A, size_t size, size_t nth) {
+            if (nth >= size)
+                return;
+
+            PlatformAutoLock _autoLock(&mutex);
+            MemoryArenaScope auxScope(&auxArena);
+
+            int parts = (size < useMultithreadStartingAtCount) ? 1 : threadPool->getThreadCount();
+            if (parts < 1)
+                parts = 1;
+
+            T* aux = (T*)auxArena.allocate(size * sizeof(T), 64);
+            uint64_t threshold = selectThreshold(A, size, nth, 0, parts);
+            size_t less, equal;
+            selectPartition(A, size, threshold, 0, parts, SIZE_MAX, true, aux, &less, &equal);
+
+            runColumnJob(CreateColumn(DynamicSortJob_ColumnCopy, &run_column_job, aux, A, NULL, sizeof(T), 0), size);
+        }
+
+#define ARIBEIRO_SORT_SELECT_INSTANTIATE(T) \
+        template void DynamicSort::topK<T>(const T* A, size_t size, size_t k, T* out, bool largest); \
+        template void DynamicSort::partialSort<T>(T* A, size_t size, size_t k); \
+        template void DynamicSort::nthElement<T>(T* A, size_t size, size_t nth);
+
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(int32_t)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(uint32_t)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(int64_t)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(uint64_t)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(float)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(double)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(IndexInt32)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(IndexUInt32)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(IndexInt32_64)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(IndexUInt32_64)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(IndexInt64)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(IndexUInt64)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(IndexFloat)
+        ARIBEIRO_SORT_SELECT_INSTANTIATE(IndexDouble)
+
+#undef ARIBEIRO_SORT_SELECT_INSTANTIATE
+
+        template void DynamicSort::sort<int32_t>(int32_t* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<uint32_t>(uint32_t* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<int64_t>(int64_t* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<uint64_t>(uint64_t* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<float>(float* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<double>(double* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<IndexInt32>(IndexInt32* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<IndexUInt32>(IndexUInt32* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<IndexInt32_64>(IndexInt32_64* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<IndexUInt32_64>(IndexUInt32_64* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<IndexInt64>(IndexInt64* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<IndexUInt64>(IndexUInt64* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<IndexFloat>(IndexFloat* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+        template void DynamicSort::sort<IndexDouble>(IndexDouble* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm);
+
+        void DynamicSort::sort_int32_t(int32_t* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<int32_t>(A, size, gather, algorithm);
+        }
+
+        void DynamicSort::sort_uint32_t(uint32_t* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<uint32_t>(A, size, gather, algorithm);
+        }
+
+        void DynamicSort::sort_IndexInt32(IndexInt32* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<IndexInt32>(A, size, gather, algorithm);
+        }
+
+        void DynamicSort::sort_IndexUInt32(IndexUInt32* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<IndexUInt32>(A, size, gather, algorithm);
+        }
+
+        void DynamicSort::sort_int64_t(int64_t* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<int64_t>(A, size, gather, algorithm);
+        }
+
+        void DynamicSort::sort_uint64_t(uint64_t* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<uint64_t>(A, size, gather, algorithm);
+        }
+
+        void DynamicSort::sort_float(float* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<float>(A, size, gather, algorithm);
+        }
+
+        void DynamicSort::sort_double(double* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<double>(A, size, gather, algorithm);
+        }
+
+        void DynamicSort::sort_IndexInt64(IndexInt64* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<IndexInt64>(A, size, gather, algorithm);
+        }
+
+        void DynamicSort::sort_IndexUInt64(IndexUInt64* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<IndexUInt64>(A, size, gather, algorithm);
+        }
+
+        void DynamicSort::sort_IndexFloat(IndexFloat* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<IndexFloat>(A, size, gather, algorithm);
+        }
+
+        void DynamicSort::sort_IndexDouble(IndexDouble* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm) {
+            sort<IndexDouble>(A, size, gather, algorithm);
         }
 
     }
 }
-
@@ -2,14 +2,20 @@
 #define __algorithms__Thread__h__
 
 #include <aRibeiroCore/common.h>
-#include <aRibeiroPlatform/ObjectBuffer.h>
-#include <aRibeiroPlatform/ObjectQueue.h>
+#include <aRibeiroPlatform/MemoryArena.h>
+#include <aRibeiroPlatform/ObjectRingQueue.h>
 #include <aRibeiroPlatform/PlatformThread.h>
 #include <aRibeiroPlatform/PlatformSemaphore.h>
 
 #include <aRibeiroCore/Algorithms.h>
+#include <aRibeiroPlatform/AlgorithmsKeyTraits.h>
+#include <aRibeiroPlatform/AlgorithmsMerge.h>
+#include <aRibeiroPlatform/AlgorithmsSample.h>
+#include <aRibeiroPlatform/AlgorithmsSelect.h>
 #include <aRibeiroPlatform/ThreadPool.h>
 
+#include <string>
+
 namespace aRibeiro {
     namespace Sorting {
 
@@ -17,26 +23,42 @@ namespace aRibeiro {
             DynamicSortGather_none,
             DynamicSortGather_bucket,
             DynamicSortGather_counting,
-            DynamicSortGather_merge
+            DynamicSortGather_merge,
+            // splitters from a sample of the array: the buckets are balanced with any key distribution
+            DynamicSortGather_sample,
+            // chosen by the cost model: built-in estimates, or the measures of DynamicSort::calibrate
+            DynamicSortGather_auto
         };
 
         enum DynamicSortAlgorithm {
             DynamicSortAlgorithm_none,
             DynamicSortAlgorithm_std,
-            DynamicSortAlgorithm_radix_counting
+            DynamicSortAlgorithm_radix_counting,
+            // in-place MSD radix sort: no auxiliary buffer, the gather is ignored (not stable)
+            DynamicSortAlgorithm_radix_msd_inplace,
+            // chosen by the cost model: built-in estimates, or the measures of DynamicSort::calibrate
+            DynamicSortAlgorithm_auto
         };
 
         enum DynamicSortJob_type {
             DynamicSortJob_SortAndCopy,
             DynamicSortJob_OnlySort,
-            DynamicSortJob_Merge
-        };
-
-        enum DynamicSortData_type {
-            DynamicSortData_Int32,
-            DynamicSortData_UInt32,
-            DynamicSortData_IndexInt32,
-            DynamicSortData_IndexUInt32
+            DynamicSortJob_Merge,
+            DynamicSortJob_MSDHistogram,
+            DynamicSortJob_MSDPermute,
+            DynamicSortJob_MSDRepair,
+            DynamicSortJob_MSDSort,
+            DynamicSortJob_SampleClassify,
+            DynamicSortJob_SampleScatter,
+            DynamicSortJob_KeyFill,
+            DynamicSortJob_KeyExtract,
+            DynamicSortJob_ColumnPermute,
+            DynamicSortJob_ColumnCopy,
+            DynamicSortJob_SelectHistogram,
+            DynamicSortJob_SelectCollect,
+            DynamicSortJob_SelectCount,
+            DynamicSortJob_SelectScatter,
+            DynamicSortJob_SelectHeap
         };
 
         struct DynamicSortJob {
@@ -44,24 +66,15 @@ namespace aRibeiro {
             DynamicSortJob_type type;
             DynamicSortAlgorithm algorithm;
 
-            DynamicSortData_type input_data_type;
+            // runs the job with the element type of the sort call
+            void (*run)(const DynamicSortJob& job);
 
             union {
                 struct {
                     struct {
-                        union {
-                            int32_t* _array_int32;
-                            uint32_t* _array_uint32;
-                            IndexInt32* _array_IndexInt32;
-                            IndexUInt32* _array_IndexUInt32;
-                        };
-                        uint32_t _size;
-                        union {
-                            int32_t* _tmp_array_int32;
-                            uint32_t* _tmp_array_uint32;
-                            IndexInt32* _tmp_array_IndexInt32;
-                            IndexUInt32* _tmp_array_IndexUInt32;
-                        };
+                        void* _array;
+                        size_t _size;
+                        void* _tmp_array;
                     } sort;
 
                     struct {
@@ -71,72 +84,289 @@ namespace aRibeiro {
                     } copy;
                 } sort_copy;
 
+                // multiway merge of the output range [rank_begin, rank_end)
                 struct {
-                    union {
-                        int32_t* in_int32;
-                        uint32_t* in_uint32;
-                        IndexInt32* in_IndexInt32;
-                        IndexUInt32* in_IndexUInt32;
-                    };
-                    union {
-                        int32_t* out_int32;
-                        uint32_t* out_uint32;
-                        IndexInt32* out_IndexInt32;
-                        IndexUInt32* out_IndexUInt32;
-                    };
-                    int i;
-                    int element_count;
-                    int size;
+                    const void* in;
+                    void* out;
+                    const size_t* run_begin;
+                    const size_t* run_end;
+                    int runs;
+                    size_t rank_begin;
+                    size_t rank_end;
                 } merge;
+
+                // in-place MSD radix jobs
+                struct {
+                    void* _array;
+                    size_t begin;
+                    size_t end;
+                    int shift;
+                    // part of the permutation, or bucket of the repair
+                    int part;
+                    int parts;
+                    size_t* head;
+                    size_t* tail;
+                    // repair: receives the begin of the range still to be filled
+                    size_t* result;
+                } msd;
+
+                // sample sort: classification and scatter of the range [begin, end)
+                struct {
+                    const void* in;
+                    void* out;
+                    size_t begin;
+                    size_t end;
+                    const void* splitters;
+                    uint8_t* oracle;
+                    // bucket counters (classify) or offsets (scatter) of the part
+                    size_t* count;
+                } sample;
+
+                // key column jobs (argsort, sortByKey) of the range [begin, end):
+                //   fill: key column (in) to key/index pairs (out)
+                //   extract: pairs (in) to the key column (out, optional) and the permutation
+                //   permute: out[i] = in[permutation[i]], copy: out[i] = in[i]
+                struct {
+                    const void* in;
+                    void* out;
+                    void* permutation;
+                    size_t begin;
+                    size_t end;
+                    size_t elementSize;
+                    // bytes of the permutation elements: 4 or 8
+                    int indexBytes;
+                } column;
+
+                // radix select jobs (topK, partialSort, nthElement) of the range [begin, end)
+                struct {
+                    const void* in;
+                    void* out;
+                    size_t begin;
+                    size_t end;
+                    int shift;
+                    // radix key mask (0 or ~0) and the prefix or threshold key
+                    uint64_t mask;
+                    uint64_t key;
+                    // histogram: 256 counters; collect and heap: number of keys copied;
+                    // count: less and equal counters
+                    size_t* count;
+                    // scatter: less, equal, equal end and greater positions; heap: k
+                    size_t position[4];
+                } select;
             };
 
         };
 
+        //
+        // Measured cost (nanoseconds per element) of each gather/algorithm pair,
+        // used by the auto mode of the DynamicSort.
+        //
+        struct DynamicSortCalibration {
+            // radix key of 32 or 64 bits
+            static const int KEYS = 2;
+            // random keys, presorted keys
+            static const int CLASSES = 2;
+            // array sizes of the measures: 16k, 128k, 1M
+            static const int SIZES = 3;
+            // single thread, counting, merge and sample gathers; std::sort and radix_counting
+            static const int CANDIDATES = 8;
+
+            bool valid;
+            int threadCount;
+            float cost[KEYS][CLASSES][SIZES][CANDIDATES];
+
+            DynamicSortCalibration();
+
+            // built-in estimates for the number of threads that run in parallel (valid stays false)
+            void setDefault(int parallelThreads);
+
+            bool load(const std::string& filename);
+            bool save(const std::string& filename) const;
+
+            static size_t sizeOf(int size_index);
+            static DynamicSortGather gatherOf(int candidate);
+            static DynamicSortAlgorithm algorithmOf(int candidate);
+        };
+
+        //
+        // Parallel sort using the ThreadPool.
+        //
+        // The element types are the ones with SortKeyTraits (AlgorithmsKeyTraits.h):
+        //   int32_t, uint32_t, int64_t, uint64_t, float, double,
+        //   IndexInt32, IndexUInt32 and IndexKey64<K> (key + 64 bits index).
+        //
+        // The float/double keys are sorted by their bits with the sign transform,
+        //   so -0.0 comes before 0.0 and the NaNs go to the ends of the array.
+        //
+        // The DynamicSortAlgorithm_radix_msd_inplace sorts without the auxiliary buffer
+        //   (the other algorithms allocate one buffer with the size of the array).
+        //   The extra memory is a few KB of counters per thread.
+        //
+        // Auto mode (DynamicSortGather_auto and/or DynamicSortAlgorithm_auto):
+        //   the costs come from a built-in table, scaled by the threads that run in parallel.
+        //   The sort does not measure the machine nor read/write files: call calibrate()
+        //   to replace the table by the measures of the machine.
+        //   Each sort samples the input (key range, presortedness and skew of the
+        //   most significant bits) and runs the pair with the lowest estimated cost,
+        //   in the calling thread or in the thread pool.
+        //
         class DynamicSort {
             //std::vector<PlatformThread*> threads;
             ThreadPool* threadPool;
-            ObjectQueue <DynamicSortJob> queue;
-            PlatformSemaphore semaphore;
-            ObjectBuffer auxBuffer;
+            ObjectRingQueue <DynamicSortJob, 4096> queue;
+            // jobs enqueued and not posted to the thread pool yet
+            uint32_t queued_jobs;
+            ThreadPoolTaskGroup taskGroup;
+            // auxBuffer is allocated from the auxArena in each sort call
+            MemoryArena auxArena;
+            uint8_t* auxBuffer;
             PlatformMutex mutex;
-            uint32_t useMultithreadStartingAtCount;
-            
-            void merge_job_int32(const int32_t* in, int32_t* out, int i, int element_count, int size);
-            void merge_job_uint32(const uint32_t* in, uint32_t* out, int i, int element_count, int size);
+            size_t useMultithreadStartingAtCount;
 
-            void merge_job_IndexInt32(const IndexInt32* in, IndexInt32* out, int i, int element_count, int size);
-            void merge_job_IndexUInt32(const IndexUInt32* in, IndexUInt32* out, int i, int element_count, int size);
+            DynamicSortCalibration calibration;
+            // used by the auto mode until the calibrate() is called
+            DynamicSortCalibration defaultCalibration;
+            std::string calibrationFile;
+            bool calibrationFileDefault;
 
             void task_run();
+            void enqueueJob(const DynamicSortJob& job);
+            void postQueueTasks();
 
-            void bucket_int32_t(int32_t* A, uint32_t size, DynamicSortAlgorithm algorithm);
-            void counting_int32_t(int32_t* A, uint32_t size, DynamicSortAlgorithm algorithm);
-            void merge_int32_t(int32_t* A, uint32_t size, DynamicSortAlgorithm algorithm);
-            
-            void bucket_uint32_t(uint32_t* A, uint32_t size, DynamicSortAlgorithm algorithm);
-            void counting_uint32_t(uint32_t* A, uint32_t size, DynamicSortAlgorithm algorithm);
-            void merge_uint32_t(uint32_t* A, uint32_t size, DynamicSortAlgorithm algorithm);
+            template <typename T>
+            void bucket(T* A, size_t size, DynamicSortAlgorithm algorithm);
+            template <typename T>
+            void counting(T* A, size_t size, DynamicSortAlgorithm algorithm);
+            template <typename T>
+            void merge(T* A, size_t size, DynamicSortAlgorithm algorithm);
+            template <typename T>
+            void sample(T* A, size_t size, DynamicSortAlgorithm algorithm);
+            template <typename T>
+            void msd(T* A, size_t size, int shift, size_t parallelSize);
+
+            // sort with the mutex locked: multithreadStartingAtCount selects the calling thread
+            template <typename T>
+            void sortLocked(T* A, size_t size, DynamicSortGather gather, DynamicSortAlgorithm algorithm, size_t multithreadStartingAtCount);
+
+            void calibrateLocked(bool force);
+            // measures the candidates with keys of the radix type T (uint32_t or uint64_t)
+            template <typename T>
+            void calibrateKey(int key);
+
+            // runs the column job on [0, size): split in one job per thread, or in the calling thread
+            void runColumnJob(DynamicSortJob job, size_t size);
+
+            // stable sort of a key column through key/index pairs P, then the permutation
+            // of the value columns. keys_out and permutation are optional.
+            template <typename K, typename P, typename I>
+            void keyColumnSort(const K* keys, size_t size, K* keys_out, I* permutation,
+                void* const* columns, const size_t* columnElementSize, int columnCount, DynamicSortGather gather);
 
+            // runs the jobs: in the calling thread when there is only one
+            void runJobs(const DynamicSortJob* jobs, int count);
 
-            void bucket_IndexInt32(IndexInt32* A, uint32_t size, DynamicSortAlgorithm algorithm);
-            void counting_IndexInt32(IndexInt32* A, uint32_t size, DynamicSortAlgorithm algorithm);
-            void merge_IndexInt32(IndexInt32* A, uint32_t size, DynamicSortAlgorithm algorithm);
+            // radix key (xor mask) of the element of rank in A
+            template <typename T>
+            uint64_t selectThreshold(const T* A, size_t size, size_t rank, uint64_t mask, int parts);
 
-            void bucket_IndexUInt32(IndexUInt32* A, uint32_t size, DynamicSortAlgorithm algorithm);
-            void counting_IndexUInt32(IndexUInt32* A, uint32_t size, DynamicSortAlgorithm algorithm);
-            void merge_IndexUInt32(IndexUInt32* A, uint32_t size, DynamicSortAlgorithm algorithm);
+            // three way partition of A to out by the threshold (stable):
+            //   the elements equal to the threshold are kept up to the position equalEnd,
+            //   and the greater ones are kept when keepGreater is true.
+            // less/equal receive the counts of the partition.
+            template <typename T>
+            void selectPartition(const T* A, size_t size, uint64_t threshold, uint64_t mask, int parts,
+                size_t equalEnd, bool keepGreater, T* out, size_t* less, size_t* equal);
+
+            // resolves the auto gather/algorithm. Returns false when A is already sorted.
+            template <typename T>
+            bool chooseAuto(const T* A, size_t size, DynamicSortGather* gather, DynamicSortAlgorithm* algorithm);
 
         public:
             
-            DynamicSort(ThreadPool* _threadPool, uint32_t useMultithreadStartingAtCount = 64*1024);//64k
+            DynamicSort(ThreadPool* _threadPool, size_t useMultithreadStartingAtCount = 64*1024);//64k
             ~DynamicSort();
 
-            void sort_int32_t(int32_t* A, uint32_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
-            void sort_uint32_t(uint32_t* A, uint32_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+            // huge pages / NUMA node of the auxiliary buffer (see PlatformMemory)
+            void setMemoryPolicy(PlatformMemoryPolicy policy, int numaNode = -1);
+
+            // Loads the calibration file, or measures the machine (about 1 to 3 seconds,
+            // holding the lock of this DynamicSort) and saves the file.
+            // force: measure even when the file is valid.
+            // The auto mode uses the built-in estimates until this method is called.
+            void calibrate(bool force = false);
+
+            // Default: PlatformPath::getDocumentsPath("aribeiro", "sort") + "/dynamic_sort_<threads>.cfg"
+            // An empty name keeps the calibration only in memory.
+            void setCalibrationFile(const std::string& filename);
+            // the table used by the auto mode: the measures, or the built-in estimates (valid == false)
+            const DynamicSortCalibration& getCalibration() const;
+
+            // Sort any element type with SortKeyTraits (instantiated for the types listed above).
+            template <typename T>
+            void sort(T* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+
+            void sort_int32_t(int32_t* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+            void sort_uint32_t(uint32_t* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+
+            void sort_IndexInt32(IndexInt32* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+            void sort_IndexUInt32(IndexUInt32* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+
+            void sort_int64_t(int64_t* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+            void sort_uint64_t(uint64_t* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+            void sort_float(float* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+            void sort_double(double* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+
+            void sort_IndexInt64(IndexInt64* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+            void sort_IndexUInt64(IndexUInt64* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+            void sort_IndexFloat(IndexFloat* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+            void sort_IndexDouble(IndexDouble* A, size_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+
+            //
+            // Key columns (structure of arrays): K is int32_t, uint32_t, int64_t, uint64_t, float or double.
+            //
+            // The keys are copied to key/index pairs (8 bytes pairs for the 32 bits keys),
+            // the pairs are sorted with radix_counting (stable), and the value columns are
+            // permuted by the index. The radix passes move only the keys and the indexes.
+            //
+
+            // permutation[i] is the position in keys of the i-th smallest key (stable).
+            // I: uint32_t (up to 4G elements) or uint64_t. The keys are not changed.
+            template <typename K, typename I>
+            void argsort(const K* keys, size_t size, I* permutation, DynamicSortGather gather = DynamicSortGather_counting);
+
+            // Sorts the keys, and moves the elements of each column to the position of their key.
+            // columns[c] has size elements with columnElementSize[c] bytes.
+            template <typename K>
+            void sortByKeyColumns(K* keys, size_t size, void* const* columns, const size_t* columnElementSize, int columnCount, DynamicSortGather gather = DynamicSortGather_counting);
+
+            //
+            // Selection: radix select with one histogram per thread (AlgorithmsSelect.h),
+            // or one heap per thread for the topK of a small k.
+            // Any element type with SortKeyTraits.
+            //
+
+            // out receives the k smallest elements sorted (largest: the k biggest, from the biggest).
+            // The elements with the same key keep their order. A is not changed.
+            template <typename T>
+            void topK(const T* A, size_t size, size_t k, T* out, bool largest = false);
+
+            // A[0, k) receives the k smallest elements sorted (stable),
+            // the order of the other elements is not specified (std::partial_sort).
+            template <typename T>
+            void partialSort(T* A, size_t size, size_t k);
 
-            void sort_IndexInt32(IndexInt32* A, uint32_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
-            void sort_IndexUInt32(IndexUInt32* A, uint32_t size, DynamicSortGather gather = DynamicSortGather_counting, DynamicSortAlgorithm algorithm = DynamicSortAlgorithm_radix_counting);
+            // A[nth] receives the element of the position nth of the sorted array,
+            // the elements before are not greater and the elements after are not less (std::nth_element).
+            template <typename T>
+            void nthElement(T* A, size_t size, size_t nth);
 
+            // sortByKey(keys, size, values_a, values_b, ...): any number of value columns
+            template <typename K, typename... V>
+            void sortByKey(K* keys, size_t size, V*... values) {
+                void* columns[] = { (void*)values..., NULL };
+                size_t columnElementSize[] = { sizeof(V)..., 0 };
+                sortByKeyColumns(keys, size, columns, columnElementSize, (int)sizeof...(V));
+            }
 
         };
     }
@@ -0,0 +1,223 @@
+#ifndef __memory_arena__H__
+#define __memory_arena__H__
+
+#include <aRibeiroCore/common.h>
+#include <aRibeiroPlatform/PlatformMemory.h>
+#include <vector>
+
+namespace aRibeiro {
+
+    /*
+
+    Chunked bump allocator.
+
+    allocate moves a pointer inside the current chunk. When the chunk is full
+    the arena goes to the next chunk, allocating a new one if needed.
+    There is no per-allocation free: the memory is released all at once with
+    rewind (to a marker) or reset (to the beginning), both O(1).
+
+    The chunks are kept after a rewind/reset, so a per-frame or per-request
+    arena stops allocating after the first iterations. A free chunk that is
+    too small for a request is replaced by a bigger one.
+
+    The default alignment is 32 bytes (the same of ObjectBuffer), 64 bytes
+    can be requested for cache line aligned data.
+
+    The arena is not thread safe. Use MemoryArena::threadArena() to get
+    an arena owned by the current thread.
+
+    Arenas with large chunks can use huge pages and NUMA placement
+    (setMemoryPolicy), applied to the chunks allocated after the call.
+
+    Example of use
+
+#include <aRibeiroPlatform/aRibeiroPlatform.h>
+using namespace aRibeiro;
+
+MemoryArena arena;
+
+void frame() {
+    MemoryArenaScope scope(&arena);
+
+    float* vertices = arena.allocateArray<float>(1024);
+    uint8_t* line = (uint8_t*)arena.allocate(4096, 64);
+    ...
+} // everything allocated in the frame is released here
+
+    */
+
+    struct MemoryArenaMarker {
+        size_t chunk;
+        size_t offset;
+    };
+
+    class MemoryArena {
+
+        struct Chunk {
+            uint8_t* data;
+            size_t size;
+            // PlatformMemory::release parameter (0: malloc_aligned)
+            size_t mapped_size;
+        };
+
+        std::vector<Chunk> chunks;
+        size_t current;
+        size_t offset;
+
+        size_t chunkSize;
+        size_t defaultAlign;
+
+        PlatformMemoryPolicy memoryPolicy;
+        int numaNode;
+
+        //private copy constructores, to avoid copy...
+        MemoryArena(const MemoryArena& v) {}
+        void operator=(const MemoryArena& v) {}
+
+        static size_t alignOffset(uintptr_t address, size_t align) {
+            return (size_t)(((address + (align - 1)) & ~(uintptr_t)(align - 1)) - address);
+        }
+
+        void newChunk(size_t index, size_t size) {
+            Chunk chunk;
+            chunk.size = (size > chunkSize) ? size : chunkSize;
+            chunk.data = (uint8_t*)PlatformMemory::allocate(chunk.size, memoryPolicy, numaNode, &chunk.mapped_size);
+            ARIBEIRO_ABORT(chunk.data == NULL, "MemoryArena: out of memory.\n");
+            if (index < chunks.size()) {
+                // the chunk is empty (the ones after the current are free): replace the small one
+                PlatformMemory::release(chunks[index].data, chunks[index].mapped_size);
+                chunks[index] = chunk;
+            }
+            else
+                chunks.push_back(chunk);
+        }
+
+    public:
+
+        // chunkSize: minimum size of each chunk
+        // align: alignment used when allocate is called with align = 0
+        MemoryArena(size_t chunkSize = 64 * 1024, size_t align = 32) {
+            ARIBEIRO_ABORT((align & (align - 1)) != 0 || align > 64, "MemoryArena: alignment must be power of two up to 64.\n");
+            this->chunkSize = chunkSize;
+            this->defaultAlign = align;
+            memoryPolicy = PlatformMemoryPolicy_Default;
+            numaNode = -1;
+            current = 0;
+            offset = 0;
+        }
+
+        virtual ~MemoryArena() {
+            release();
+        }
+
+        // huge pages and NUMA node (-1: any node) of the chunks allocated from now on
+        void setMemoryPolicy(PlatformMemoryPolicy policy, int numaNode = -1) {
+            memoryPolicy = policy;
+            this->numaNode = numaNode;
+        }
+
+        // align = 0 uses the arena default alignment
+        void* allocate(size_t size, size_t align = 0) {
+            if (align == 0)
+                align = defaultAlign;
+            ARIBEIRO_ABORT((align & (align - 1)) != 0 || align > 64, "MemoryArena: alignment must be power of two up to 64.\n");
+
+            if (current < chunks.size()) {
+                Chunk& chunk = chunks[current];
+                size_t padding = alignOffset((uintptr_t)(chunk.data + offset), align);
+                if (offset + padding + size <= chunk.size) {
+                    uint8_t* result = chunk.data + offset + padding;
+                    offset += padding + size;
+                    return result;
+                }
+                // an empty chunk is replaced by a bigger one, otherwise go to the next chunk
+                if (offset > 0)
+                    current++;
+            }
+
+            // the chunks are 64 bytes aligned, so the allocation starts at offset 0
+            if (current >= chunks.size() || chunks[current].size < size)
+                newChunk(current, size);
+
+            offset = size;
+            return chunks[current].data;
+        }
+
+        template <typename T>
+        T* allocateArray(size_t count, size_t align = 0) {
+            return (T*)allocate(sizeof(T) * count, align);
+        }
+
+        MemoryArenaMarker getMarker() const {
+            MemoryArenaMarker marker;
+            marker.chunk = current;
+            marker.offset = offset;
+            return marker;
+        }
+
+        // release everything allocated after the marker
+        void rewind(const MemoryArenaMarker& marker) {
+            current = marker.chunk;
+            offset = marker.offset;
+        }
+
+        // release everything, keeping the chunks
+        void reset() {
+            current = 0;
+            offset = 0;
+        }
+
+        // release everything and free the chunks
+        void release() {
+            for (size_t i = 0; i < chunks.size(); i++)
+                PlatformMemory::release(chunks[i].data, chunks[i].mapped_size);
+            chunks.clear();
+            reset();
+        }
+
+        // approximated bytes in use (the skipped end of the chunks counts as used)
+        size_t getUsedSize() const {
+            size_t result = offset;
+            for (size_t i = 0; i < current && i < chunks.size(); i++)
+                result += chunks[i].size;
+            return result;
+        }
+
+        // bytes allocated from the system
+        size_t getCapacity() const {
+            size_t result = 0;
+            for (size_t i = 0; i < chunks.size(); i++)
+                result += chunks[i].size;
+            return result;
+        }
+
+        // arena owned by the current thread
+        static MemoryArena* threadArena() {
+            static thread_local MemoryArena arena;
+            return &arena;
+        }
+    };
+
+    // Rewind the arena to the position it had in the scope creation.
+    class MemoryArenaScope {
+        MemoryArena* arena;
+        MemoryArenaMarker marker;
+
+        //private copy constructores, to avoid copy...
+        MemoryArenaScope(const MemoryArenaScope& v) {}
+        void operator=(const MemoryArenaScope& v) {}
+
+    public:
+        MemoryArenaScope(MemoryArena* arena) {
+            this->arena = arena;
+            marker = arena->getMarker();
+        }
+
+        ~MemoryArenaScope() {
+            arena->rewind(marker);
+        }
+    };
+
+}
+
+#endif
@@ -7,12 +7,26 @@
 #include <aRibeiroCore/common.h>
 #include <aRibeiroPlatform/PlatformMutex.h>
 #include <aRibeiroPlatform/PlatformAutoLock.h>
+#include <aRibeiroPlatform/ObjectBufferPool.h>
+#include <aRibeiroPlatform/PlatformMemory.h>
 
 namespace aRibeiro {
 
     //
     // This Object Buffer have the default align to 32 bytes
     //   supporting 256 bits instructions ( All SSE and AVX/AVX2 ).
+    //
+    // The allocation grows geometrically (growth_factor, 1.5x by default),
+    //   so a sequence of slowly growing setSize calls does O(log n) reallocations.
+    //   The content is kept when the buffer grows.
+    //
+    // A buffer owned by a single thread can be created with
+    //   ObjectBuffer(false) to skip the mutex in all calls.
+    //
+    // With a pool (ObjectBuffer(true, ObjectBufferPool::Instance()) or setPool)
+    //   the memory is borrowed from the pool and returned to it on free.
+    //
+    // Large buffers can use huge pages and NUMA placement (setMemoryPolicy).
     //
 	class ObjectBuffer {
 
@@ -21,22 +35,97 @@ namespace aRibeiro {
         void operator=(const ObjectBuffer& v){}
 
 		bool constructed_from_external_buffer;
+		bool thread_safe;
 		PlatformMutex mutex;
+
+		ObjectBufferPool *pool;
+		// pool that owns the current data (NULL: malloc_aligned)
+		ObjectBufferPool *data_pool;
+
+		PlatformMemoryPolicy memory_policy;
+		int numa_node;
+		// the current data comes from PlatformMemory::allocate
+		bool data_from_platform_memory;
+		size_t data_mapped_size;
+
+		void releaseData() {
+			if (!constructed_from_external_buffer && data != NULL) {
+				if (data_from_platform_memory)
+					PlatformMemory::release(data, data_mapped_size);
+				else if (data_pool != NULL)
+					data_pool->release(data, alloc_size);
+				else
+					free_aligned(data);
+			}
+			data_pool = NULL;
+			data_from_platform_memory = false;
+			data_mapped_size = 0;
+		}
+
+		PlatformMutex* lockMutex() {
+			return (thread_safe) ? &mutex : NULL;
+		}
+
+		// reallocate keeping the first 'size' bytes
+		void reallocate(uint32_t _alloc_size, int _align) {
+			uint8_t *new_data = NULL;
+			ObjectBufferPool *new_data_pool = NULL;
+			bool new_from_platform_memory = false;
+			size_t new_mapped_size = 0;
+			uint32_t new_alloc_size = _alloc_size;
+			if (_alloc_size > 0) {
+				// the PlatformMemory and the pool blocks are 64 bytes aligned
+				if ((memory_policy != PlatformMemoryPolicy_Default || numa_node >= 0) && _align <= 64) {
+					new_data = (uint8_t*)PlatformMemory::allocate(_alloc_size, memory_policy, numa_node, &new_mapped_size);
+					new_from_platform_memory = true;
+				}
+				else if (pool != NULL && _align <= 64) {
+					new_data = pool->allocate(_alloc_size, &new_alloc_size);
+					new_data_pool = pool;
+				}
+				else
+					new_data = (uint8_t*)malloc_aligned(_alloc_size, _align);
+				ARIBEIRO_ABORT(new_data == NULL, "ObjectBuffer: out of memory.\n");
+				uint32_t keep = (size < _alloc_size) ? size : _alloc_size;
+				if (keep > 0 && data != NULL)
+					memcpy(new_data, data, keep);
+			}
+			releaseData();
+			data = new_data;
+			data_pool = new_data_pool;
+			data_from_platform_memory = new_from_platform_memory;
+			data_mapped_size = new_mapped_size;
+			alloc_size = new_alloc_size;
+			align = _align;
+			constructed_from_external_buffer = false;
+		}
+
 	public:
 		uint8_t *data;
 		uint32_t alloc_size;
 		uint32_t size;
         int align;
+        float growth_factor;
 
 		ObjectBuffer(uint8_t *_data, uint32_t _size, int _align = 32) {
 			data = _data;
 			size = _size;
             align = _align;
 			alloc_size = 0;
+            growth_factor = 1.5f;
 			constructed_from_external_buffer = true;
+			thread_safe = true;
+			pool = NULL;
+			data_pool = NULL;
+			memory_policy = PlatformMemoryPolicy_Default;
+			numa_node = -1;
+			data_from_platform_memory = false;
+			data_mapped_size = 0;
 		}
 
-		ObjectBuffer() {
+		// thread_safe = false: the buffer is used by one thread only (no locking)
+		// pool: borrow the memory from a pool (NULL: malloc_aligned)
+		ObjectBuffer(bool thread_safe = true, ObjectBufferPool *pool = NULL) {
 			
 			//printf("ObjectBuffer()\n");
 
@@ -44,7 +133,15 @@ namespace aRibeiro {
 			size = 0;
 			alloc_size = 0;
             align = 32;
+            growth_factor = 1.5f;
 			constructed_from_external_buffer = false;
+			this->thread_safe = thread_safe;
+			this->pool = pool;
+			data_pool = NULL;
+			memory_policy = PlatformMemoryPolicy_Default;
+			numa_node = -1;
+			data_from_platform_memory = false;
+			data_mapped_size = 0;
 		}
 
 		virtual ~ObjectBuffer() {
@@ -52,18 +149,63 @@ namespace aRibeiro {
 			free();
 		}
 
+		// 1.0 allocates the exact size, 2.0 doubles the allocation on each growth
+		void setGrowthFactor(float factor) {
+			ARIBEIRO_ABORT(factor < 1.0f, "ObjectBuffer: growth factor must be >= 1.0.\n");
+			growth_factor = factor;
+		}
+
+		// the next allocations use the pool (the current data is kept until it needs to grow)
+		void setPool(ObjectBufferPool *pool) {
+			PlatformAutoLock autoLock(lockMutex());
+			this->pool = pool;
+		}
+
+		ObjectBufferPool* getPool() const {
+			return pool;
+		}
+
+		// the next allocations use huge pages and/or are placed in a NUMA node (-1: any node)
+		// (the current data is kept until it needs to grow)
+		void setMemoryPolicy(PlatformMemoryPolicy policy, int numa_node = -1) {
+			PlatformAutoLock autoLock(lockMutex());
+			memory_policy = policy;
+			this->numa_node = numa_node;
+		}
+
+		bool isThreadSafe() const {
+			return thread_safe;
+		}
+
+		// allocate at least _alloc_size bytes, keeping the content
+		// (the allocation and the alignment never go below the current ones)
+		ObjectBuffer* reserve(uint32_t _alloc_size, int _align = 32) {
+			PlatformAutoLock autoLock(lockMutex());
+			uint32_t new_alloc_size = _alloc_size;
+			if (new_alloc_size < alloc_size)
+				new_alloc_size = alloc_size;
+			if (new_alloc_size < size)
+				new_alloc_size = size;
+			int new_align = (_align > align) ? _align : align;
+			if (_alloc_size > alloc_size || (_align > align && new_alloc_size > 0)) {
+				reallocate(new_alloc_size, new_align);
+				ARIBEIRO_ABORT(alloc_size < size, "ObjectBuffer: reserve allocated less than the size.\n");
+			}
+			return this;
+		}
+
 		ObjectBuffer* setSize(uint32_t _size, int _align = 32) {
-			PlatformAutoLock autoLock(&mutex);
+			PlatformAutoLock autoLock(lockMutex());
 			
-			if (_size == size)
+			if (_size == size && _align <= align)
 				return this;
 			
-			if (_size > alloc_size) {
-				free();
-				data = (uint8_t*)malloc_aligned(_size, _align);
-				alloc_size = _size;
-                align = _align;
-				//constructed_from_external_buffer = false;
+			if (_size > alloc_size || _align > align) {
+				uint64_t grow = (uint64_t)((double)alloc_size * (double)growth_factor);
+				if (grow > 0xffffffffu)
+					grow = 0xffffffffu;
+				uint32_t new_alloc_size = ((uint64_t)_size > grow) ? _size : (uint32_t)grow;
+				reallocate(new_alloc_size, (_align > align) ? _align : align);
 			}
 
 			size = _size;
@@ -71,8 +213,27 @@ namespace aRibeiro {
 			return this;
 		}
 
+		// release the memory not used by the current size
+		ObjectBuffer* shrinkToFit() {
+			PlatformAutoLock autoLock(lockMutex());
+			if (constructed_from_external_buffer || alloc_size <= size)
+				return this;
+			// the pool has no smaller block for this size
+			if (data_pool != NULL && pool == data_pool && size > 0) {
+				int size_class = ObjectBufferPool::sizeClass(size);
+				if (size_class >= 0 && ObjectBufferPool::classSize(size_class) == alloc_size)
+					return this;
+			}
+			reallocate(size, align);
+			return this;
+		}
+
         ObjectBuffer* copy(const ObjectBuffer* src) {
-			PlatformAutoLock autoLock(&mutex);
+            if (src == this)
+                return this;
+			PlatformAutoLock autoLock(lockMutex());
+            // the old content is overwritten, avoid copying it in the growth
+            size = 0;
             setSize(src->size, src->align);
             memcpy(data, src->data,size);
 
@@ -82,10 +243,8 @@ namespace aRibeiro {
 		ObjectBuffer* free() {
 
 			//printf("ObjectBuffer* free()\n");
-			PlatformAutoLock autoLock(&mutex);
-			if (!constructed_from_external_buffer && data != NULL) {
-				free_aligned(data);
-			}
+			PlatformAutoLock autoLock(lockMutex());
+			releaseData();
 
 			data = NULL;
 			size = 0;
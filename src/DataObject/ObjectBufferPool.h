@@ -0,0 +1,410 @@
+#ifndef __object_buffer_pool__H__
+#define __object_buffer_pool__H__
+
+#include <aRibeiroCore/common.h>
+#include <aRibeiroPlatform/PlatformMutex.h>
+#include <aRibeiroPlatform/PlatformAutoLock.h>
+#include <vector>
+#include <map>
+#include <atomic>
+
+namespace aRibeiro {
+
+    struct ObjectBufferPoolStats {
+        uint64_t allocations;
+        uint64_t releases;
+        // allocations served by the thread cache of the calling thread
+        uint64_t threadCacheHits;
+        // allocations served by the shared free lists
+        uint64_t sharedHits;
+        // allocations that called malloc_aligned
+        uint64_t systemAllocations;
+        // released blocks that called free_aligned
+        uint64_t systemFrees;
+
+        // bytes borrowed and not returned yet
+        size_t bytesInUse;
+        size_t peakBytesInUse;
+        // free bytes kept by the pool (shared lists and thread caches)
+        size_t cachedBytes;
+    };
+
+    /*
+
+    Pool of aligned memory blocks grouped in power of two size classes.
+
+    The allocate rounds the size up to the next power of two (minimum 64 bytes)
+    and returns a released block of the same class if there is one.
+    Blocks bigger than the largest class (64MB) are not cached.
+
+    Each thread keeps a few free blocks of the small classes (up to 64KB),
+    so most allocate/release calls of small messages do not lock the pool.
+    The cache of a thread that exits returns to the shared lists.
+
+    The blocks are 64 bytes aligned.
+
+    Example of use
+
+#include <aRibeiroPlatform/aRibeiroPlatform.h>
+using namespace aRibeiro;
+
+uint32_t alloc_size;
+uint8_t* data = ObjectBufferPool::Instance()->allocate(1500, &alloc_size);
+...
+ObjectBufferPool::Instance()->release(data, alloc_size);
+
+ObjectBufferPoolStats stats = ObjectBufferPool::Instance()->getStats();
+printf("in use: %u bytes\n", (uint32_t)stats.bytesInUse);
+
+    */
+
+    class ObjectBufferPool {
+
+    public:
+        static const int MIN_CLASS_SHIFT = 6; // 64 bytes
+        static const int MAX_CLASS_SHIFT = 26; // 64 MB
+        static const int CLASS_COUNT = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+
+        // classes cached by each thread: 64 bytes up to 64 KB
+        static const int THREAD_CLASS_COUNT = 16 - MIN_CLASS_SHIFT + 1;
+        static const uint32_t THREAD_CACHE_SIZE = 8;
+
+    private:
+
+        struct ThreadBlocks {
+            uint64_t pool_id;
+            uint32_t count[THREAD_CLASS_COUNT];
+            uint8_t* blocks[THREAD_CLASS_COUNT][THREAD_CACHE_SIZE];
+        };
+
+        // live pools, used to return the caches of the threads that exit
+        struct Registry {
+            aRibeiro::PlatformMutex mutex;
+            std::map<uint64_t, ObjectBufferPool*> pools;
+            uint64_t next_id;
+
+            Registry() {
+                next_id = 1;
+            }
+        };
+
+        struct ThreadCache {
+            std::vector<ThreadBlocks*> caches;
+            ThreadBlocks* last;
+
+            ThreadCache() {
+                last = NULL;
+            }
+
+            ~ThreadCache() {
+                Registry& reg = registry();
+                PlatformAutoLock autoLock(&reg.mutex);
+                for (size_t i = 0; i < caches.size(); i++) {
+                    ThreadBlocks* cache = caches[i];
+                    std::map<uint64_t, ObjectBufferPool*>::iterator it = reg.pools.find(cache->pool_id);
+                    for (int c = 0; c < THREAD_CLASS_COUNT; c++) {
+                        if (it != reg.pools.end())
+                            it->second->sharedPush(c, cache->blocks[c], cache->count[c]);
+                        else
+                            freeBlocks(cache->blocks[c], cache->count[c]);
+                    }
+                    delete cache;
+                }
+                caches.clear();
+            }
+        };
+
+        static Registry& registry() {
+            static Registry reg;
+            return reg;
+        }
+
+        static ThreadCache& threadCache() {
+            static thread_local ThreadCache cache;
+            return cache;
+        }
+
+        static void freeBlocks(uint8_t** blocks, uint32_t count) {
+            for (uint32_t i = 0; i < count; i++)
+                free_aligned(blocks[i]);
+        }
+
+        uint64_t pool_id;
+        PlatformMutex mutex;
+        std::vector<uint8_t*> free_blocks[CLASS_COUNT];
+        size_t shared_cached_bytes;
+        size_t max_cached_bytes;
+
+        std::atomic<uint64_t> stat_allocations;
+        std::atomic<uint64_t> stat_releases;
+        std::atomic<uint64_t> stat_thread_hits;
+        std::atomic<uint64_t> stat_shared_hits;
+        std::atomic<uint64_t> stat_system_allocations;
+        std::atomic<uint64_t> stat_system_frees;
+        std::atomic<size_t> stat_bytes_in_use;
+        std::atomic<size_t> stat_peak_bytes_in_use;
+        std::atomic<size_t> stat_thread_cached_bytes;
+
+        //private copy constructores, to avoid copy...
+        ObjectBufferPool(const ObjectBufferPool& v) {}
+        void operator=(const ObjectBufferPool& v) {}
+
+        ThreadBlocks* getThreadBlocks() {
+            ThreadCache& cache = threadCache();
+            if (cache.last != NULL && cache.last->pool_id == pool_id)
+                return cache.last;
+
+            for (size_t i = 0; i < cache.caches.size(); i++) {
+                if (cache.caches[i]->pool_id == pool_id) {
+                    cache.last = cache.caches[i];
+                    return cache.last;
+                }
+            }
+
+            // first use of this pool in this thread: free the caches of the deleted pools
+            {
+                Registry& reg = registry();
+                PlatformAutoLock autoLock(&reg.mutex);
+                for (size_t i = 0; i < cache.caches.size();) {
+                    if (reg.pools.find(cache.caches[i]->pool_id) == reg.pools.end()) {
+                        for (int c = 0; c < THREAD_CLASS_COUNT; c++)
+                            freeBlocks(cache.caches[i]->blocks[c], cache.caches[i]->count[c]);
+                        delete cache.caches[i];
+                        cache.caches[i] = cache.caches.back();
+                        cache.caches.pop_back();
+                    }
+                    else
+                        i++;
+                }
+            }
+
+            ThreadBlocks* blocks = new ThreadBlocks();
+            blocks->pool_id = pool_id;
+            for (int c = 0; c < THREAD_CLASS_COUNT; c++)
+                blocks->count[c] = 0;
+            cache.caches.push_back(blocks);
+            cache.last = blocks;
+            return blocks;
+        }
+
+        // move blocks to the shared list, freeing the ones above the cache limit
+        void sharedPush(int size_class, uint8_t** blocks, uint32_t count) {
+            if (count == 0)
+                return;
+            size_t block_size = classSize(size_class);
+            stat_thread_cached_bytes.fetch_sub(block_size * count, std::memory_order_relaxed);
+            PlatformAutoLock autoLock(&mutex);
+            for (uint32_t i = 0; i < count; i++) {
+                if (shared_cached_bytes + block_size <= max_cached_bytes) {
+                    free_blocks[size_class].push_back(blocks[i]);
+                    shared_cached_bytes += block_size;
+                }
+                else {
+                    free_aligned(blocks[i]);
+                    stat_system_frees.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        uint8_t* sharedPop(int size_class) {
+            PlatformAutoLock autoLock(&mutex);
+            std::vector<uint8_t*> &list = free_blocks[size_class];
+            if (list.size() == 0)
+                return NULL;
+            uint8_t* result = list.back();
+            list.pop_back();
+            shared_cached_bytes -= classSize(size_class);
+            return result;
+        }
+
+        uint8_t* systemAllocate(uint32_t size) {
+            uint8_t* result = (uint8_t*)malloc_aligned(size, 64);
+            ARIBEIRO_ABORT(result == NULL, "ObjectBufferPool: out of memory.\n");
+            stat_system_allocations.fetch_add(1, std::memory_order_relaxed);
+            return result;
+        }
+
+        void addInUse(size_t size) {
+            size_t in_use = stat_bytes_in_use.fetch_add(size, std::memory_order_relaxed) + size;
+            size_t peak = stat_peak_bytes_in_use.load(std::memory_order_relaxed);
+            while (in_use > peak && !stat_peak_bytes_in_use.compare_exchange_weak(peak, in_use, std::memory_order_relaxed));
+        }
+
+        void trimShared() {
+            PlatformAutoLock autoLock(&mutex);
+            for (int i = 0; i < CLASS_COUNT; i++) {
+                for (size_t j = 0; j < free_blocks[i].size(); j++)
+                    free_aligned(free_blocks[i][j]);
+                stat_system_frees.fetch_add(free_blocks[i].size(), std::memory_order_relaxed);
+                free_blocks[i].clear();
+            }
+            shared_cached_bytes = 0;
+        }
+
+    public:
+
+        // returns -1 if the size is bigger than the largest class
+        static int sizeClass(uint32_t size) {
+            int shift = MIN_CLASS_SHIFT;
+            while (shift <= MAX_CLASS_SHIFT && ((uint32_t)1 << shift) < size)
+                shift++;
+            if (shift > MAX_CLASS_SHIFT)
+                return -1;
+            return shift - MIN_CLASS_SHIFT;
+        }
+
+        static uint32_t classSize(int size_class) {
+            return (uint32_t)1 << (size_class + MIN_CLASS_SHIFT);
+        }
+
+        // max_cached_bytes: the released blocks above this limit are freed
+        // (the thread caches are not counted)
+        ObjectBufferPool(size_t max_cached_bytes = 256 * 1024 * 1024) {
+            this->max_cached_bytes = max_cached_bytes;
+            shared_cached_bytes = 0;
+
+            stat_allocations = 0;
+            stat_releases = 0;
+            stat_thread_hits = 0;
+            stat_shared_hits = 0;
+            stat_system_allocations = 0;
+            stat_system_frees = 0;
+            stat_bytes_in_use = 0;
+            stat_peak_bytes_in_use = 0;
+            stat_thread_cached_bytes = 0;
+
+            Registry& reg = registry();
+            PlatformAutoLock autoLock(&reg.mutex);
+            pool_id = reg.next_id++;
+            reg.pools[pool_id] = this;
+        }
+
+        virtual ~ObjectBufferPool() {
+            {
+                // the thread caches of this pool are freed by their threads from now on
+                // (on thread exit or on the first use of another pool)
+                Registry& reg = registry();
+                PlatformAutoLock autoLock(&reg.mutex);
+                reg.pools.erase(pool_id);
+            }
+            trimShared();
+        }
+
+        // alloc_size receives the real size of the block, that must be passed to release
+        uint8_t* allocate(uint32_t size, uint32_t *alloc_size) {
+            stat_allocations.fetch_add(1, std::memory_order_relaxed);
+
+            int size_class = sizeClass(size);
+            if (size_class < 0) {
+                *alloc_size = size;
+                addInUse(size);
+                return systemAllocate(size);
+            }
+
+            *alloc_size = classSize(size_class);
+            addInUse(*alloc_size);
+
+            if (size_class < THREAD_CLASS_COUNT) {
+                ThreadBlocks* cache = getThreadBlocks();
+                if (cache->count[size_class] > 0) {
+                    stat_thread_hits.fetch_add(1, std::memory_order_relaxed);
+                    stat_thread_cached_bytes.fetch_sub(*alloc_size, std::memory_order_relaxed);
+                    return cache->blocks[size_class][--cache->count[size_class]];
+                }
+            }
+
+            uint8_t* result = sharedPop(size_class);
+            if (result != NULL) {
+                stat_shared_hits.fetch_add(1, std::memory_order_relaxed);
+                return result;
+            }
+
+            return systemAllocate(*alloc_size);
+        }
+
+        void release(uint8_t* data, uint32_t alloc_size) {
+            if (data == NULL)
+                return;
+            stat_releases.fetch_add(1, std::memory_order_relaxed);
+            stat_bytes_in_use.fetch_sub(alloc_size, std::memory_order_relaxed);
+
+            int size_class = sizeClass(alloc_size);
+            if (size_class < 0 || classSize(size_class) != alloc_size) {
+                free_aligned(data);
+                stat_system_frees.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            stat_thread_cached_bytes.fetch_add(alloc_size, std::memory_order_relaxed);
+
+            if (size_class < THREAD_CLASS_COUNT) {
+                ThreadBlocks* cache = getThreadBlocks();
+                uint32_t &count = cache->count[size_class];
+                if (count == THREAD_CACHE_SIZE) {
+                    // move half of the cache to the shared list
+                    count -= THREAD_CACHE_SIZE / 2;
+                    sharedPush(size_class, &cache->blocks[size_class][count], THREAD_CACHE_SIZE / 2);
+                }
+                cache->blocks[size_class][count++] = data;
+                return;
+            }
+
+            sharedPush(size_class, &data, 1);
+        }
+
+        // free the blocks of the shared lists and of the current thread cache
+        void trim() {
+            ThreadBlocks* cache = NULL;
+            {
+                ThreadCache& thread_cache = threadCache();
+                for (size_t i = 0; i < thread_cache.caches.size(); i++)
+                    if (thread_cache.caches[i]->pool_id == pool_id)
+                        cache = thread_cache.caches[i];
+            }
+            if (cache != NULL) {
+                for (int c = 0; c < THREAD_CLASS_COUNT; c++) {
+                    freeBlocks(cache->blocks[c], cache->count[c]);
+                    stat_system_frees.fetch_add(cache->count[c], std::memory_order_relaxed);
+                    stat_thread_cached_bytes.fetch_sub((size_t)classSize(c) * cache->count[c], std::memory_order_relaxed);
+                    cache->count[c] = 0;
+                }
+            }
+
+            trimShared();
+        }
+
+        void setMaxCachedBytes(size_t max_cached_bytes) {
+            PlatformAutoLock autoLock(&mutex);
+            this->max_cached_bytes = max_cached_bytes;
+        }
+
+        size_t getCachedBytes() {
+            PlatformAutoLock autoLock(&mutex);
+            return shared_cached_bytes + stat_thread_cached_bytes.load(std::memory_order_relaxed);
+        }
+
+        // the counters are updated with relaxed atomics,
+        // the values are approximated while other threads use the pool
+        ObjectBufferPoolStats getStats() {
+            ObjectBufferPoolStats result;
+            result.allocations = stat_allocations.load(std::memory_order_relaxed);
+            result.releases = stat_releases.load(std::memory_order_relaxed);
+            result.threadCacheHits = stat_thread_hits.load(std::memory_order_relaxed);
+            result.sharedHits = stat_shared_hits.load(std::memory_order_relaxed);
+            result.systemAllocations = stat_system_allocations.load(std::memory_order_relaxed);
+            result.systemFrees = stat_system_frees.load(std::memory_order_relaxed);
+            result.bytesInUse = stat_bytes_in_use.load(std::memory_order_relaxed);
+            result.peakBytesInUse = stat_peak_bytes_in_use.load(std::memory_order_relaxed);
+            result.cachedBytes = getCachedBytes();
+            return result;
+        }
+
+        static ObjectBufferPool *Instance() {
+            static ObjectBufferPool result;
+            return &result;
+        }
+    };
+
+}
+
+#endif
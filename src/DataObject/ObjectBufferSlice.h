@@ -0,0 +1,214 @@
+#ifndef __object_buffer_slice__H__
+#define __object_buffer_slice__H__
+
+#include <aRibeiroCore/common.h>
+#include <aRibeiroPlatform/ObjectBuffer.h>
+#include <aRibeiroPlatform/ObjectBufferPool.h>
+#include <atomic>
+#include <new>
+
+namespace aRibeiro {
+
+    /*
+
+    Reference counted view of a shared buffer.
+
+    Copying a slice only increments the reference count of the buffer,
+    so a payload can be passed between threads and queues without copying
+    its content. The slice(offset, length) creates a view of a part of the
+    buffer that shares the same memory.
+
+    When the last slice is released, the memory returns to the
+    ObjectBufferPool it came from.
+
+    The reference count is thread safe, the content is not: fill the buffer
+    before sharing it.
+
+    Example of use
+
+#include <aRibeiroPlatform/aRibeiroPlatform.h>
+using namespace aRibeiro;
+
+ObjectQueue<ObjectBufferSlice> queue;
+
+void reader() {
+    ObjectBufferSlice packet = ObjectBufferSlice::allocate(64 * 1024);
+    uint32_t received;
+    socket.read_buffer(packet.data(), packet.size(), &received);
+
+    // header and payload share the packet memory
+    queue.enqueue(packet.slice(0, 16));
+    queue.enqueue(packet.slice(16, received - 16));
+}
+
+    */
+
+    class ObjectBufferSlice {
+
+        // control block: a small block of the pool (thread cached), separated from the content,
+        // so the content block is exactly the size class of the requested size
+        struct Header {
+            std::atomic<int32_t> ref_count;
+            uint32_t header_alloc_size;
+            uint32_t alloc_size;
+            uint8_t *block;
+            ObjectBufferPool *pool;
+        };
+
+        Header *header;
+        uint8_t *ptr;
+        uint32_t length;
+
+        void retain() {
+            if (header != NULL)
+                header->ref_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void releaseRef() {
+            if (header != NULL && header->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                ObjectBufferPool *pool = header->pool;
+                uint8_t *block = header->block;
+                uint32_t alloc_size = header->alloc_size;
+                uint32_t header_alloc_size = header->header_alloc_size;
+                header->~Header();
+                pool->release(block, alloc_size);
+                pool->release((uint8_t*)header, header_alloc_size);
+            }
+            header = NULL;
+            ptr = NULL;
+            length = 0;
+        }
+
+    public:
+
+        ObjectBufferSlice() {
+            header = NULL;
+            ptr = NULL;
+            length = 0;
+        }
+
+        ObjectBufferSlice(const ObjectBufferSlice& v) {
+            header = v.header;
+            ptr = v.ptr;
+            length = v.length;
+            retain();
+        }
+
+        ObjectBufferSlice(ObjectBufferSlice&& v) {
+            header = v.header;
+            ptr = v.ptr;
+            length = v.length;
+            v.header = NULL;
+            v.ptr = NULL;
+            v.length = 0;
+        }
+
+        void operator=(const ObjectBufferSlice& v) {
+            if (header == v.header) {
+                ptr = v.ptr;
+                length = v.length;
+                return;
+            }
+            // retain first: v can be a slice owned by this buffer
+            Header *new_header = v.header;
+            uint8_t *new_ptr = v.ptr;
+            uint32_t new_length = v.length;
+            if (new_header != NULL)
+                new_header->ref_count.fetch_add(1, std::memory_order_relaxed);
+            releaseRef();
+            header = new_header;
+            ptr = new_ptr;
+            length = new_length;
+        }
+
+        void operator=(ObjectBufferSlice&& v) {
+            if (this == &v)
+                return;
+            releaseRef();
+            header = v.header;
+            ptr = v.ptr;
+            length = v.length;
+            v.header = NULL;
+            v.ptr = NULL;
+            v.length = 0;
+        }
+
+        ~ObjectBufferSlice() {
+            releaseRef();
+        }
+
+        // new buffer with uninitialized content
+        static ObjectBufferSlice allocate(uint32_t size, ObjectBufferPool *pool = NULL) {
+            if (pool == NULL)
+                pool = ObjectBufferPool::Instance();
+
+            uint32_t header_alloc_size;
+            uint8_t *header_block = pool->allocate((uint32_t)sizeof(Header), &header_alloc_size);
+            uint32_t alloc_size;
+            uint8_t *block = pool->allocate(size, &alloc_size);
+
+            ObjectBufferSlice result;
+            result.header = new (header_block) Header();
+            result.header->ref_count.store(1, std::memory_order_relaxed);
+            result.header->header_alloc_size = header_alloc_size;
+            result.header->alloc_size = alloc_size;
+            result.header->block = block;
+            result.header->pool = pool;
+            result.ptr = block;
+            result.length = size;
+            return result;
+        }
+
+        // new buffer with a copy of the data (the only copy of the payload)
+        static ObjectBufferSlice copyFrom(const uint8_t *data, uint32_t size, ObjectBufferPool *pool = NULL) {
+            ObjectBufferSlice result = allocate(size, pool);
+            if (size > 0)
+                memcpy(result.ptr, data, size);
+            return result;
+        }
+
+        static ObjectBufferSlice copyFrom(const ObjectBuffer &buffer, ObjectBufferPool *pool = NULL) {
+            return copyFrom(buffer.data, buffer.size, pool);
+        }
+
+        // view of a part of this slice, sharing the same memory
+        ObjectBufferSlice slice(uint32_t offset, uint32_t length) const {
+            ARIBEIRO_ABORT((uint64_t)offset + (uint64_t)length > (uint64_t)this->length, "ObjectBufferSlice: slice out of range.\n");
+            ObjectBufferSlice result(*this);
+            result.ptr += offset;
+            result.length = length;
+            return result;
+        }
+
+        uint8_t* data() const {
+            return ptr;
+        }
+
+        uint32_t size() const {
+            return length;
+        }
+
+        bool isNull() const {
+            return header == NULL;
+        }
+
+        // number of slices sharing the buffer
+        int32_t useCount() const {
+            if (header == NULL)
+                return 0;
+            return header->ref_count.load(std::memory_order_acquire);
+        }
+
+        // true if this slice is the only reference to the buffer (safe to write)
+        bool isUnique() const {
+            return useCount() == 1;
+        }
+
+        void reset() {
+            releaseRef();
+        }
+    };
+
+}
+
+#endif
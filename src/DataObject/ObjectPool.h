@@ -2,50 +2,162 @@
 #define __pool__H__
 
 #include <aRibeiroCore/common.h>
-//#include <queue>
-#include <list>
 #include <aRibeiroPlatform/PlatformAutoLock.h>
-#include <aRibeiroPlatform/ObjectQueue.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+#include <map>
 
 namespace aRibeiro {
 
+    /*
+
+    Object pool backed by slabs.
+
+    The objects live inside slabs of slots. A free slot is linked in an
+    intrusive free list (the depot), so no map or list node is allocated
+    by create/release.
+
+    Each thread keeps a magazine (a small stack of free slots) for each pool.
+    create/release use the magazine without any lock. The pool mutex is
+    taken only to move half a magazine from/to the depot or to allocate a new slab.
+
+    When the ignore_placement_new_delete is true, the released object is not
+    destructed, so the next create can return it with its old state.
+
+    In debug builds (NDEBUG not defined) release checks that the object
+    was created by this pool and that it is not released twice.
+
+    reserve(n) pre-allocates n free objects in one contiguous aligned slab.
+    createBatch/releaseBatch move many objects with at most one lock.
+    trim() frees the completely free slabs above the high-water mark
+    (the largest number of objects in use since the last trim).
+
+    Example of use
+
+#include <aRibeiroPlatform/aRibeiroPlatform.h>
+using namespace aRibeiro;
+
+ObjectPool<Packet> pool;
+
+Packet* packet = pool.create();
+...
+pool.release(packet);
+
+// startup
+pool.reserve(10000);
+
+// burst
+Packet* packets[256];
+pool.createBatch(packets, 256);
+...
+pool.releaseBatch(packets, 256);
+
+// from time to time
+pool.trim();
+
+    */
+
     template <class T>
     class ObjectPool {
 
-        struct ObjectPoolElement {
+        struct Slot;
+
+        struct Slab {
+            Slot* slots;
+            uint32_t count;
+            // slots of this slab in the depot
+            uint32_t free_count;
+        };
+
+        struct Slot {
+            // free list link
+            Slot* next;
+            Slab* slab;
+#ifndef NDEBUG
+            ObjectPool* owner;
+            bool in_use;
+#endif
+            // the storage has a T constructed
+            bool constructed;
             bool ignore_placement_new_delete;
-            T* data;
+            alignas(T) uint8_t storage[sizeof(T)];
 
-            ObjectPoolElement() {
-                ignore_placement_new_delete = false;
-                data = NULL;
+            T* data() {
+                return (T*)storage;
             }
+        };
+
+        static const uint32_t MAGAZINE_SIZE = 64;
+        static const uint32_t MIN_SLAB_SLOTS = 64;
+        static const uint32_t MAX_SLAB_SLOTS = 4096;
 
-            bool operator >(const ObjectPoolElement&b)const {
-                return (uintptr_t)data > (uintptr_t)b.data;
+        struct Magazine {
+            uint64_t pool_id;
+            uint32_t count;
+            Slot* slots[MAGAZINE_SIZE];
+        };
+
+        // live pools, used to return the magazines of the threads that exit
+        struct Registry {
+            aRibeiro::PlatformMutex mutex;
+            std::map<uint64_t, ObjectPool*> pools;
+            uint64_t next_id;
+
+            Registry() {
+                next_id = 1;
             }
-            bool operator <(const ObjectPoolElement&b)const {
-                return (uintptr_t)data < (uintptr_t)b.data;
+        };
+
+        struct ThreadCache {
+            std::vector<Magazine*> magazines;
+            Magazine* last;
+
+            ThreadCache() {
+                last = NULL;
             }
-            bool operator ==(const ObjectPoolElement&b)const {
-                return (uintptr_t)data == (uintptr_t)b.data;
+
+            ~ThreadCache() {
+                Registry& reg = registry();
+                PlatformAutoLock autoLock(&reg.mutex);
+                for (size_t i = 0; i < magazines.size(); i++) {
+                    Magazine* magazine = magazines[i];
+                    typename std::map<uint64_t, ObjectPool*>::iterator it = reg.pools.find(magazine->pool_id);
+                    if (it != reg.pools.end())
+                        it->second->depotPush(magazine->slots, magazine->count);
+                    delete magazine;
+                }
+                magazines.clear();
             }
         };
 
-        aRibeiro::PlatformMutex mutex;
+        static Registry& registry() {
+            static Registry reg;
+            return reg;
+        }
 
-        //std::vector<Element> list;
+        static ThreadCache& threadCache() {
+            static thread_local ThreadCache cache;
+            return cache;
+        }
 
-        ObjectQueue< ObjectPoolElement > available;
-        //ObjectQueue< ObjectPoolElement > in_use;
-        std::map< T*, ObjectPoolElement > in_use;
+        static Slot* slotFromData(T* data) {
+            return (Slot*)((uint8_t*)data - offsetof(Slot, storage));
+        }
 
+        uint64_t pool_id;
+        aRibeiro::PlatformMutex mutex;
+
+        // intrusive free list
+        Slot* depot;
+        uint32_t depot_count;
 
-        //std::vector<T*> used;
-        //std::vector<T*> available;
-        // int posCreate;
-        // int posRelease;
-        // int count;
+        std::vector<Slab*> slabs;
+        uint32_t next_slab_slots;
+        uint32_t total_slots;
+        // largest number of slots out of the depot since the last trim
+        uint32_t high_water;
+        uint32_t auto_trim_threshold;
 
         bool released;
 
@@ -53,127 +165,340 @@ namespace aRibeiro {
         ObjectPool(const ObjectPool& v) {}
         void operator=(const ObjectPool& v) {}
 
-    public:
+        // mutex must be locked
+        void allocateSlab(uint32_t count) {
+            Slot* slots = (Slot*)malloc_aligned(sizeof(Slot) * count, 64);
+            ARIBEIRO_ABORT(slots == NULL, "ObjectPool: out of memory.\n");
+
+            Slab* slab = new Slab();
+            slab->slots = slots;
+            slab->count = count;
+            slab->free_count = count;
+
+            for (uint32_t i = 0; i < count; i++) {
+                Slot* slot = &slots[i];
+                slot->slab = slab;
+#ifndef NDEBUG
+                slot->owner = this;
+                slot->in_use = false;
+#endif
+                slot->constructed = false;
+                slot->ignore_placement_new_delete = false;
+                slot->next = (i + 1 < count) ? &slots[i + 1] : depot;
+            }
+            depot = slots;
+            depot_count += count;
+            total_slots += count;
 
-        ObjectPool() : available(false)
-            //    , in_use(false) 
-        {
-            released = false;
+            slabs.push_back(slab);
         }
 
-        virtual ~ObjectPool() {
-            
-            //printf("virtual ~ObjectPool()\n");
+        // mutex must be locked
+        Slot* depotPop() {
+            if (depot == NULL) {
+                allocateSlab(next_slab_slots);
+                if (next_slab_slots < MAX_SLAB_SLOTS)
+                    next_slab_slots <<= 1;
+            }
+            Slot* slot = depot;
+            depot = slot->next;
+            depot_count--;
+            slot->slab->free_count--;
+            if (total_slots - depot_count > high_water)
+                high_water = total_slots - depot_count;
+            return slot;
+        }
 
+        // mutex must be locked
+        void depotPushLocked(Slot* slot) {
+            slot->next = depot;
+            depot = slot;
+            depot_count++;
+            slot->slab->free_count++;
+        }
+
+        void depotPush(Slot** slots, uint32_t count) {
+            if (count == 0)
+                return;
             PlatformAutoLock autoLock(&mutex);
+            for (uint32_t i = 0; i < count; i++)
+                depotPushLocked(slots[i]);
+            if (auto_trim_threshold > 0 && depot_count > auto_trim_threshold)
+                trim();
+        }
 
-            //printf("while (available.size() > 0)\n");
-            while (available.size() > 0) {
-                //printf("    while (available.size() > 0)\n");
-                ObjectPoolElement element = available.dequeue(NULL,true);
+        void refill(Magazine* magazine) {
+            PlatformAutoLock autoLock(&mutex);
+            while (magazine->count < MAGAZINE_SIZE / 2)
+                magazine->slots[magazine->count++] = depotPop();
+        }
 
-                if (!element.ignore_placement_new_delete)
-                    new (element.data) T();
-                delete element.data;
-            }
+        T* initializeSlot(Slot* slot, bool ignore_placement_new_delete) {
+#ifndef NDEBUG
+            slot->in_use = true;
+#endif
 
-            //printf("while (it != in_use.end())\n");
-            typename std::map< T*, ObjectPoolElement >::iterator it = in_use.begin();
-            while (it != in_use.end()) {
-                //printf("    typename std::map< T*, ObjectPoolElement >::iterator it = in_use.begin()\n");
-                ObjectPoolElement element = it->second;
-                //if (!element.ignore_placement_new_delete)
-                    //new (element.data) T();
-                    //element.data->~T();
-                delete element.data;
-                it++;
+            if (slot->constructed && !ignore_placement_new_delete) {
+                // released with ignore_placement_new_delete: reset the object
+                slot->data()->~T();
+                slot->constructed = false;
             }
-            in_use.clear();
-
-            /*
-            while (in_use.size() > 0) {
-                ObjectPoolElement element = in_use.dequeue(NULL,true);
-                if (!element.ignore_placement_new_delete)
-                    element.data->~T();
-                delete element.data;
+            if (!slot->constructed) {
+                //placement new operator
+                new (slot->storage) T();
+                slot->constructed = true;
             }
-            */
+            slot->ignore_placement_new_delete = ignore_placement_new_delete;
 
-            released = true;
+            return slot->data();
         }
 
-        T* create(bool ignore_placement_new_delete = false) {
-            PlatformAutoLock autoLock(&mutex);
+        Slot* finalizeSlot(T* data) {
+            Slot* slot = slotFromData(data);
 
-            ARIBEIRO_ABORT(released, "ERROR: trying to create element from a deleted pool");
+#ifndef NDEBUG
+            ARIBEIRO_ABORT(slot->owner != this, "ERROR: deleting unknown element...\n");
+            ARIBEIRO_ABORT(!slot->in_use, "ERROR: element released twice...\n");
+            slot->in_use = false;
+#endif
 
-            if (available.size() > 0) {
-                ObjectPoolElement element = available.dequeue();
-                element.ignore_placement_new_delete = ignore_placement_new_delete;
+            //placement delete operator
+            if (!slot->ignore_placement_new_delete) {
+                slot->data()->~T();
+                slot->constructed = false;
+            }
 
-                //in_use.enqueueInOrder(element);
-                in_use[element.data] = element;
+            return slot;
+        }
 
-                //placement new operator
-                if (!element.ignore_placement_new_delete)
-                    new (element.data) T();
-                return element.data;
+        // destruct the objects released with ignore_placement_new_delete and free the memory
+        static void freeSlab(Slab* slab) {
+            for (uint32_t i = 0; i < slab->count; i++) {
+                if (slab->slots[i].constructed)
+                    slab->slots[i].data()->~T();
             }
-            else {
-                ObjectPoolElement newElement;
-                newElement.ignore_placement_new_delete = ignore_placement_new_delete;
-                newElement.data = new T();
+            free_aligned(slab->slots);
+            delete slab;
+        }
 
-                in_use[newElement.data] = newElement;
-                //in_use.enqueueInOrder(newElement);
+        Magazine* getMagazine() {
+            ThreadCache& cache = threadCache();
+            if (cache.last != NULL && cache.last->pool_id == pool_id)
+                return cache.last;
 
-                return newElement.data;
+            for (size_t i = 0; i < cache.magazines.size(); i++) {
+                if (cache.magazines[i]->pool_id == pool_id) {
+                    cache.last = cache.magazines[i];
+                    return cache.last;
+                }
             }
+
+            // first use of this pool in this thread: drop the magazines of the deleted pools
+            {
+                Registry& reg = registry();
+                PlatformAutoLock autoLock(&reg.mutex);
+                for (size_t i = 0; i < cache.magazines.size();) {
+                    if (reg.pools.find(cache.magazines[i]->pool_id) == reg.pools.end()) {
+                        delete cache.magazines[i];
+                        cache.magazines[i] = cache.magazines.back();
+                        cache.magazines.pop_back();
+                    }
+                    else
+                        i++;
+                }
+            }
+
+            Magazine* magazine = new Magazine();
+            magazine->pool_id = pool_id;
+            magazine->count = 0;
+            cache.magazines.push_back(magazine);
+            cache.last = magazine;
+            return magazine;
         }
 
-        void release(T* data) {
+    public:
+
+        ObjectPool() {
+            depot = NULL;
+            depot_count = 0;
+            next_slab_slots = MIN_SLAB_SLOTS;
+            total_slots = 0;
+            high_water = 0;
+            auto_trim_threshold = 0;
+            released = false;
+
+            Registry& reg = registry();
+            PlatformAutoLock autoLock(&reg.mutex);
+            pool_id = reg.next_id++;
+            reg.pools[pool_id] = this;
+        }
+
+        virtual ~ObjectPool() {
+            {
+                // the magazines that still reference this pool are ignored from now on
+                Registry& reg = registry();
+                PlatformAutoLock autoLock(&reg.mutex);
+                reg.pools.erase(pool_id);
+            }
+
             PlatformAutoLock autoLock(&mutex);
 
+            // destruct the objects in use and the ones released with ignore_placement_new_delete
+            for (size_t i = 0; i < slabs.size(); i++)
+                freeSlab(slabs[i]);
+            slabs.clear();
+            depot = NULL;
+            depot_count = 0;
+            total_slots = 0;
+
+            released = true;
+        }
+
+        T* create(bool ignore_placement_new_delete = false) {
+            ARIBEIRO_ABORT(released, "ERROR: trying to create element from a deleted pool");
+
+            Magazine* magazine = getMagazine();
+            if (magazine->count == 0)
+                refill(magazine);
+            return initializeSlot(magazine->slots[--magazine->count], ignore_placement_new_delete);
+        }
+
+        void release(T* data) {
             ARIBEIRO_ABORT(released, "ERROR: trying to release element from a deleted pool\n");
 
-            //check in_use elements
-            typename std::map< T*, ObjectPoolElement >::iterator it = in_use.find(data);
+            Slot* slot = finalizeSlot(data);
 
-            if (it != in_use.end()) {
-                ObjectPoolElement removedElement = it->second;
+            Magazine* magazine = getMagazine();
+            if (magazine->count == MAGAZINE_SIZE) {
+                // return half of the magazine to the depot
+                depotPush(&magazine->slots[MAGAZINE_SIZE / 2], MAGAZINE_SIZE / 2);
+                magazine->count = MAGAZINE_SIZE / 2;
+            }
+            magazine->slots[magazine->count++] = slot;
+        }
+
+        // create count objects, taking the pool mutex at most once
+        void createBatch(T** result, size_t count, bool ignore_placement_new_delete = false) {
+            ARIBEIRO_ABORT(released, "ERROR: trying to create element from a deleted pool");
+
+            // the result array holds the slots until they are initialized
+            size_t i = 0;
+
+            Magazine* magazine = getMagazine();
+            while (i < count && magazine->count > 0)
+                result[i++] = (T*)magazine->slots[--magazine->count];
+
+            if (i < count) {
+                PlatformAutoLock autoLock(&mutex);
+                // one slab with all the missing slots
+                if (depot_count < count - i)
+                    allocateSlab((uint32_t)(count - i - depot_count));
+                while (i < count)
+                    result[i++] = (T*)depotPop();
+            }
 
-                in_use.erase(it);
+            for (i = 0; i < count; i++)
+                result[i] = initializeSlot((Slot*)result[i], ignore_placement_new_delete);
+        }
 
-                //placement delete operator
-                if (!removedElement.ignore_placement_new_delete)
-                    removedElement.data->~T();
+        // release count objects, taking the pool mutex at most once
+        void releaseBatch(T** data, size_t count) {
+            ARIBEIRO_ABORT(released, "ERROR: trying to release element from a deleted pool\n");
 
-                available.enqueue(removedElement);
+            Magazine* magazine = getMagazine();
+            size_t i = 0;
+            while (i < count && magazine->count < MAGAZINE_SIZE) {
+                magazine->slots[magazine->count++] = finalizeSlot(data[i]);
+                i++;
             }
-            else {
-                ARIBEIRO_ABORT(true, "ERROR: deleting unknown element...\n");
+
+            if (i < count) {
+                PlatformAutoLock autoLock(&mutex);
+                for (; i < count; i++)
+                    depotPushLocked(finalizeSlot(data[i]));
+                if (auto_trim_threshold > 0 && depot_count > auto_trim_threshold)
+                    trim();
             }
+        }
 
-            /*
-            ObjectPoolElement toSearch;
-            toSearch.data = data;
-            ObjectPoolElement removedElement = in_use.removeInOrder(toSearch, true);
-            if (removedElement.data != NULL) {
-                //placement delete operator
-                if (!removedElement.ignore_placement_new_delete)
-                    removedElement.data->~T();
+        // make sure there are at least count free objects,
+        // the missing ones are allocated in one contiguous aligned slab
+        void reserve(size_t count) {
+            PlatformAutoLock autoLock(&mutex);
+            if (depot_count < count)
+                allocateSlab((uint32_t)(count - depot_count));
+            // the reserved memory is kept until a trim after a period with less objects in use
+            if (total_slots > high_water)
+                high_water = total_slots;
+        }
 
-                available.enqueue(removedElement);
+        // Free the slabs that are completely free and are above the high-water mark
+        // (the largest number of objects in use since the last trim).
+        //
+        // The slots in the thread magazines count as in use.
+        //
+        // Returns the number of objects freed.
+        uint32_t trim() {
+            PlatformAutoLock autoLock(&mutex);
+
+            std::vector<Slab*> removed;
+            uint32_t freed = 0;
+            for (size_t i = 0; i < slabs.size();) {
+                Slab* slab = slabs[i];
+                if (slab->free_count == slab->count && total_slots - slab->count >= high_water) {
+                    total_slots -= slab->count;
+                    freed += slab->count;
+                    // mark the slab to be removed from the depot
+                    slab->free_count = 0xffffffffu;
+                    removed.push_back(slab);
+                    slabs[i] = slabs.back();
+                    slabs.pop_back();
+                }
+                else
+                    i++;
             }
-            else {
-                ARIBEIRO_ABORT(true, "ERROR: deleting unknown element...\n");
+
+            if (freed > 0) {
+                Slot* new_depot = NULL;
+                Slot* slot = depot;
+                while (slot != NULL) {
+                    Slot* next = slot->next;
+                    if (slot->slab->free_count != 0xffffffffu) {
+                        slot->next = new_depot;
+                        new_depot = slot;
+                    }
+                    slot = next;
+                }
+                depot = new_depot;
+                depot_count -= freed;
+
+                for (size_t i = 0; i < removed.size(); i++)
+                    freeSlab(removed[i]);
             }
-            */
 
+            high_water = total_slots - depot_count;
+            return freed;
+        }
+
+        // trim automatically when the depot has more than threshold free objects (0 disables)
+        void setAutoTrimThreshold(uint32_t threshold) {
+            PlatformAutoLock autoLock(&mutex);
+            auto_trim_threshold = threshold;
+        }
+
+        // number of objects allocated (in use and free)
+        uint32_t getCapacity() {
+            PlatformAutoLock autoLock(&mutex);
+            return total_slots;
+        }
+
+        // number of free objects in the depot (the thread magazines are not included)
+        uint32_t getFreeCount() {
+            PlatformAutoLock autoLock(&mutex);
+            return depot_count;
         }
     };
 
 }
 
 #endif
-
@@ -0,0 +1,312 @@
+#ifndef __priority_queue__H__
+#define __priority_queue__H__
+
+#include <aRibeiroCore/common.h>
+#include <vector>
+#include <functional>
+#include <aRibeiroPlatform/PlatformAutoLock.h>
+#include <aRibeiroPlatform/PlatformSemaphore.h>
+
+namespace aRibeiro {
+
+    /*
+
+    Priority queue with keyed removal.
+
+    It is an indexed binary heap protected by a mutex:
+        - enqueue, dequeue, remove and update: O(log n)
+        - peek: O(1)
+
+    The dequeue returns the smallest element (Compare = std::less<T>),
+    the same order of ObjectQueue::enqueueInOrder.
+
+    The enqueue returns a handle that can be used to remove or update the
+    element while it is in the queue. A handle of an element that left the
+    queue is invalid (remove/update return false).
+
+    It has the same blocking semantics of ObjectQueue:
+        - blocking: dequeue waits for an element, or returns T() when the
+          current thread is interrupted (see isSignaledFromCurrentThread)
+        - non-blocking: dequeue returns T() if the queue is empty
+
+    Example of use
+
+#include <aRibeiroPlatform/aRibeiroPlatform.h>
+using namespace aRibeiro;
+
+struct Timer {
+    int64_t time;
+    int id;
+    bool operator<(const Timer& v) const { return time < v.time; }
+};
+
+ObjectPriorityQueue<Timer> timers(false);
+
+ObjectPriorityQueueHandle handle = timers.enqueue(timer);
+
+// reschedule
+timer.time += 1000;
+timers.update(handle, timer);
+
+// cancel
+timers.remove(handle);
+
+Timer next;
+if (timers.peek(&next) && next.time <= now)
+    timers.tryDequeue(&next);
+
+    */
+
+    typedef uint64_t ObjectPriorityQueueHandle;
+
+    template <typename T, typename Compare = std::less<T> >
+    class ObjectPriorityQueue {
+
+        struct Entry {
+            T value;
+            uint32_t slot;
+        };
+
+        // the handle is the slot index plus the slot generation,
+        // so a handle of a removed element does not match a reused slot
+        struct Slot {
+            uint32_t heap_index;
+            uint32_t generation;
+        };
+
+        static const uint32_t INVALID_INDEX = 0xffffffffu;
+
+        aRibeiro::PlatformMutex mutex;
+        aRibeiro::PlatformSemaphore semaphore;
+        bool blocking;
+        Compare compare;
+
+        std::vector<Entry> heap;
+        std::vector<Slot> slots;
+        std::vector<uint32_t> free_slots;
+
+        //private copy constructores, to avoid copy...
+        ObjectPriorityQueue(const ObjectPriorityQueue& v) :semaphore(0) {}
+        void operator=(const ObjectPriorityQueue& v) {}
+
+        void place(uint32_t index, const Entry& entry) {
+            heap[index] = entry;
+            slots[entry.slot].heap_index = index;
+        }
+
+        void siftUp(uint32_t index) {
+            Entry entry = heap[index];
+            while (index > 0) {
+                uint32_t parent = (index - 1) >> 1;
+                if (!compare(entry.value, heap[parent].value))
+                    break;
+                place(index, heap[parent]);
+                index = parent;
+            }
+            place(index, entry);
+        }
+
+        void siftDown(uint32_t index) {
+            Entry entry = heap[index];
+            uint32_t count = (uint32_t)heap.size();
+            while (true) {
+                uint32_t child = (index << 1) + 1;
+                if (child >= count)
+                    break;
+                if (child + 1 < count && compare(heap[child + 1].value, heap[child].value))
+                    child++;
+                if (!compare(heap[child].value, entry.value))
+                    break;
+                place(index, heap[child]);
+                index = child;
+            }
+            place(index, entry);
+        }
+
+        // returns the heap index of the handle, or INVALID_INDEX
+        uint32_t findHandle(ObjectPriorityQueueHandle handle) {
+            uint32_t slot = (uint32_t)(handle & 0xffffffffu);
+            uint32_t generation = (uint32_t)(handle >> 32);
+            if (slot >= slots.size() || slots[slot].generation != generation)
+                return INVALID_INDEX;
+            return slots[slot].heap_index;
+        }
+
+        T removeAt(uint32_t index) {
+            Entry removed = heap[index];
+
+            slots[removed.slot].heap_index = INVALID_INDEX;
+            slots[removed.slot].generation++;
+            free_slots.push_back(removed.slot);
+
+            uint32_t last = (uint32_t)heap.size() - 1;
+            if (index != last) {
+                place(index, heap[last]);
+                heap.pop_back();
+                if (index > 0 && compare(heap[index].value, heap[(index - 1) >> 1].value))
+                    siftUp(index);
+                else
+                    siftDown(index);
+            }
+            else
+                heap.pop_back();
+
+            return removed.value;
+        }
+
+        bool popFront(T *result) {
+            PlatformAutoLock autoLock(&mutex);
+            if (heap.size() == 0)
+                return false;
+            *result = removeAt(0);
+            return true;
+        }
+
+    public:
+
+        ObjectPriorityQueue(bool blocking = true) :semaphore(0) {
+            this->blocking = blocking;
+        }
+
+        virtual ~ObjectPriorityQueue() {
+        }
+
+        ObjectPriorityQueueHandle enqueue(const T &v) {
+            mutex.lock();
+
+            uint32_t slot;
+            if (free_slots.size() > 0) {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            }
+            else {
+                slot = (uint32_t)slots.size();
+                Slot new_slot;
+                new_slot.heap_index = INVALID_INDEX;
+                new_slot.generation = 0;
+                slots.push_back(new_slot);
+            }
+
+            Entry entry;
+            entry.value = v;
+            entry.slot = slot;
+            heap.push_back(entry);
+            siftUp((uint32_t)heap.size() - 1);
+
+            ObjectPriorityQueueHandle handle = ((ObjectPriorityQueueHandle)slots[slot].generation << 32) | (ObjectPriorityQueueHandle)slot;
+            mutex.unlock();
+
+            if (blocking)
+                semaphore.release();
+
+            return handle;
+        }
+
+        // returns false if the element is not in the queue anymore
+        bool remove(ObjectPriorityQueueHandle handle, T *removed = NULL) {
+            mutex.lock();
+            uint32_t index = findHandle(handle);
+            if (index == INVALID_INDEX) {
+                mutex.unlock();
+                return false;
+            }
+            T value = removeAt(index);
+            mutex.unlock();
+
+            if (removed != NULL)
+                *removed = value;
+
+            // take the permit of the removed element;
+            // if a consumer already has it, the consumer finds the queue empty and waits again
+            if (blocking)
+                semaphore.tryToAcquire();
+
+            return true;
+        }
+
+        // change the value of an element, keeping its handle
+        //
+        // returns false if the element is not in the queue anymore
+        bool update(ObjectPriorityQueueHandle handle, const T &v) {
+            PlatformAutoLock autoLock(&mutex);
+            uint32_t index = findHandle(handle);
+            if (index == INVALID_INDEX)
+                return false;
+            heap[index].value = v;
+            if (index > 0 && compare(heap[index].value, heap[(index - 1) >> 1].value))
+                siftUp(index);
+            else
+                siftDown(index);
+            return true;
+        }
+
+        bool contains(ObjectPriorityQueueHandle handle) {
+            PlatformAutoLock autoLock(&mutex);
+            return findHandle(handle) != INVALID_INDEX;
+        }
+
+        uint32_t size() {
+            PlatformAutoLock autoLock(&mutex);
+            return (uint32_t)heap.size();
+        }
+
+        T peek() {
+            PlatformAutoLock autoLock(&mutex);
+            if (heap.size() > 0)
+                return heap[0].value;
+            return T();
+        }
+
+        // returns false if the queue is empty
+        bool peek(T *result) {
+            PlatformAutoLock autoLock(&mutex);
+            if (heap.size() == 0)
+                return false;
+            *result = heap[0].value;
+            return true;
+        }
+
+        // returns false if the queue is empty (never waits)
+        bool tryDequeue(T *result) {
+            if (blocking && !semaphore.tryToAcquire())
+                return false;
+            if (popFront(result))
+                return true;
+            return false;
+        }
+
+        T dequeue(bool *isSignaled = NULL, bool ignoreSignal = false) {
+            T result = T();
+
+            if (blocking) {
+                while (true) {
+                    if (!semaphore.blockingAcquire()) {
+                        // without a permit there is no element to take
+                        if (isSignaled != NULL)
+                            *isSignaled = !ignoreSignal;
+                        return T();
+                    }
+                    // the element of this permit can be removed by a remove call
+                    if (popFront(&result))
+                        break;
+                }
+                if (isSignaled != NULL)
+                    *isSignaled = false;
+                return result;
+            }
+
+            if (!popFront(&result))
+                result = T();
+            if (isSignaled != NULL)
+                *isSignaled = false;
+            return result;
+        }
+
+        bool isSignaledFromCurrentThread() {
+            return semaphore.isSignaled();
+        }
+    };
+
+}
+
+#endif
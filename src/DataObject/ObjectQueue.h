@@ -198,6 +198,8 @@ int main(int argc, char* argv[]){
         }
 
         // int(*compareFunction)(const T&a, const T&b) = ObjectQueue_default_comparer
+        //
+        // O(n) insertion: use ObjectPriorityQueue for large ordered queues
         void enqueueInOrder(const T &v) {
             //PlatformAutoLock autoLock(&mutex);
             mutex.lock();
@@ -400,6 +402,24 @@ int main(int argc, char* argv[]){
                 semaphore.release();
         }
 
+        // enqueue several elements with one lock and one call to semaphore.release(count)
+        // (one post for each element on linux/mac)
+        void enqueue(const T *v, size_t count) {
+            if (count == 0)
+                return;
+
+            mutex.lock();
+
+            ARIBEIRO_ABORT(ordered == true, "Trying to enqueue element in an ordered queue.\n");
+
+            for (size_t i = 0; i < count; i++)
+                list.push_back(v[i]);
+            mutex.unlock();
+
+            if (blocking)
+                semaphore.release((uint32_t)count);
+        }
+
         uint32_t size() {
             PlatformAutoLock autoLock(&mutex);
             return (uint32_t)list.size();
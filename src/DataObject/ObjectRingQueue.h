@@ -0,0 +1,227 @@
+#ifndef __ring_queue__H__
+#define __ring_queue__H__
+
+#include <aRibeiroCore/common.h>
+#include <aRibeiroPlatform/PlatformSemaphore.h>
+#include <aRibeiroPlatform/PlatformSleep.h>
+#include <atomic>
+
+namespace aRibeiro {
+
+    /*
+
+    Bounded lock-free multi-producer multi-consumer queue.
+
+    Each slot has a sequence number that tells if it is ready to be written
+    or ready to be read, so the producers and the consumers only synchronize
+    with a compare-and-swap on their own position.
+
+    It has the same enqueue/dequeue semantics of ObjectQueue:
+        - blocking: dequeue waits for an element, or returns T() when the
+          current thread is interrupted (see isSignaledFromCurrentThread)
+        - non-blocking: dequeue returns T() if the queue is empty
+
+    The enqueue waits for a free slot when the queue is full.
+    Use tryEnqueue/tryDequeue to not wait.
+
+    Capacity must be a power of two.
+
+    Reference:
+        Dmitry Vyukov. Bounded MPMC queue.
+        https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+
+    Example of use
+
+#include <aRibeiroPlatform/aRibeiroPlatform.h>
+using namespace aRibeiro;
+
+ObjectRingQueue<int, 1024> queue;
+
+void thread() {
+    while ( !PlatformThread::getCurrentThread()->isCurrentThreadInterrupted() ) {
+        bool isSignaled;
+        int v = queue.dequeue(&isSignaled);
+        if (isSignaled)
+            break;
+        printf("[thread]: %i\n", v);
+    }
+    printf("end thread\n");
+}
+
+    */
+
+    template <typename T, size_t Capacity>
+    class ObjectRingQueue {
+
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "ObjectRingQueue capacity must be power of two.");
+
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        Cell* buffer;
+
+        // keep the producer and consumer positions in different cache lines
+        // (padding: the new of C++11/14 does not align the object to 64 bytes)
+        uint8_t pad0[64 - sizeof(Cell*)];
+        std::atomic<size_t> enqueue_pos;
+        uint8_t pad1[64 - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> dequeue_pos;
+        uint8_t pad2[64 - sizeof(std::atomic<size_t>)];
+        aRibeiro::PlatformSemaphore semaphore;
+        bool blocking;
+
+        //private copy constructores, to avoid copy...
+        ObjectRingQueue(const ObjectRingQueue& v) :semaphore(0) {}
+        void operator=(const ObjectRingQueue& v) {}
+
+        bool push(const T &v) {
+            size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true) {
+                cell = &buffer[pos & (Capacity - 1)];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+                if (dif == 0) {
+                    if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (dif < 0)
+                    return false; // full
+                else
+                    pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+            cell->data = v;
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T *result) {
+            size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true) {
+                cell = &buffer[pos & (Capacity - 1)];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+                if (dif == 0) {
+                    if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (dif < 0)
+                    return false; // empty
+                else
+                    pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+            *result = cell->data;
+            cell->sequence.store(pos + Capacity, std::memory_order_release);
+            return true;
+        }
+
+    public:
+
+        ObjectRingQueue(bool blocking = true) :semaphore(0) {
+            this->blocking = blocking;
+            buffer = new Cell[Capacity];
+            for (size_t i = 0; i < Capacity; i++)
+                buffer[i].sequence.store(i, std::memory_order_relaxed);
+            enqueue_pos.store(0, std::memory_order_relaxed);
+            dequeue_pos.store(0, std::memory_order_relaxed);
+        }
+
+        virtual ~ObjectRingQueue() {
+            delete[] buffer;
+        }
+
+        // returns false if the queue is full
+        bool tryEnqueue(const T &v) {
+            if (!push(v))
+                return false;
+            if (blocking)
+                semaphore.release();
+            return true;
+        }
+
+        // waits for a free slot if the queue is full
+        void enqueue(const T &v) {
+            while (!push(v))
+                PlatformSleep::yield();
+            if (blocking)
+                semaphore.release();
+        }
+
+        // enqueue several elements with one call to semaphore.release(count)
+        // (one post for each element on linux/mac)
+        void enqueue(const T *v, size_t count) {
+            if (count == 0)
+                return;
+            for (size_t i = 0; i < count; i++) {
+                while (!push(v[i]))
+                    PlatformSleep::yield();
+            }
+            if (blocking)
+                semaphore.release((uint32_t)count);
+        }
+
+        // returns false if the queue is empty (never waits)
+        bool tryDequeue(T *result) {
+            if (blocking) {
+                if (dequeue_pos.load(std::memory_order_relaxed) == enqueue_pos.load(std::memory_order_relaxed))
+                    return false;
+                if (!semaphore.tryToAcquire())
+                    return false;
+                // the permit guarantees one element, it can be still being written
+                while (!pop(result))
+                    PlatformSleep::cpuRelax();
+                return true;
+            }
+            return pop(result);
+        }
+
+        T dequeue(bool *isSignaled = NULL, bool ignoreSignal = false) {
+
+            T result = T();
+
+            if (blocking) {
+                if (!semaphore.blockingAcquire()) {
+                    // without a permit there is no element to take
+                    if (isSignaled != NULL)
+                        *isSignaled = !ignoreSignal;
+                    return result;
+                }
+
+                // the permit guarantees one element, it can be still being written
+                while (!pop(&result))
+                    PlatformSleep::cpuRelax();
+
+                if (isSignaled != NULL)
+                    *isSignaled = false;
+                return result;
+            }
+
+            if (!pop(&result))
+                result = T();
+            if (isSignaled != NULL)
+                *isSignaled = false;
+            return result;
+        }
+
+        // approximated when called concurrently
+        uint32_t size() {
+            size_t tail = dequeue_pos.load(std::memory_order_relaxed);
+            size_t head = enqueue_pos.load(std::memory_order_relaxed);
+            return (head > tail) ? (uint32_t)(head - tail) : 0;
+        }
+
+        uint32_t capacity() const {
+            return (uint32_t)Capacity;
+        }
+
+        bool isSignaledFromCurrentThread() {
+            return semaphore.isSignaled();
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef __spsc_queue__H__
+#define __spsc_queue__H__
+
+#include <aRibeiroCore/common.h>
+#include <aRibeiroPlatform/PlatformSemaphore.h>
+#include <aRibeiroPlatform/PlatformSleep.h>
+#include <atomic>
+
+namespace aRibeiro {
+
+    /*
+
+    Bounded single-producer single-consumer queue.
+
+    Only one thread can push and only one thread can pop.
+
+    Each side keeps a cached copy of the other side index, so the shared
+    index is read only when the cached value says the queue is full (producer)
+    or empty (consumer). The batch operations publish several elements with
+    one index store.
+
+    With blocking = true the consumer can wait for elements (pop/popN).
+    The consumer spins a little and then sleeps in a semaphore (doorbell).
+    The producer only touches the semaphore when the consumer is asleep.
+
+    Capacity must be a power of two.
+
+    Example of use
+
+#include <aRibeiroPlatform/aRibeiroPlatform.h>
+using namespace aRibeiro;
+
+ObjectSPSCQueue<int, 1024> queue(true);
+
+void consumer() {
+    int values[64];
+    while (true) {
+        size_t count = queue.popN(values, 64);
+        if (count == 0) // interrupted
+            break;
+        for (size_t i = 0; i < count; i++)
+            printf("[consumer]: %i\n", values[i]);
+    }
+}
+
+void producer() {
+    int values[3] = { 1, 2, 3 };
+    queue.pushN(values, 3);
+    queue.push(4);
+}
+
+    */
+
+    template <typename T, size_t Capacity>
+    class ObjectSPSCQueue {
+
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "ObjectSPSCQueue capacity must be power of two.");
+
+        T* buffer;
+        bool blocking;
+        uint32_t spinCount;
+
+        // (padding: the new of C++11/14 does not align the object to 64 bytes)
+        uint8_t pad0[64];
+
+        // producer cache line
+        std::atomic<size_t> head;
+        size_t cached_tail;
+        uint8_t pad1[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+        // consumer cache line
+        std::atomic<size_t> tail;
+        size_t cached_head;
+        uint8_t pad2[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+        // doorbell
+        std::atomic<bool> consumer_sleeping;
+        aRibeiro::PlatformSemaphore doorbell;
+
+        //private copy constructores, to avoid copy...
+        ObjectSPSCQueue(const ObjectSPSCQueue& v) :doorbell(0) {}
+        void operator=(const ObjectSPSCQueue& v) {}
+
+        void ringDoorbell() {
+            if (!blocking)
+                return;
+            // pairs with the fence of the consumer in waitElements
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (consumer_sleeping.load(std::memory_order_relaxed) &&
+                consumer_sleeping.exchange(false, std::memory_order_acq_rel))
+                doorbell.release();
+        }
+
+        // consumer: returns the number of elements available
+        size_t available() {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (cached_head == t)
+                cached_head = head.load(std::memory_order_acquire);
+            return cached_head - t;
+        }
+
+        // consumer: returns false if the thread was interrupted
+        bool waitElements() {
+            for (uint32_t i = 0; i < spinCount; i++) {
+                if (available() > 0)
+                    return true;
+                PlatformSleep::cpuRelax();
+            }
+            while (available() == 0) {
+                consumer_sleeping.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (available() > 0) {
+                    // the producer may have taken the flag already, then it releases the doorbell
+                    if (!consumer_sleeping.exchange(false, std::memory_order_acq_rel))
+                        doorbell.blockingAcquire();
+                    return true;
+                }
+                if (!doorbell.blockingAcquire()) {
+                    consumer_sleeping.store(false, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    public:
+
+        // spinCount: how many times the blocking pop checks the queue before sleeping
+        ObjectSPSCQueue(bool blocking = false, uint32_t spinCount = 1024) :doorbell(0) {
+            this->blocking = blocking;
+            this->spinCount = spinCount;
+            buffer = new T[Capacity];
+            head.store(0, std::memory_order_relaxed);
+            tail.store(0, std::memory_order_relaxed);
+            cached_head = 0;
+            cached_tail = 0;
+            consumer_sleeping.store(false, std::memory_order_relaxed);
+        }
+
+        virtual ~ObjectSPSCQueue() {
+            delete[] buffer;
+        }
+
+        // producer: returns false if the queue is full
+        bool tryPush(const T &v) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h - cached_tail == Capacity) {
+                cached_tail = tail.load(std::memory_order_acquire);
+                if (h - cached_tail == Capacity)
+                    return false;
+            }
+            buffer[h & (Capacity - 1)] = v;
+            head.store(h + 1, std::memory_order_release);
+            ringDoorbell();
+            return true;
+        }
+
+        // producer: push up to count elements, returns how many were pushed
+        size_t tryPushN(const T *v, size_t count) {
+            size_t h = head.load(std::memory_order_relaxed);
+            size_t free_slots = Capacity - (h - cached_tail);
+            if (free_slots < count) {
+                cached_tail = tail.load(std::memory_order_acquire);
+                free_slots = Capacity - (h - cached_tail);
+            }
+            if (count > free_slots)
+                count = free_slots;
+            if (count == 0)
+                return 0;
+            for (size_t i = 0; i < count; i++)
+                buffer[(h + i) & (Capacity - 1)] = v[i];
+            head.store(h + count, std::memory_order_release);
+            ringDoorbell();
+            return count;
+        }
+
+        // producer: waits for free slots when the queue is full
+        void push(const T &v) {
+            while (!tryPush(v))
+                PlatformSleep::yield();
+        }
+
+        // producer: waits for free slots when the queue is full
+        void pushN(const T *v, size_t count) {
+            while (count > 0) {
+                size_t pushed = tryPushN(v, count);
+                if (pushed == 0)
+                    PlatformSleep::yield();
+                v += pushed;
+                count -= pushed;
+            }
+        }
+
+        // consumer: returns false if the queue is empty
+        bool tryPop(T *result) {
+            if (available() == 0)
+                return false;
+            size_t t = tail.load(std::memory_order_relaxed);
+            *result = buffer[t & (Capacity - 1)];
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer: pop up to max_count elements, returns how many were popped
+        size_t tryPopN(T *result, size_t max_count) {
+            size_t count = available();
+            if (count > max_count)
+                count = max_count;
+            if (count == 0)
+                return 0;
+            size_t t = tail.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < count; i++)
+                result[i] = buffer[(t + i) & (Capacity - 1)];
+            tail.store(t + count, std::memory_order_release);
+            return count;
+        }
+
+        // consumer: waits for one element (blocking queue only)
+        //
+        // returns false if the current thread was interrupted
+        bool pop(T *result) {
+            ARIBEIRO_ABORT(!blocking, "ObjectSPSCQueue: pop called in a non-blocking queue.\n");
+            if (!waitElements())
+                return false;
+            return tryPop(result);
+        }
+
+        // consumer: waits for at least one element (blocking queue only)
+        //
+        // returns 0 if the current thread was interrupted
+        size_t popN(T *result, size_t max_count) {
+            ARIBEIRO_ABORT(!blocking, "ObjectSPSCQueue: popN called in a non-blocking queue.\n");
+            if (!waitElements())
+                return 0;
+            return tryPopN(result, max_count);
+        }
+
+        // approximated when called concurrently
+        uint32_t size() {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t h = head.load(std::memory_order_relaxed);
+            return (h > t) ? (uint32_t)(h - t) : 0;
+        }
+
+        uint32_t capacity() const {
+            return (uint32_t)Capacity;
+        }
+
+        bool isSignaledFromCurrentThread() {
+            return doorbell.isSignaled();
+        }
+    };
+
+}
+
+#endif
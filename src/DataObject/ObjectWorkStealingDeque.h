@@ -0,0 +1,181 @@
+#ifndef __work_stealing_deque__H__
+#define __work_stealing_deque__H__
+
+#include <aRibeiroCore/common.h>
+#include <atomic>
+#include <vector>
+
+namespace aRibeiro {
+
+    /*
+
+    Chase-Lev work stealing deque.
+
+    Only the owner thread can call push and pop (LIFO end).
+    Any other thread can call steal (FIFO end).
+
+    The element type must be trivially copyable (pointers or small PODs),
+    because the slots are read concurrently by the thieves.
+
+    Reference:
+        Le, Pop, Cohen, Zappa Nardelli.
+        Correct and Efficient Work-Stealing for Weak Memory Models. PPoPP 2013.
+
+    Example of use
+
+ObjectWorkStealingDeque<Job*> deque;
+
+// owner thread
+deque.push(job);
+Job* job;
+if (deque.pop(&job))
+    job->run();
+
+// other threads
+Job* stolen;
+if (deque.steal(&stolen))
+    stolen->run();
+
+    */
+
+    template <typename T>
+    class ObjectWorkStealingDeque {
+
+        struct Array {
+            int64_t capacity;
+            int64_t mask;
+            std::atomic<T>* buffer;
+
+            Array(int64_t _capacity) {
+                capacity = _capacity;
+                mask = _capacity - 1;
+                buffer = new std::atomic<T>[_capacity];
+            }
+            ~Array() {
+                delete[] buffer;
+            }
+
+            T get(int64_t i) const {
+                return buffer[i & mask].load(std::memory_order_relaxed);
+            }
+            void put(int64_t i, const T& v) {
+                buffer[i & mask].store(v, std::memory_order_relaxed);
+            }
+
+            Array* grow(int64_t bottom, int64_t top) const {
+                Array* result = new Array(capacity << 1);
+                for (int64_t i = top; i != bottom; i++)
+                    result->put(i, get(i));
+                return result;
+            }
+        };
+
+        // keep top and bottom in different cache lines
+        // (padding: the new of C++11/14 does not align the object to 64 bytes)
+        uint8_t pad0[64];
+        std::atomic<int64_t> top;
+        uint8_t pad1[64 - sizeof(std::atomic<int64_t>)];
+        std::atomic<int64_t> bottom;
+        uint8_t pad2[64 - sizeof(std::atomic<int64_t>)];
+        std::atomic<Array*> array;
+        uint8_t pad3[64 - sizeof(std::atomic<Array*>)];
+
+        // arrays replaced by a grow operation,
+        // they can still be read by a thief, so they are released in the destructor
+        std::vector<Array*> garbage;
+
+        //private copy constructores, to avoid copy...
+        ObjectWorkStealingDeque(const ObjectWorkStealingDeque& v) {}
+        void operator=(const ObjectWorkStealingDeque& v) {}
+
+    public:
+
+        // the initial capacity must be a power of two
+        ObjectWorkStealingDeque(int64_t initial_capacity = 1024) {
+            ARIBEIRO_ABORT((initial_capacity & (initial_capacity - 1)) != 0, "ObjectWorkStealingDeque capacity must be power of two.\n");
+            top.store(0, std::memory_order_relaxed);
+            bottom.store(0, std::memory_order_relaxed);
+            array.store(new Array(initial_capacity), std::memory_order_relaxed);
+        }
+
+        virtual ~ObjectWorkStealingDeque() {
+            for (size_t i = 0; i < garbage.size(); i++)
+                delete garbage[i];
+            garbage.clear();
+            delete array.load(std::memory_order_relaxed);
+        }
+
+        // owner thread only
+        void push(const T& v) {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            Array* a = array.load(std::memory_order_relaxed);
+
+            if (b - t > a->capacity - 1) {
+                Array* new_array = a->grow(b, t);
+                garbage.push_back(a);
+                a = new_array;
+                array.store(a, std::memory_order_release);
+            }
+
+            a->put(b, v);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        // owner thread only
+        bool pop(T* result) {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            Array* a = array.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+
+            if (t <= b) {
+                *result = a->get(b);
+                if (t == b) {
+                    // last element, race against the thieves
+                    bool success = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                    return success;
+                }
+                return true;
+            }
+
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // any thread
+        bool steal(T* result) {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+
+            if (t < b) {
+                Array* a = array.load(std::memory_order_acquire);
+                T v = a->get(t);
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    return false;
+                *result = v;
+                return true;
+            }
+
+            return false;
+        }
+
+        // approximated when called concurrently
+        int64_t size() const {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_relaxed);
+            return (b > t) ? (b - t) : 0;
+        }
+
+        bool isEmpty() const {
+            return size() == 0;
+        }
+    };
+
+}
+
+#endif
@@ -29,7 +29,8 @@ namespace aRibeiro {
             ::printf("read main loop\n");
             fflush(stdin);
             
-            ObjectBuffer buffer;
+            // used only by this thread
+            ObjectBuffer buffer(false);
 
             while (true){
                 while (queue.read(&buffer)) {
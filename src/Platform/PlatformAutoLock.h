@@ -6,15 +6,18 @@
 
 namespace aRibeiro {
 
+    // A NULL mutex makes the lock a no-op (used by single-owner objects).
     class PlatformAutoLock {
         PlatformMutex *mutex;
     public:
         PlatformAutoLock(PlatformMutex *mutex){
             this->mutex = mutex;
-            this->mutex->lock();
+            if (this->mutex != NULL)
+                this->mutex->lock();
         }
         ~PlatformAutoLock() {
-            this->mutex->unlock();
+            if (this->mutex != NULL)
+                this->mutex->unlock();
         }
     };
 
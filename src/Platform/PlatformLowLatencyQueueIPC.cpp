@@ -579,6 +579,14 @@ namespace aRibeiro {
     }
 
     bool PlatformLowLatencyQueueIPC::read(ObjectBuffer *outputBuffer) {
+        return readElement(outputBuffer, NULL, NULL, NULL);
+    }
+
+    bool PlatformLowLatencyQueueIPC::read(MemoryArena *arena, uint8_t **data, uint32_t *size) {
+        return readElement(NULL, arena, data, size);
+    }
+
+    bool PlatformLowLatencyQueueIPC::readElement(ObjectBuffer *outputBuffer, MemoryArena *arena, uint8_t **data, uint32_t *size) {
 
         if (blocking_on_read) 
         {
@@ -606,8 +614,14 @@ namespace aRibeiro {
 
         PlatformBufferHeader bufferHeader;
         read_buffer((uint8_t*)&bufferHeader, sizeof(PlatformBufferHeader));
-        outputBuffer->setSize(bufferHeader.size);
-        read_buffer(outputBuffer->data, outputBuffer->size);
+        if (outputBuffer != NULL) {
+            outputBuffer->setSize(bufferHeader.size);
+            read_buffer(outputBuffer->data, outputBuffer->size);
+        } else {
+            *data = (uint8_t*)arena->allocate(bufferHeader.size);
+            *size = bufferHeader.size;
+            read_buffer(*data, bufferHeader.size);
+        }
 
         unlock();
         shm_mutex.unlock();
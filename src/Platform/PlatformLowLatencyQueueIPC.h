@@ -26,6 +26,9 @@ namespace aRibeiro {
         void releaseAll(bool release_semaphore_ipc);
         void onAbort(const char *file, int line, const char *message);
 
+        // the element is copied to the outputBuffer, or to memory allocated from the arena
+        bool readElement(ObjectBuffer *outputBuffer, MemoryArena *arena, uint8_t **data, uint32_t *size);
+
         PlatformMutex shm_mutex;
     public:
 
@@ -61,6 +64,8 @@ namespace aRibeiro {
         bool write(const ObjectBuffer &inputBuffer, bool blocking = true, bool ignore_first_lock = false);
 
         bool read(ObjectBuffer *outputBuffer);
+        // read the element to memory allocated from the arena (no heap allocation after the arena warm up)
+        bool read(MemoryArena *arena, uint8_t **data, uint32_t *size);
 
         virtual ~PlatformLowLatencyQueueIPC();
 
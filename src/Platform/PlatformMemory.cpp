@@ -0,0 +1,149 @@
+#include "PlatformMemory.h"
+#include "PlatformThread.h"
+
+#if defined(OS_TARGET_win)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+namespace aRibeiro {
+
+    static size_t __round_up(size_t v, size_t align) {
+        return ((v + align - 1) / align) * align;
+    }
+
+    struct __FirstTouchJob {
+        uint8_t* ptr;
+        size_t size;
+        std::vector<int> cpus;
+    };
+
+    static void __first_touch_thread(__FirstTouchJob* job) {
+        if (!PlatformThread::setCurrentThreadAffinity(job->cpus))
+            return;
+        // read and write the same value: keeps the content of pages already in use
+        volatile uint8_t* ptr = job->ptr;
+        size_t page = PlatformMemory::pageSize();
+        for (size_t i = 0; i < job->size; i += page)
+            ptr[i] = ptr[i];
+    }
+
+    size_t PlatformMemory::pageSize() {
+#if defined(OS_TARGET_win)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return (size_t)info.dwPageSize;
+#else
+        long result = sysconf(_SC_PAGESIZE);
+        return (result > 0) ? (size_t)result : 4096;
+#endif
+    }
+
+    void* PlatformMemory::allocate(size_t size, PlatformMemoryPolicy policy, int numa_node, size_t *mapped_size) {
+        ARIBEIRO_ABORT(mapped_size == NULL, "PlatformMemory: mapped_size cannot be NULL.\n");
+        *mapped_size = 0;
+
+        void* result = NULL;
+
+        if (policy == PlatformMemoryPolicy_Default || size == 0) {
+            result = malloc_aligned(size, 64);
+        }
+        else {
+#if defined(OS_TARGET_win)
+            if (policy == PlatformMemoryPolicy_HugeTLB) {
+                // needs the SeLockMemoryPrivilege, fails otherwise
+                size_t large_page = (size_t)GetLargePageMinimum();
+                if (large_page > 0) {
+                    size_t length = __round_up(size, large_page);
+                    result = VirtualAlloc(NULL, length, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+                    if (result != NULL)
+                        *mapped_size = length;
+                }
+            }
+            // there is no transparent huge page on windows
+            if (result == NULL) {
+                size_t length = __round_up(size, pageSize());
+                result = VirtualAlloc(NULL, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+                if (result != NULL)
+                    *mapped_size = length;
+            }
+#else
+            size_t length = __round_up(size, HUGE_PAGE_SIZE);
+
+#if defined(MAP_HUGETLB)
+            if (policy == PlatformMemoryPolicy_HugeTLB) {
+                // fails when there is no huge page reserved (/proc/sys/vm/nr_hugepages)
+                result = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (result == MAP_FAILED)
+                    result = NULL;
+            }
+#endif
+
+            if (result == NULL) {
+                // map one huge page more to align the block to the huge page size
+                size_t map_length = length + HUGE_PAGE_SIZE;
+                void* map = mmap(NULL, map_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (map == MAP_FAILED)
+                    return NULL;
+
+                uint8_t* map_begin = (uint8_t*)map;
+                uint8_t* begin = (uint8_t*)__round_up((size_t)map_begin, HUGE_PAGE_SIZE);
+                uint8_t* end = begin + length;
+                if (begin > map_begin)
+                    munmap(map_begin, begin - map_begin);
+                if (map_begin + map_length > end)
+                    munmap(end, (map_begin + map_length) - end);
+
+                result = begin;
+#if defined(MADV_HUGEPAGE)
+                madvise(result, length, MADV_HUGEPAGE);
+#endif
+            }
+
+            *mapped_size = length;
+#endif
+        }
+
+        if (result != NULL && numa_node >= 0)
+            firstTouch(result, size, numa_node);
+
+        return result;
+    }
+
+    void PlatformMemory::release(void* ptr, size_t mapped_size) {
+        if (ptr == NULL)
+            return;
+        if (mapped_size == 0) {
+            free_aligned(ptr);
+            return;
+        }
+#if defined(OS_TARGET_win)
+        VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+        munmap(ptr, mapped_size);
+#endif
+    }
+
+    void PlatformMemory::firstTouch(void* ptr, size_t size, int numa_node) {
+        if (ptr == NULL || size == 0 || numa_node < 0)
+            return;
+        if (PlatformThread::QueryNumberOfNUMANodes() <= 1 || numa_node >= PlatformThread::QueryNumberOfNUMANodes())
+            return;
+
+        __FirstTouchJob job;
+        job.ptr = (uint8_t*)ptr;
+        job.size = size;
+        job.cpus = PlatformThread::QueryNUMANodeCPUs(numa_node);
+        if (job.cpus.size() == 0)
+            return;
+
+        // a new thread, so the affinity of the caller is not changed
+        PlatformThread thread(&__first_touch_thread, &job);
+        thread.start();
+        thread.wait();
+    }
+
+}
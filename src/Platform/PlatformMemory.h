@@ -0,0 +1,74 @@
+#ifndef platform_memory_h
+#define platform_memory_h
+
+#include <aRibeiroCore/common.h>
+
+namespace aRibeiro {
+
+    enum PlatformMemoryPolicy {
+        // malloc_aligned
+        PlatformMemoryPolicy_Default = 0,
+        // anonymous mapping with madvise(MADV_HUGEPAGE) (transparent huge pages)
+        PlatformMemoryPolicy_TransparentHugePages,
+        // explicit huge pages (MAP_HUGETLB / MEM_LARGE_PAGES),
+        // falls back to transparent huge pages when there is no huge page reserved
+        PlatformMemoryPolicy_HugeTLB
+    };
+
+    /// \brief Allocation of large memory blocks with huge pages and NUMA placement.
+    ///
+    /// Large buffers (sort buffers, big arrays) accessed in random order spend a lot
+    /// of time in TLB misses with the 4KB pages. Mapping them with 2MB pages reduces
+    /// the TLB misses.
+    ///
+    /// The NUMA placement uses the first-touch policy of the operating systems:
+    /// a page is placed in the NUMA node of the thread that writes it first.
+    /// The block is touched by a thread pinned to the processors of the node.
+    ///
+    /// Example:
+    ///
+    /// \code
+    /// #include <aRibeiroPlatform/aRibeiroPlatform.h>
+    /// using namespace aRibeiro;
+    ///
+    /// size_t mapped_size;
+    /// uint32_t *keys = (uint32_t *)PlatformMemory::allocate(
+    ///     count * sizeof(uint32_t), PlatformMemoryPolicy_TransparentHugePages, 0, &mapped_size);
+    /// ...
+    /// PlatformMemory::release(keys, mapped_size);
+    /// \endcode
+    ///
+    class PlatformMemory {
+    public:
+
+        static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+        /// \brief Allocate a block with the policy, 64 bytes aligned at least.
+        ///
+        /// \param size bytes to allocate
+        /// \param policy page policy
+        /// \param numa_node node to place the pages (-1: no placement)
+        /// \param mapped_size receives the value to pass to release
+        ///        (0 when the block comes from malloc_aligned)
+        /// \return the block, or NULL on failure
+        ///
+        static void* allocate(size_t size, PlatformMemoryPolicy policy, int numa_node, size_t *mapped_size);
+
+        /// \brief Release a block created with allocate.
+        ///
+        static void release(void* ptr, size_t mapped_size);
+
+        /// \brief Write the pages of a block from a thread running in the NUMA node.
+        ///
+        /// Only pages not touched before are moved to the node (first-touch).
+        ///
+        static void firstTouch(void* ptr, size_t size, int numa_node);
+
+        /// \brief Size of the system page.
+        ///
+        static size_t pageSize();
+    };
+
+}
+
+#endif
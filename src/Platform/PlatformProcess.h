@@ -44,7 +44,7 @@ namespace aRibeiro {
 
         void threadRun() {
 
-            ObjectBuffer signal;
+            ObjectBuffer signal(false);
             queue->read(&signal);
             if (queue->isSignaled())
                 return;
@@ -571,6 +571,14 @@ namespace aRibeiro {
     }
 
     bool PlatformQueueIPC::read(ObjectBuffer *outputBuffer, bool blocking, bool ignore_first_lock) {
+        return readElement(outputBuffer, NULL, NULL, NULL, blocking, ignore_first_lock);
+    }
+
+    bool PlatformQueueIPC::read(MemoryArena *arena, uint8_t **data, uint32_t *size, bool blocking, bool ignore_first_lock) {
+        return readElement(NULL, arena, data, size, blocking, ignore_first_lock);
+    }
+
+    bool PlatformQueueIPC::readElement(ObjectBuffer *outputBuffer, MemoryArena *arena, uint8_t **data, uint32_t *size, bool blocking, bool ignore_first_lock) {
 
         //PlatformAutoLock autoLock(&shm_mutex);
         shm_mutex.lock();
@@ -604,8 +612,14 @@ namespace aRibeiro {
 
         PlatformBufferHeader bufferHeader;
         read_buffer((uint8_t*)&bufferHeader, sizeof(PlatformBufferHeader));
-        outputBuffer->setSize(bufferHeader.size);
-        read_buffer(outputBuffer->data, outputBuffer->size);
+        if (outputBuffer != NULL) {
+            outputBuffer->setSize(bufferHeader.size);
+            read_buffer(outputBuffer->data, outputBuffer->size);
+        } else {
+            *data = (uint8_t*)arena->allocate(bufferHeader.size);
+            *size = bufferHeader.size;
+            read_buffer(*data, bufferHeader.size);
+        }
 
         //if (!ignore_first_lock)
         unlock();
@@ -3,6 +3,7 @@
 
 #include <aRibeiroCore/common.h>
 #include <aRibeiroPlatform/ObjectBuffer.h>
+#include <aRibeiroPlatform/MemoryArena.h>
 
 #if defined(OS_TARGET_win)
 
@@ -63,6 +64,9 @@ namespace aRibeiro {
         void write_buffer(const uint8_t* data, uint32_t size);
         void read_buffer(uint8_t* data, uint32_t size);
 
+        // the element is copied to the outputBuffer, or to memory allocated from the arena
+        bool readElement(ObjectBuffer *outputBuffer, MemoryArena *arena, uint8_t **data, uint32_t *size, bool blocking, bool ignore_first_lock);
+
         //private copy constructores, to avoid copy...
         PlatformQueueIPC(const PlatformQueueIPC& v){}
         void operator=(const PlatformQueueIPC& v){}
@@ -102,6 +106,8 @@ namespace aRibeiro {
 
         bool readHasElement(bool lock_if_true = false);
         bool read(ObjectBuffer *outputBuffer, bool blocking = true, bool ignore_first_lock = false);
+        // read the element to memory allocated from the arena (no heap allocation after the arena warm up)
+        bool read(MemoryArena *arena, uint8_t **data, uint32_t *size, bool blocking = true, bool ignore_first_lock = false);
 
         virtual ~PlatformQueueIPC();
 
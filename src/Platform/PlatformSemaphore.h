@@ -335,6 +335,24 @@ namespace aRibeiro {
     #endif
         }
 
+        // release several permits at once,
+        // wakes at most count threads that are blocked in the semaphore.
+        // Windows: one ReleaseSemaphore call; linux/mac: one post for each permit.
+        void release(uint32_t count) {
+            if (count == 0)
+                return;
+    #if defined(OS_TARGET_win)
+            BOOL result = ReleaseSemaphore( semaphore, (LONG)count, NULL );
+            ARIBEIRO_ABORT(!result, "ReleaseSemaphore error: %s\n", _GetLastErrorToString_semaphore().c_str());
+    #elif defined(OS_TARGET_linux)
+            for (uint32_t i = 0; i < count; i++)
+                sem_post(&semaphore);
+    #elif defined(OS_TARGET_mac)
+            for (uint32_t i = 0; i < count; i++)
+                fake_sem_post(&semaphore);
+    #endif
+        }
+
         // only check if this queue is signaled for the current thread... 
         // it may be active in another thread...
         bool isSignaled() const {
@@ -4,6 +4,7 @@
 #if defined(OS_TARGET_win)
     #include <timeapi.h>
     #include <processthreadsapi.h>
+    #include <intrin.h>
 #else
     #include <sched.h>
     #include <errno.h>
@@ -83,4 +84,16 @@ namespace aRibeiro {
         
     }
 
+    void PlatformSleep::cpuRelax() {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+        _mm_pause();
+#elif defined(_MSC_VER) && (defined(_M_ARM) || defined(_M_ARM64))
+        __yield();
+#elif defined(__i386__) || defined(__x86_64__)
+        __asm__ __volatile__("pause");
+#elif defined(__arm__) || defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
 }
@@ -76,6 +76,25 @@ namespace aRibeiro {
         static void busySleepMicro(int64_t micros);
 
         static void yield();
+
+        /// \brief Hint the processor the current thread is inside a spin-wait loop.
+        ///
+        /// Uses the pause instruction on x86 and the yield instruction on ARM.
+        /// It does not call the operating system.
+        ///
+        /// Example:
+        ///
+        /// \code
+        /// #include <aRibeiroPlatform/aRibeiroPlatform.h>
+        /// using namespace aRibeiro;
+        ///
+        /// while (!flag)
+        ///     PlatformSleep::cpuRelax();
+        /// \endcode
+        ///
+        /// \author Alessandro Ribeiro
+        ///
+        static void cpuRelax();
     };
 
 }
@@ -4,6 +4,7 @@
 #include <aRibeiroPlatform/GlobalThreadOptions.h>
 
 #include <stdio.h>
+#include <algorithm>
 
 #if defined(OS_TARGET_win)
     #include <process.h>
@@ -15,6 +16,8 @@
     #include <sys/types.h>
     #include <signal.h>
     #include <pthread.h>
+    #include <sched.h>
+    #include <dirent.h>
 
     #define GetCurrentThreadId() syscall(SYS_gettid)
 
@@ -762,4 +765,146 @@ namespace aRibeiro {
 #endif
     
 
+    //
+    // NUMA topology and affinity
+    //
+
+#if defined(OS_TARGET_linux)
+    // parse the sysfs cpu list format: "0-3,8-11"
+    static std::vector<int> __parse_cpu_list(const char* str) {
+        std::vector<int> result;
+        const char* ptr = str;
+        while (*ptr != 0 && *ptr != '\n') {
+            char* end;
+            long first = strtol(ptr, &end, 10);
+            if (end == ptr)
+                break;
+            long last = first;
+            ptr = end;
+            if (*ptr == '-') {
+                ptr++;
+                last = strtol(ptr, &end, 10);
+                ptr = end;
+            }
+            for (long i = first; i <= last; i++)
+                result.push_back((int)i);
+            if (*ptr == ',')
+                ptr++;
+        }
+        return result;
+    }
+
+    // sysfs ids of the NUMA nodes, sorted.
+    // The ids may have gaps (node0, node2, ...): the node index of the API is the position in this list.
+    static std::vector<int> __read_node_ids() {
+        std::vector<int> result;
+        FILE* file = fopen("/sys/devices/system/node/online", "rb");
+        if (file != NULL) {
+            char buffer[4096];
+            size_t readed = fread(buffer, 1, sizeof(buffer) - 1, file);
+            buffer[readed] = 0;
+            fclose(file);
+            result = __parse_cpu_list(buffer);
+            if (result.size() > 0)
+                return result;
+        }
+        // no online file: list the node directories
+        DIR* dir = opendir("/sys/devices/system/node");
+        if (dir == NULL)
+            return result;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            int id;
+            char tail;
+            if (sscanf(entry->d_name, "node%i%c", &id, &tail) == 1)
+                result.push_back(id);
+        }
+        closedir(dir);
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    static bool __read_node_cpu_list(int node, std::vector<int>* result) {
+        std::vector<int> ids = __read_node_ids();
+        if (node < 0 || node >= (int)ids.size())
+            return false;
+        char path[128];
+        sprintf(path, "/sys/devices/system/node/node%i/cpulist", ids[node]);
+        FILE* file = fopen(path, "rb");
+        if (file == NULL)
+            return false;
+        char buffer[4096];
+        size_t readed = fread(buffer, 1, sizeof(buffer) - 1, file);
+        buffer[readed] = 0;
+        fclose(file);
+        *result = __parse_cpu_list(buffer);
+        return true;
+    }
+#endif
+
+    int PlatformThread::QueryNumberOfNUMANodes() {
+#if defined(OS_TARGET_win)
+        ULONG highest_node = 0;
+        if (!GetNumaHighestNodeNumber(&highest_node))
+            return 1;
+        return (int)highest_node + 1;
+#elif defined(OS_TARGET_linux)
+        int count = (int)__read_node_ids().size();
+        return (count > 0) ? count : 1;
+#else
+        return 1;
+#endif
+    }
+
+    std::vector<int> PlatformThread::QueryNUMANodeCPUs(int node) {
+        std::vector<int> result;
+#if defined(OS_TARGET_win)
+        ULONGLONG mask = 0;
+        if (GetNumaNodeProcessorMask((UCHAR)node, &mask)) {
+            for (int i = 0; i < 64; i++) {
+                if (mask & (1ULL << i))
+                    result.push_back(i);
+            }
+            return result;
+        }
+#elif defined(OS_TARGET_linux)
+        if (__read_node_cpu_list(node, &result) && result.size() > 0)
+            return result;
+        result.clear();
+#endif
+        // no NUMA information: all processors are in the node 0
+        if (node == 0) {
+            int count = QueryNumberOfSystemThreads();
+            for (int i = 0; i < count; i++)
+                result.push_back(i);
+        }
+        return result;
+    }
+
+    bool PlatformThread::setCurrentThreadAffinity(const std::vector<int>& cpus) {
+        if (cpus.size() == 0)
+            return false;
+#if defined(OS_TARGET_win)
+        DWORD_PTR mask = 0;
+        for (size_t i = 0; i < cpus.size(); i++) {
+            if (cpus[i] >= 0 && cpus[i] < (int)(sizeof(DWORD_PTR) * 8))
+                mask |= ((DWORD_PTR)1) << cpus[i];
+        }
+        if (mask == 0)
+            return false;
+        return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(OS_TARGET_linux)
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        for (size_t i = 0; i < cpus.size(); i++) {
+            if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE)
+                CPU_SET(cpus[i], &cpuset);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0;
+#else
+        // mac: there is no API to pin a thread to a processor
+        return false;
+#endif
+    }
+
 }
@@ -688,6 +688,32 @@ public:
         */
         }
 
+        /// \brief Number of NUMA nodes of the machine.
+        ///
+        /// Returns 1 when the platform does not expose the NUMA topology.
+        ///
+        static int QueryNumberOfNUMANodes();
+
+        /// \brief Logical processors that belongs to a NUMA node.
+        ///
+        /// The index is the position of the node in the sorted list of the online nodes,
+        /// so it is contiguous even when the system node ids have gaps.
+        ///
+        /// \param node NUMA node index, from 0 to QueryNumberOfNUMANodes()-1
+        ///
+        static std::vector<int> QueryNUMANodeCPUs(int node);
+
+        /// \brief Set the processors the current thread is allowed to run.
+        ///
+        /// Uses pthread_setaffinity_np on linux and SetThreadAffinityMask on windows.
+        ///
+        /// \warning Not supported on mac (returns false).
+        ///
+        /// \param cpus logical processor indexes
+        /// \return true if the affinity was set
+        ///
+        static bool setCurrentThreadAffinity(const std::vector<int>& cpus);
+
     };
 
 }
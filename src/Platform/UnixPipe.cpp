@@ -86,6 +86,8 @@ namespace aRibeiro
             return false;
         if (outputBuffer->size == 0)
             outputBuffer->setSize(64 * 1024); // 64k
+        else if (outputBuffer->size < outputBuffer->alloc_size)
+            outputBuffer->setSize(outputBuffer->alloc_size); // reuse the whole allocation
 
         ssize_t received = ::read(read_fd, outputBuffer->data, outputBuffer->size);
         if (received > 0)
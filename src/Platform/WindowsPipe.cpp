@@ -164,6 +164,8 @@ namespace aRibeiro
 			return false;
 		if (outputBuffer->size == 0)
 			outputBuffer->setSize(64 * 1024); // 64k
+		else if (outputBuffer->size < outputBuffer->alloc_size)
+			outputBuffer->setSize(outputBuffer->alloc_size); // reuse the whole allocation
 
 		//https://stackoverflow.com/questions/42402673/createprocess-and-capture-stdout
 
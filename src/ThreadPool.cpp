@@ -2,28 +2,372 @@
 
 namespace aRibeiro {
 
-	void ThreadPool::run() {
-		bool isSignaled;
-		while (!PlatformThread::isCurrentThreadInterrupted()) {
-			TaskMethod_Fnc job = task_queue.dequeue(&isSignaled);
-			if (isSignaled)
+	// worker that is running in the current thread
+	static thread_local ThreadPoolWorker* __current_worker = NULL;
+	// victim selection of threads that help the pool from outside
+	static thread_local uint32_t __helper_random_state = 0x6C078965u;
+	static thread_local uint32_t __helper_aging_tick = 0;
+
+	// the aging is checked once every AGING_CHECK_INTERVAL searches
+	static const uint32_t AGING_CHECK_INTERVAL = 16;
+
+	void ThreadPool::workerEntryPoint(ThreadPoolWorker* worker) {
+		if (worker->cpus.size() > 0 && !PlatformThread::setCurrentThreadAffinity(worker->cpus))
+			worker->affinity_failed.store(true, std::memory_order_relaxed);
+		__current_worker = worker;
+		worker->pool->run(worker);
+		__current_worker = NULL;
+	}
+
+	void ThreadPool::executeTask(ThreadPoolTask* task) {
+		task->fnc();
+		task->done.store(true, std::memory_order_release);
+		if (task->group != NULL)
+			task->group->taskDone();
+		unfinished_tasks.fetch_sub(1, std::memory_order_release);
+		task->releaseReference();
+	}
+
+	bool ThreadPool::findNormalTask(ThreadPoolNode* node, ThreadPoolWorker* worker, uint32_t* random_state, ThreadPoolTask** task) {
+		if (scheduler == ThreadPoolScheduler_SharedQueue) {
+			*task = node->dequeueNormal();
+			return *task != NULL;
+		}
+
+		// own deque
+		if (worker != NULL && worker->deque.pop(task))
+			return true;
+
+		// steal from a random victim of the same node
+		int count = (int)node->workers.size();
+		if (count > 0) {
+			// xorshift32
+			uint32_t x = *random_state;
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			*random_state = x;
+
+			int start = (int)(x % (uint32_t)count);
+			for (int i = 0; i < count; i++) {
+				ThreadPoolWorker* victim = node->workers[(start + i) % count];
+				if (victim == worker)
+					continue;
+				if (victim->deque.steal(task))
+					return true;
+			}
+		}
+
+		// injection queue of the node
+		*task = node->dequeueNormal();
+		return *task != NULL;
+	}
+
+	bool ThreadPool::dequeueLane(ThreadPoolNode* node, GlobalThreadPriority priority, ThreadPoolTask** task) {
+		if (priority == GlobalThreadPriority_Normal)
+			return false;
+		*task = node->getLaneQueue(priority)->dequeue();
+		if (*task == NULL)
+			return false;
+		node->lane_count.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool ThreadPool::dequeueDeadline(ThreadPoolNode* node, ThreadPoolTask** task) {
+		ThreadPoolDeadlineTask entry;
+		if (!node->deadline_queue.tryDequeue(&entry))
+			return false;
+		*task = entry.task;
+		node->lane_count.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool ThreadPool::findAgedTask(ThreadPoolNode* node, ThreadPoolWorker* worker, uint32_t* random_state, ThreadPoolTask** task) {
+		int64_t aging = aging_time.load(std::memory_order_relaxed);
+		if (aging <= 0)
+			return false;
+		int64_t now = nowMicro();
+		int64_t limit = now - aging;
+
+		// lowest lanes first
+		for (int lane = GlobalThreadPriority_None; lane <= GlobalThreadPriority_High; lane++) {
+			if (node->lane_served_time[lane].load(std::memory_order_relaxed) > limit)
+				continue;
+			bool found;
+			if (lane == GlobalThreadPriority_Normal)
+				found = findNormalTask(node, worker, random_state, task);
+			else
+				found = dequeueLane(node, (GlobalThreadPriority)lane, task);
+			// an empty lane is not starving either
+			node->lane_served_time[lane].store(now, std::memory_order_relaxed);
+			if (found)
+				return true;
+		}
+		return false;
+	}
+
+	bool ThreadPool::findTask(ThreadPoolNode* node, ThreadPoolWorker* worker, uint32_t* random_state, ThreadPoolTask** task) {
+		// fast path: only normal tasks
+		if (node->lane_count.load(std::memory_order_relaxed) <= 0) {
+			if (findNormalTask(node, worker, random_state, task))
+				return true;
+			// a lane task may arrive after the first check
+			if (node->lane_count.load(std::memory_order_relaxed) <= 0)
+				return false;
+		}
+
+		uint32_t* aging_tick = (worker != NULL) ? &worker->aging_tick : &__helper_aging_tick;
+		if (((*aging_tick)++ % AGING_CHECK_INTERVAL) == 0 && findAgedTask(node, worker, random_state, task))
+			return true;
+
+		if (dequeueLane(node, GlobalThreadPriority_Realtime, task) ||
+			dequeueDeadline(node, task))
+			return true;
+
+		if (dequeueLane(node, GlobalThreadPriority_High, task)) {
+			node->lane_served_time[GlobalThreadPriority_High].store(nowMicro(), std::memory_order_relaxed);
+			return true;
+		}
+
+		if (findNormalTask(node, worker, random_state, task)) {
+			node->lane_served_time[GlobalThreadPriority_Normal].store(nowMicro(), std::memory_order_relaxed);
+			return true;
+		}
+
+		if (dequeueLane(node, GlobalThreadPriority_None, task)) {
+			node->lane_served_time[GlobalThreadPriority_None].store(nowMicro(), std::memory_order_relaxed);
+			return true;
+		}
+
+		return false;
+	}
+
+	bool ThreadPool::tryAcquirePermit(ThreadPoolNode* node) {
+		if (exiting.load(std::memory_order_relaxed))
+			return false;
+		int32_t count = node->pending_count.load(std::memory_order_relaxed);
+		while (count > 0) {
+			if (node->pending_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed))
+				return true;
+		}
+		return false;
+	}
+
+	// wake min(count, parked workers): each post is claimed from the parked_count,
+	// so a batch of tasks does not post the semaphore once for each task
+	void ThreadPool::wakeWorkers(ThreadPoolNode* node, int32_t count) {
+		// pairs with the fence in waitPermit: either the worker sees the new permits
+		// or this thread sees the worker in the parked_count
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int32_t parked = node->parked_count.load(std::memory_order_relaxed);
+		int32_t wake;
+		do {
+			if (parked <= 0)
 				return;
-			job();
+			wake = (count < parked) ? count : parked;
+		} while (!node->parked_count.compare_exchange_weak(parked, parked - wake, std::memory_order_relaxed, std::memory_order_relaxed));
+		node->wakeup.release((uint32_t)wake);
+	}
+
+	bool ThreadPool::waitPermit(ThreadPoolWorker* worker) {
+		ThreadPoolNode* node = worker->node;
+
+		uint32_t spin_count = idle_spin_count.load(std::memory_order_relaxed);
+		uint32_t yield_count = idle_yield_count.load(std::memory_order_relaxed);
+		uint32_t min_spin_count = idle_min_spin_count.load(std::memory_order_relaxed);
+		bool adaptive = idle_adaptive.load(std::memory_order_relaxed);
+
+		uint32_t spin_limit = spin_count;
+		if (adaptive) {
+			if (worker->spin_limit > spin_count)
+				worker->spin_limit = spin_count;
+			else if (worker->spin_limit < min_spin_count)
+				worker->spin_limit = (min_spin_count < spin_count) ? min_spin_count : spin_count;
+			spin_limit = worker->spin_limit;
+		}
+
+		for (uint32_t i = 0; i < spin_limit; i++) {
+			if (tryAcquirePermit(node)) {
+				worker->spin_wakeups.fetch_add(1, std::memory_order_relaxed);
+				if (adaptive) {
+					uint32_t new_limit = spin_limit << 1;
+					worker->spin_limit = (new_limit > spin_count || new_limit < spin_limit) ? spin_count : new_limit;
+				}
+				return true;
+			}
+			PlatformSleep::cpuRelax();
+		}
+
+		if (adaptive)
+			worker->spin_limit = spin_limit >> 1;
+
+		for (uint32_t i = 0; i < yield_count; i++) {
+			if (tryAcquirePermit(node)) {
+				worker->yield_wakeups.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+			PlatformSleep::yield();
+		}
+
+		while (true) {
+			node->parked_count.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (tryAcquirePermit(node)) {
+				// leave the parked_count, if a producer already claimed this worker
+				// its post stays in the semaphore and the next park returns right away
+				int32_t parked = node->parked_count.load(std::memory_order_relaxed);
+				while (parked > 0 && !node->parked_count.compare_exchange_weak(parked, parked - 1, std::memory_order_relaxed, std::memory_order_relaxed));
+				worker->yield_wakeups.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+			if (!node->wakeup.blockingAcquire())
+				return false;
+			// another worker can take the permit first, then park again
+			if (tryAcquirePermit(node)) {
+				worker->park_wakeups.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+			if (exiting.load(std::memory_order_relaxed))
+				return false;
 		}
 	}
 
-	ThreadPool::ThreadPool() {
+	void ThreadPool::run(ThreadPoolWorker* worker) {
+		ThreadPoolNode* node = worker->node;
+		while (true) {
+			if (!waitPermit(worker))
+				return;
+
+			// the permit guarantees there is at least one task available in the node
+			ThreadPoolTask* task = NULL;
+			while (!findTask(node, worker, &worker->random_state, &task))
+				PlatformSleep::yield();
+
+			executeTask(task);
+		}
+	}
+
+	void ThreadPool::initialize(int threadCount, const std::vector<int>& cpuSet, ThreadPoolPinPolicy _pinPolicy, ThreadPoolScheduler _scheduler) {
+
+		scheduler = _scheduler;
+		pinPolicy = _pinPolicy;
+		next_node.store(0, std::memory_order_relaxed);
+		unfinished_tasks.store(0, std::memory_order_relaxed);
+		exiting.store(false, std::memory_order_relaxed);
+		setIdlePolicy(ThreadPoolIdlePolicy());
+		aging_time.store(10000, std::memory_order_relaxed);
+
+		std::vector<int> cpus = cpuSet;
+		if (cpus.size() == 0) {
+			int count = PlatformThread::QueryNumberOfSystemThreads();
+			for (int i = 0; i < count; i++)
+				cpus.push_back(i);
+		}
+		if (threadCount <= 0)
+			threadCount = (int)cpus.size();
+
+		// group the cpu set by NUMA node, keeping the cpu set order
+		int numa_count = PlatformThread::QueryNumberOfNUMANodes();
+		std::map<int, int> cpu_to_numa;
+		for (int i = 0; i < numa_count; i++) {
+			std::vector<int> node_cpus = PlatformThread::QueryNUMANodeCPUs(i);
+			for (size_t j = 0; j < node_cpus.size(); j++)
+				cpu_to_numa[node_cpus[j]] = i;
+		}
+		std::vector< std::vector<int> > numa_cpus(numa_count);
+		for (size_t i = 0; i < cpus.size(); i++) {
+			std::map<int, int>::iterator it = cpu_to_numa.find(cpus[i]);
+			int numa = (it != cpu_to_numa.end()) ? it->second : 0;
+			numa_cpus[numa].push_back(cpus[i]);
+		}
+		std::vector<int> used_numa;
+		for (int i = 0; i < numa_count; i++) {
+			if (numa_cpus[i].size() > 0)
+				used_numa.push_back(i);
+		}
+
+		// create the sub-pools
+		if (pinPolicy == ThreadPoolPinPolicy_PerNUMANode) {
+			for (size_t i = 0; i < used_numa.size(); i++) {
+				ThreadPoolNode* node = new ThreadPoolNode();
+				node->numa_node = used_numa[i];
+				nodes.push_back(node);
+			}
+		}
+		else
+			nodes.push_back(new ThreadPoolNode());
+
+		// processor order of the scatter policy: one processor of each NUMA node at a time
+		std::vector<int> scatter_cpus;
+		if (pinPolicy == ThreadPoolPinPolicy_Scatter) {
+			size_t max_node_size = 0;
+			for (size_t i = 0; i < used_numa.size(); i++)
+				max_node_size = (std::max)(max_node_size, numa_cpus[used_numa[i]].size());
+			for (size_t j = 0; j < max_node_size; j++) {
+				for (size_t i = 0; i < used_numa.size(); i++) {
+					const std::vector<int>& node_cpus = numa_cpus[used_numa[i]];
+					if (j < node_cpus.size())
+						scatter_cpus.push_back(node_cpus[j]);
+				}
+			}
+		}
+
+		int64_t now = nowMicro();
+		for (size_t i = 0; i < nodes.size(); i++) {
+			for (int j = 0; j < 4; j++)
+				nodes[i]->lane_served_time[j].store(now, std::memory_order_relaxed);
+		}
+
+		for (int i = 0; i < threadCount; i++) {
+			ThreadPoolWorker* worker = new ThreadPoolWorker();
+			worker->pool = this;
+			worker->index = i;
+			worker->random_state = 0x9E3779B9u * (uint32_t)(i + 1);
+			worker->aging_tick = 0;
+			worker->spin_limit = 0;
+			worker->spin_wakeups.store(0, std::memory_order_relaxed);
+			worker->yield_wakeups.store(0, std::memory_order_relaxed);
+			worker->park_wakeups.store(0, std::memory_order_relaxed);
+			worker->affinity_failed.store(false, std::memory_order_relaxed);
 
-		for (int i = 0; i < PlatformThread::QueryNumberOfSystemThreads(); i++)
-			threads.push_back(new PlatformThread(this, &ThreadPool::run));
+			switch (pinPolicy) {
+			case ThreadPoolPinPolicy_Compact:
+				worker->node = nodes[0];
+				worker->cpus.push_back(cpus[i % cpus.size()]);
+				break;
+			case ThreadPoolPinPolicy_Scatter:
+				worker->node = nodes[0];
+				worker->cpus.push_back(scatter_cpus[i % scatter_cpus.size()]);
+				break;
+			case ThreadPoolPinPolicy_PerNUMANode:
+				worker->node = nodes[i % nodes.size()];
+				worker->cpus = numa_cpus[worker->node->numa_node];
+				break;
+			default:
+				worker->node = nodes[0];
+				break;
+			}
+
+			worker->node->workers.push_back(worker);
+			worker->thread = new PlatformThread(&ThreadPool::workerEntryPoint, worker);
+			workers.push_back(worker);
+			threads.push_back(worker->thread);
+		}
 		for (int i = 0; i < threads.size(); i++)
 			threads[i]->start();
+	}
+
+	ThreadPool::ThreadPool(ThreadPoolScheduler _scheduler) {
+		initialize(0, std::vector<int>(), ThreadPoolPinPolicy_None, _scheduler);
+	}
 
-		printf("[ThreadPool] Created %i threads on the pool.\n", (int)threads.size());
+	ThreadPool::ThreadPool(int threadCount, const std::vector<int>& cpuSet, ThreadPoolPinPolicy _pinPolicy, ThreadPoolScheduler _scheduler) {
+		initialize(threadCount, cpuSet, _pinPolicy, _scheduler);
 	}
 
 	ThreadPool::~ThreadPool() {
 
+		exiting.store(true, std::memory_order_relaxed);
 		for (int i = 0; i < threads.size(); i++)
 			threads[i]->interrupt();
 		for (int i = 0; i < threads.size(); i++)
@@ -32,9 +376,279 @@ namespace aRibeiro {
 			delete threads[i];
 		threads.clear();
 
+		// release the tasks that were not executed (lanes, queues and worker deques)
+		for (int i = 0; i < nodes.size(); i++) {
+			ThreadPoolTask* task;
+			while (findTask(nodes[i], NULL, &__helper_random_state, &task))
+				task->releaseReference();
+		}
+
+		for (int i = 0; i < workers.size(); i++)
+			delete workers[i];
+		workers.clear();
+
+		for (int i = 0; i < nodes.size(); i++)
+			delete nodes[i];
+		nodes.clear();
+
+	}
+
+	ThreadPoolTask* ThreadPool::createTask(const TaskMethod_Fnc& fnc, ThreadPoolTaskGroup* group, GlobalThreadPriority priority, int64_t deadline) {
+		ThreadPoolTask* task = new ThreadPoolTask();
+		task->fnc = fnc;
+		task->group = group;
+		task->references.store(1, std::memory_order_relaxed);
+		task->done.store(false, std::memory_order_relaxed);
+		task->priority = priority;
+		task->has_deadline = false;
+		task->deadline = deadline;
+		return task;
+	}
+
+	int64_t ThreadPool::nowMicro() {
+#if defined(OS_TARGET_win)
+		return clock.GetCounterMicro(false);
+#else
+		return clock.GetDeltaMicro(false);
+#endif
+	}
+
+	ThreadPoolNode* ThreadPool::selectNode(ThreadPoolWorker* worker) {
+		if (worker != NULL)
+			return worker->node;
+		if (nodes.size() == 1)
+			return nodes[0];
+		return nodes[next_node.fetch_add(1, std::memory_order_relaxed) % nodes.size()];
+	}
+
+	void ThreadPool::enqueueTasks(ThreadPoolNode* node, ThreadPoolWorker* worker, ThreadPoolTask** tasks, size_t count) {
+		if (scheduler == ThreadPoolScheduler_WorkStealing && worker != NULL && worker->node == node) {
+			for (size_t i = 0; i < count; i++)
+				worker->deque.push(tasks[i]);
+		}
+		else
+			node->enqueueNormal(tasks, count);
+		node->pending_count.fetch_add((int32_t)count, std::memory_order_release);
+		wakeWorkers(node, (int32_t)count);
+	}
+
+	void ThreadPool::enqueueLaneTask(ThreadPoolNode* node, ThreadPoolTask* task) {
+		node->lane_count.fetch_add(1, std::memory_order_relaxed);
+		if (task->has_deadline)
+			node->deadline_queue.enqueue(ThreadPoolDeadlineTask(task->deadline, task));
+		else
+			node->getLaneQueue(task->priority)->enqueue(task);
+		node->pending_count.fetch_add(1, std::memory_order_release);
+		wakeWorkers(node, 1);
+	}
+
+	ThreadPoolTaskHandle ThreadPool::postSingleTask(ThreadPoolNode* node, ThreadPoolTask* task) {
+		// create the handle before the task can run and release the pool reference
+		ThreadPoolTaskHandle handle(task);
+
+		if (task->group != NULL)
+			task->group->taskPosted();
+		unfinished_tasks.fetch_add(1, std::memory_order_relaxed);
+
+		if (task->priority == GlobalThreadPriority_Normal && !task->has_deadline)
+			enqueueTasks(node, getCurrentWorker(), &task, 1);
+		else
+			enqueueLaneTask(node, task);
+
+		return handle;
+	}
+
+	ThreadPoolTaskHandle ThreadPool::postTask(const TaskMethod_Fnc& fnc, ThreadPoolTaskGroup* group) {
+		return postSingleTask(selectNode(getCurrentWorker()), createTask(fnc, group));
+	}
+
+	ThreadPoolTaskHandle ThreadPool::postTaskToNode(int node, const TaskMethod_Fnc& fnc, ThreadPoolTaskGroup* group) {
+		ARIBEIRO_ABORT(node < 0 || node >= (int)nodes.size(), "ThreadPool: invalid node index.\n");
+		return postSingleTask(nodes[node], createTask(fnc, group));
+	}
+
+	ThreadPoolTaskHandle ThreadPool::postTask(const TaskMethod_Fnc& fnc, GlobalThreadPriority priority, ThreadPoolTaskGroup* group) {
+		return postSingleTask(selectNode(getCurrentWorker()), createTask(fnc, group, priority));
+	}
+
+	ThreadPoolTaskHandle ThreadPool::postTaskWithDeadline(const TaskMethod_Fnc& fnc, int64_t deadlineMicro, ThreadPoolTaskGroup* group) {
+		ThreadPoolTask* task = createTask(fnc, group, GlobalThreadPriority_Normal, nowMicro() + deadlineMicro);
+		task->has_deadline = true;
+		return postSingleTask(selectNode(getCurrentWorker()), task);
+	}
+
+	void ThreadPool::postTasks(const TaskMethod_Fnc* fnc, size_t count, ThreadPoolTaskGroup* group) {
+		if (count == 0)
+			return;
+
+		std::vector<ThreadPoolTask*> tasks(count);
+		for (size_t i = 0; i < count; i++)
+			tasks[i] = createTask(fnc[i], group);
+
+		if (group != NULL)
+			group->taskPosted((int32_t)count);
+		unfinished_tasks.fetch_add((int32_t)count, std::memory_order_relaxed);
+
+		ThreadPoolWorker* worker = getCurrentWorker();
+		if (worker != NULL || nodes.size() == 1) {
+			enqueueTasks(selectNode(worker), worker, &tasks[0], count);
+			return;
+		}
+
+		// external thread: split the batch between the sub-pools
+		size_t node_count = nodes.size();
+		size_t first = next_node.fetch_add(1, std::memory_order_relaxed);
+		size_t offset = 0;
+		for (size_t i = 0; i < node_count; i++) {
+			size_t node_tasks = count / node_count + ((i < count % node_count) ? 1 : 0);
+			if (node_tasks == 0)
+				continue;
+			enqueueTasks(nodes[(first + i) % node_count], NULL, &tasks[offset], node_tasks);
+			offset += node_tasks;
+		}
+	}
+
+	void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain, const ParallelForMethod_Fnc& fnc) {
+		if (end <= begin)
+			return;
+		if (grain == 0)
+			grain = 1;
+
+		ThreadPoolParallelFor job;
+		job.fnc = fnc;
+		job.next.store(begin, std::memory_order_relaxed);
+		job.end = end;
+		job.grain = grain;
+
+		// the calling thread is one of the participants
+		size_t chunks = (end - begin + grain - 1) / grain;
+		size_t helpers = chunks - 1;
+		if (helpers > threads.size())
+			helpers = threads.size();
+
+		ThreadPoolTaskGroup group;
+		if (helpers > 0) {
+			std::vector<TaskMethod_Fnc> fncs(helpers, TaskMethod_Fnc(&job, &ThreadPoolParallelFor::run));
+			postTasks(&fncs[0], helpers, &group);
+		}
+
+		job.run();
+		waitAll(&group);
+	}
+
+	bool ThreadPool::runPendingTask() {
+		ThreadPoolWorker* worker = getCurrentWorker();
+		uint32_t* random_state = (worker != NULL) ? &worker->random_state : &__helper_random_state;
+
+		ThreadPoolNode* node = NULL;
+		if (worker != NULL) {
+			if (tryAcquirePermit(worker->node))
+				node = worker->node;
+		}
+		else {
+			size_t first = (nodes.size() == 1) ? 0 : (size_t)(*random_state % nodes.size());
+			for (size_t i = 0; i < nodes.size(); i++) {
+				ThreadPoolNode* candidate = nodes[(first + i) % nodes.size()];
+				if (tryAcquirePermit(candidate)) {
+					node = candidate;
+					break;
+				}
+			}
+		}
+		if (node == NULL)
+			return false;
+
+		ThreadPoolTask* task = NULL;
+		while (!findTask(node, worker, random_state, &task))
+			PlatformSleep::yield();
+
+		executeTask(task);
+		return true;
+	}
+
+	void ThreadPool::wait(const ThreadPoolTaskHandle& handle) {
+		while (!handle.isDone()) {
+			if (!runPendingTask())
+				PlatformSleep::yield();
+		}
+	}
+
+	void ThreadPool::waitAll(ThreadPoolTaskGroup* group) {
+		while (!group->isDone()) {
+			if (!runPendingTask())
+				PlatformSleep::yield();
+		}
+	}
+
+	void ThreadPool::waitAll() {
+		while (unfinished_tasks.load(std::memory_order_acquire) > 0) {
+			if (!runPendingTask())
+				PlatformSleep::yield();
+		}
+	}
+
+	int ThreadPool::getThreadCount() const {
+		return (int)threads.size();
+	}
+
+	ThreadPoolScheduler ThreadPool::getScheduler() const {
+		return scheduler;
+	}
+
+	ThreadPoolPinPolicy ThreadPool::getPinPolicy() const {
+		return pinPolicy;
+	}
+
+	int ThreadPool::getNodeCount() const {
+		return (int)nodes.size();
+	}
+
+	void ThreadPool::setIdlePolicy(const ThreadPoolIdlePolicy& policy) {
+		idle_spin_count.store(policy.spinCount, std::memory_order_relaxed);
+		idle_yield_count.store(policy.yieldCount, std::memory_order_relaxed);
+		idle_min_spin_count.store(policy.minSpinCount, std::memory_order_relaxed);
+		idle_adaptive.store(policy.adaptive, std::memory_order_relaxed);
+	}
+
+	ThreadPoolIdlePolicy ThreadPool::getIdlePolicy() const {
+		return ThreadPoolIdlePolicy(
+			idle_spin_count.load(std::memory_order_relaxed),
+			idle_yield_count.load(std::memory_order_relaxed),
+			idle_adaptive.load(std::memory_order_relaxed),
+			idle_min_spin_count.load(std::memory_order_relaxed)
+		);
+	}
+
+	int ThreadPool::getAffinityFailureCount() const {
+		int result = 0;
+		for (size_t i = 0; i < workers.size(); i++) {
+			if (workers[i]->affinity_failed.load(std::memory_order_relaxed))
+				result++;
+		}
+		return result;
+	}
+
+	ThreadPoolIdleStats ThreadPool::getIdleStats() const {
+		ThreadPoolIdleStats result;
+		for (size_t i = 0; i < workers.size(); i++) {
+			result.spinWakeups += workers[i]->spin_wakeups.load(std::memory_order_relaxed);
+			result.yieldWakeups += workers[i]->yield_wakeups.load(std::memory_order_relaxed);
+			result.parkWakeups += workers[i]->park_wakeups.load(std::memory_order_relaxed);
+		}
+		return result;
+	}
+
+	void ThreadPool::setAgingTime(int64_t micros) {
+		aging_time.store(micros, std::memory_order_relaxed);
+	}
+
+	int64_t ThreadPool::getAgingTime() const {
+		return aging_time.load(std::memory_order_relaxed);
 	}
 
-	void ThreadPool::postTask(const TaskMethod_Fnc& fnc) {
-		task_queue.enqueue(fnc);
+	ThreadPoolWorker* ThreadPool::getCurrentWorker() {
+		if (__current_worker != NULL && __current_worker->pool == this)
+			return __current_worker;
+		return NULL;
 	}
 }
@@ -3,27 +3,431 @@
 
 #include <aRibeiroCore/MethodPointer.h>
 #include <aRibeiroPlatform/ObjectQueue.h>
+#include <aRibeiroPlatform/ObjectRingQueue.h>
+#include <aRibeiroPlatform/ObjectPriorityQueue.h>
+#include <aRibeiroPlatform/ObjectWorkStealingDeque.h>
 #include <aRibeiroPlatform/PlatformThread.h>
 #include <aRibeiroPlatform/PlatformSemaphore.h>
+#include <aRibeiroPlatform/PlatformTime.h>
+#include <aRibeiroPlatform/GlobalThreadOptions.h>
+
+#include <atomic>
 
 namespace aRibeiro {
 
 	DefineMethodPointer(TaskMethod_Fnc, void) VoidMethodCall();
+	DefineMethodPointer(ParallelForMethod_Fnc, void, size_t begin, size_t end) VoidMethodCall(begin, end);
+
+	enum ThreadPoolScheduler {
+		// all workers dequeue from one mutex protected queue
+		ThreadPoolScheduler_SharedQueue,
+		// each worker owns a lock-free deque, idle workers steal from the others,
+		// tasks posted from outside the pool go to a global injection queue
+		ThreadPoolScheduler_WorkStealing
+	};
+
+	enum ThreadPoolPinPolicy {
+		// workers are not pinned
+		ThreadPoolPinPolicy_None,
+		// worker i is pinned to the i-th processor of the cpu set
+		ThreadPoolPinPolicy_Compact,
+		// workers are pinned alternating the NUMA nodes of the cpu set
+		ThreadPoolPinPolicy_Scatter,
+		// one sub-pool for each NUMA node, each worker can run on any processor of its node
+		ThreadPoolPinPolicy_PerNUMANode
+	};
+
+	// What an idle worker does before blocking in the kernel.
+	//
+	// The worker spins (PlatformSleep::cpuRelax) up to spinCount times, then calls
+	// PlatformSleep::yield up to yieldCount times and then parks in the semaphore.
+	//
+	// When adaptive is true each worker adjusts its own spin limit between minSpinCount
+	// and spinCount: it doubles when a task arrives while spinning (tasks are arriving often)
+	// and halves when the worker had to yield or park (tasks are arriving rarely).
+	struct ThreadPoolIdlePolicy {
+		uint32_t spinCount;
+		uint32_t yieldCount;
+		bool adaptive;
+		uint32_t minSpinCount;
+
+		ThreadPoolIdlePolicy(uint32_t _spinCount = 0, uint32_t _yieldCount = 0, bool _adaptive = false, uint32_t _minSpinCount = 16) {
+			spinCount = _spinCount;
+			yieldCount = _yieldCount;
+			adaptive = _adaptive;
+			minSpinCount = _minSpinCount;
+		}
+	};
+
+	// How the idle workers got their tasks.
+	//
+	// spinWakeups + yieldWakeups are the wakeups that avoided the kernel.
+	struct ThreadPoolIdleStats {
+		uint64_t spinWakeups;
+		uint64_t yieldWakeups;
+		uint64_t parkWakeups;
+
+		ThreadPoolIdleStats() {
+			spinWakeups = 0;
+			yieldWakeups = 0;
+			parkWakeups = 0;
+		}
+
+		uint64_t avoidedWakeups() const {
+			return spinWakeups + yieldWakeups;
+		}
+	};
+
+	class ThreadPool;
+
+	// Counts the tasks posted with this group that are not finished yet.
+	//
+	// ThreadPool::waitAll(&group) runs pending tasks of the pool until the group is done.
+	class ThreadPoolTaskGroup {
+		std::atomic<int32_t> pending;
+
+		//private copy constructores, to avoid copy...
+		ThreadPoolTaskGroup(const ThreadPoolTaskGroup& v) {}
+		void operator=(const ThreadPoolTaskGroup& v) {}
+
+	public:
+		ThreadPoolTaskGroup() {
+			pending.store(0, std::memory_order_relaxed);
+		}
+
+		void taskPosted(int32_t count = 1) {
+			pending.fetch_add(count, std::memory_order_relaxed);
+		}
+
+		void taskDone() {
+			pending.fetch_sub(1, std::memory_order_release);
+		}
+
+		int32_t getPendingCount() const {
+			return pending.load(std::memory_order_acquire);
+		}
+
+		bool isDone() const {
+			return pending.load(std::memory_order_acquire) == 0;
+		}
+	};
+
+	// internal task node, shared between the pool and the handles
+	struct ThreadPoolTask {
+		TaskMethod_Fnc fnc;
+		ThreadPoolTaskGroup* group;
+		std::atomic<int32_t> references;
+		std::atomic<bool> done;
+		GlobalThreadPriority priority;
+		bool has_deadline;
+		// pool clock, in microseconds
+		int64_t deadline;
+
+		void addReference() {
+			references.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void releaseReference() {
+			if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete this;
+		}
+	};
+
+	// Handle returned by ThreadPool::postTask.
+	//
+	// Can be ignored, or used to check/wait for the task completion.
+	class ThreadPoolTaskHandle {
+		ThreadPoolTask* task;
+	public:
+		ThreadPoolTaskHandle(ThreadPoolTask* _task = NULL) {
+			task = _task;
+			if (task != NULL)
+				task->addReference();
+		}
+		ThreadPoolTaskHandle(const ThreadPoolTaskHandle& v) {
+			task = v.task;
+			if (task != NULL)
+				task->addReference();
+		}
+		void operator=(const ThreadPoolTaskHandle& v) {
+			if (v.task != NULL)
+				v.task->addReference();
+			if (task != NULL)
+				task->releaseReference();
+			task = v.task;
+		}
+		~ThreadPoolTaskHandle() {
+			if (task != NULL)
+				task->releaseReference();
+		}
+
+		bool isValid() const {
+			return task != NULL;
+		}
+
+		bool isDone() const {
+			return task == NULL || task->done.load(std::memory_order_acquire);
+		}
+	};
+
+	// shared state of a ThreadPool::parallelFor call
+	struct ThreadPoolParallelFor {
+		ParallelForMethod_Fnc fnc;
+		std::atomic<size_t> next;
+		size_t end;
+		size_t grain;
+
+		// process chunks until the range is exhausted
+		void run() {
+			while (true) {
+				size_t chunk_begin = next.fetch_add(grain, std::memory_order_relaxed);
+				if (chunk_begin >= end)
+					return;
+				size_t chunk_end = chunk_begin + grain;
+				if (chunk_end > end || chunk_end < chunk_begin)
+					chunk_end = end;
+				fnc(chunk_begin, chunk_end);
+			}
+		}
+	};
+
+	// element of the deadline lane, ordered by the deadline (earliest first)
+	struct ThreadPoolDeadlineTask {
+		int64_t deadline;
+		ThreadPoolTask* task;
+
+		ThreadPoolDeadlineTask(int64_t _deadline = 0, ThreadPoolTask* _task = NULL) {
+			deadline = _deadline;
+			task = _task;
+		}
+
+		bool operator<(const ThreadPoolDeadlineTask& v) const { return deadline < v.deadline; }
+	};
+
+	struct ThreadPoolNode;
+
+	struct ThreadPoolWorker {
+		ThreadPool* pool;
+		ThreadPoolNode* node;
+		int index;
+		uint32_t random_state;
+		uint32_t aging_tick;
+		// processors this worker is pinned to (empty means no affinity)
+		std::vector<int> cpus;
+		// the thread could not set the affinity to the cpus
+		std::atomic<bool> affinity_failed;
+		PlatformThread* thread;
+		ObjectWorkStealingDeque<ThreadPoolTask*> deque;
+
+		// adaptive idle state
+		uint32_t spin_limit;
+		std::atomic<uint64_t> spin_wakeups;
+		std::atomic<uint64_t> yield_wakeups;
+		std::atomic<uint64_t> park_wakeups;
+	};
+
+	// Sub-pool: workers that share the same queue and permits.
+	//
+	// There is one node for each NUMA node with ThreadPoolPinPolicy_PerNUMANode
+	// and just one node with the other policies.
+	struct ThreadPoolNode {
+		// NUMA node index (-1 when the pool is not split by NUMA node)
+		int numa_node;
+		std::vector<ThreadPoolWorker*> workers;
+		// shared queue, or the global injection queue of the work stealing scheduler
+		ObjectRingQueue<ThreadPoolTask*, 4096> task_queue;
+		// receives the tasks when the task_queue is full
+		ObjectQueue<ThreadPoolTask*> overflow_queue;
+		std::atomic<int32_t> overflow_count;
+		// one permit for each posted task, the workers take them with a compare and swap
+		std::atomic<int32_t> pending_count;
+		// number of workers that are parked (or about to park) and were not woken yet
+		std::atomic<int32_t> parked_count;
+		// parks the idle workers, a post wakes one parked worker
+		PlatformSemaphore wakeup;
+
+		// priority lanes (the normal lane uses the task_queue and the worker deques)
+		ObjectQueue<ThreadPoolTask*> realtime_queue;
+		ObjectQueue<ThreadPoolTask*> high_queue;
+		ObjectQueue<ThreadPoolTask*> background_queue;
+		// earliest deadline first
+		ObjectPriorityQueue<ThreadPoolDeadlineTask> deadline_queue;
+		// number of tasks in the lanes above and in the deadline queue
+		std::atomic<int32_t> lane_count;
+		// last time each lane was served, indexed by GlobalThreadPriority (used by the aging)
+		std::atomic<int64_t> lane_served_time[4];
+
+		ThreadPoolNode() :task_queue(false), overflow_queue(false), wakeup(0),
+			realtime_queue(false), high_queue(false), background_queue(false), deadline_queue(false) {
+			numa_node = -1;
+			overflow_count.store(0, std::memory_order_relaxed);
+			pending_count.store(0, std::memory_order_relaxed);
+			parked_count.store(0, std::memory_order_relaxed);
+			lane_count.store(0, std::memory_order_relaxed);
+		}
+
+		void enqueueNormal(ThreadPoolTask** tasks, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				if (!task_queue.tryEnqueue(tasks[i])) {
+					overflow_count.fetch_add((int32_t)(count - i), std::memory_order_relaxed);
+					overflow_queue.enqueue(&tasks[i], count - i);
+					return;
+				}
+			}
+		}
+
+		ThreadPoolTask* dequeueNormal() {
+			ThreadPoolTask* task;
+			if (task_queue.tryDequeue(&task))
+				return task;
+			if (overflow_count.load(std::memory_order_relaxed) <= 0)
+				return NULL;
+			task = overflow_queue.dequeue();
+			if (task != NULL)
+				overflow_count.fetch_sub(1, std::memory_order_relaxed);
+			return task;
+		}
+
+		// the normal lane is not here: it uses the task_queue and the worker deques
+		ObjectQueue<ThreadPoolTask*>* getLaneQueue(GlobalThreadPriority priority) {
+			switch (priority) {
+			case GlobalThreadPriority_Realtime: return &realtime_queue;
+			case GlobalThreadPriority_High: return &high_queue;
+			default: return &background_queue;
+			}
+		}
+	};
 
 	class ThreadPool {
 
+		ThreadPoolScheduler scheduler;
+		ThreadPoolPinPolicy pinPolicy;
+
 		std::vector<PlatformThread*> threads;
-		ObjectQueue<TaskMethod_Fnc> task_queue;
+		std::vector<ThreadPoolWorker*> workers;
+		std::vector<ThreadPoolNode*> nodes;
+
+		std::atomic<uint32_t> next_node;
+		std::atomic<int32_t> unfinished_tasks;
+		// set by the destructor, the workers stop taking permits
+		std::atomic<bool> exiting;
+
+		std::atomic<uint32_t> idle_spin_count;
+		std::atomic<uint32_t> idle_yield_count;
+		std::atomic<uint32_t> idle_min_spin_count;
+		std::atomic<bool> idle_adaptive;
+
+		std::atomic<int64_t> aging_time;
+
+#if defined(OS_TARGET_win)
+		w32PerformanceCounter clock;
+#else
+		UnixMicroCounter clock;
+#endif
+
+		static void workerEntryPoint(ThreadPoolWorker* worker);
 
-		void run();
+		void initialize(int threadCount, const std::vector<int>& cpuSet, ThreadPoolPinPolicy pinPolicy, ThreadPoolScheduler scheduler);
+
+		void run(ThreadPoolWorker* worker);
+		bool tryAcquirePermit(ThreadPoolNode* node);
+		bool waitPermit(ThreadPoolWorker* worker);
+		void wakeWorkers(ThreadPoolNode* node, int32_t count);
+		bool findTask(ThreadPoolNode* node, ThreadPoolWorker* worker, uint32_t* random_state, ThreadPoolTask** task);
+		bool findNormalTask(ThreadPoolNode* node, ThreadPoolWorker* worker, uint32_t* random_state, ThreadPoolTask** task);
+		bool findAgedTask(ThreadPoolNode* node, ThreadPoolWorker* worker, uint32_t* random_state, ThreadPoolTask** task);
+		bool dequeueLane(ThreadPoolNode* node, GlobalThreadPriority priority, ThreadPoolTask** task);
+		void enqueueLaneTask(ThreadPoolNode* node, ThreadPoolTask* task);
+		bool dequeueDeadline(ThreadPoolNode* node, ThreadPoolTask** task);
+		void executeTask(ThreadPoolTask* task);
+		ThreadPoolTask* createTask(const TaskMethod_Fnc& fnc, ThreadPoolTaskGroup* group, GlobalThreadPriority priority = GlobalThreadPriority_Normal, int64_t deadline = 0);
+		ThreadPoolTaskHandle postSingleTask(ThreadPoolNode* node, ThreadPoolTask* task);
+		int64_t nowMicro();
+		ThreadPoolNode* selectNode(ThreadPoolWorker* worker);
+		void enqueueTasks(ThreadPoolNode* node, ThreadPoolWorker* worker, ThreadPoolTask** tasks, size_t count);
 
 	public:
 
-		ThreadPool();
+		// one worker for each logical processor, without affinity
+		ThreadPool(ThreadPoolScheduler scheduler = ThreadPoolScheduler_SharedQueue);
+
+		// threadCount <= 0 means one worker for each processor of the cpu set
+		// an empty cpuSet means all the processors of the machine
+		ThreadPool(int threadCount,
+			const std::vector<int>& cpuSet = std::vector<int>(),
+			ThreadPoolPinPolicy pinPolicy = ThreadPoolPinPolicy_None,
+			ThreadPoolScheduler scheduler = ThreadPoolScheduler_SharedQueue);
+
 		~ThreadPool();
-		void postTask(const TaskMethod_Fnc& fnc);
+
+		// group is optional, when set it is incremented now and decremented after the task execution
+		//
+		// tasks posted from a worker stay in its NUMA node, the others are distributed round robin
+		ThreadPoolTaskHandle postTask(const TaskMethod_Fnc& fnc, ThreadPoolTaskGroup* group = NULL);
+
+		// post the task to the sub-pool of the NUMA node (see getNodeCount)
+		ThreadPoolTaskHandle postTaskToNode(int node, const TaskMethod_Fnc& fnc, ThreadPoolTaskGroup* group = NULL);
+
+		// Post the task to a priority lane.
+		//
+		// The workers drain the realtime lane, the deadline tasks and the high lane before the normal tasks.
+		// GlobalThreadPriority_None is the background lane: it runs when there is nothing else to do.
+		// GlobalThreadPriority_Normal is the same as postTask(fnc, group).
+		ThreadPoolTaskHandle postTask(const TaskMethod_Fnc& fnc, GlobalThreadPriority priority, ThreadPoolTaskGroup* group = NULL);
+
+		// Post the task with a deadline, in microseconds from now.
+		//
+		// The deadline tasks run earliest deadline first, after the realtime lane and before the high lane.
+		ThreadPoolTaskHandle postTaskWithDeadline(const TaskMethod_Fnc& fnc, int64_t deadlineMicro, ThreadPoolTaskGroup* group = NULL);
+
+		// Post count tasks with one queue lock and one update of the permits.
+		// Only min(count, parked workers) workers are woken (one post for each).
+		void postTasks(const TaskMethod_Fnc* fnc, size_t count, ThreadPoolTaskGroup* group = NULL);
+
+		// Split [begin, end) in chunks of grain elements and call fnc(chunk_begin, chunk_end) in parallel.
+		//
+		// The calling thread processes chunks too and returns after all chunks are done.
+		void parallelFor(size_t begin, size_t end, size_t grain, const ParallelForMethod_Fnc& fnc);
+
+		// Run one pending task in the calling thread.
+		//
+		// Returns false if there is no task to run.
+		bool runPendingTask();
+
+		// The waits below help the pool running pending tasks instead of sleeping,
+		// so they can be called from inside a task (nested parallelism).
+		void wait(const ThreadPoolTaskHandle& handle);
+		void waitAll(ThreadPoolTaskGroup* group);
+		// wait all tasks posted to the pool
+		void waitAll();
+
+		int getThreadCount() const;
+		ThreadPoolScheduler getScheduler() const;
+		ThreadPoolPinPolicy getPinPolicy() const;
+
+		// number of sub-pools (NUMA nodes with ThreadPoolPinPolicy_PerNUMANode, 1 otherwise)
+		int getNodeCount() const;
+
+		// Number of workers that could not be pinned to their processors
+		// (all the pinned workers on mac). Updated when each worker thread starts.
+		int getAffinityFailureCount() const;
+
+		// the default policy parks the idle workers right away
+		void setIdlePolicy(const ThreadPoolIdlePolicy& policy);
+		ThreadPoolIdlePolicy getIdlePolicy() const;
+
+		// sum of the counters of all workers
+		ThreadPoolIdleStats getIdleStats() const;
+
+		// A lane that was not served for more than the aging time runs before the higher lanes,
+		// so the low priority work is never starved (default 10ms, 0 disables the aging).
+		void setAgingTime(int64_t micros);
+		int64_t getAgingTime() const;
+
+		// returns the worker running the current thread, or NULL if it is not a worker of this pool
+		ThreadPoolWorker* getCurrentWorker();
 
 	};
 }
 
-#endif
\ No newline at end of file
+#endif